@@ -206,6 +206,28 @@
 #define DB_HEAP_CACHE_LIMIT		1
 #endif /* DB_HEAP_CACHE_LIMIT */
 
+/* The maximum number of B+-tree indexes. */
+#ifndef DB_BTREE_INDEX_LIMIT
+#define DB_BTREE_INDEX_LIMIT		1
+#endif /* DB_BTREE_INDEX_LIMIT */
+
+/* The maximum number of keys in a B+-tree node. */
+#ifndef DB_BTREE_ORDER
+#define DB_BTREE_ORDER			14
+#endif /* DB_BTREE_ORDER */
+
+/* The number of node slots initially reserved in the file of a B+-tree
+   index. The file doubles in size when it gets more than half full. */
+#ifndef DB_BTREE_NODE_LIMIT
+#define DB_BTREE_NODE_LIMIT		512
+#endif /* DB_BTREE_NODE_LIMIT */
+
+/* The number of B+-tree nodes cached in RAM. An insertion needs room
+   for about twice the height of the tree. */
+#ifndef DB_BTREE_CACHE_LIMIT
+#define DB_BTREE_CACHE_LIMIT		8
+#endif /* DB_BTREE_CACHE_LIMIT */
+
 /*----------------------------------------------------------------------------*/
 
 /* LVM options. */
@@ -0,0 +1,1279 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *     A B+-tree index for flash memory.
+ *
+ *     The tree is stored in a single file of fixed-size node slots.
+ *     Nodes are never rewritten in place: a modified node is written
+ *     to the next free slot, and so are all its ancestors up to a new
+ *     root. This keeps the writes sequential, which suits flash
+ *     memories as well as the flash-aware I/O semantics that the
+ *     storage layer uses. Because old nodes are left intact until
+ *     the file is compacted, the last root that was written always
+ *     describes a consistent tree. Rows that were inserted into the
+ *     relation after that are added when a loaded tree is first used.
+ *     When the live nodes fill more than half of the file, compaction
+ *     doubles its size.
+ *
+ *     A row that cannot be added to the tree, for instance because
+ *     the storage is full, does not fail the insertion. The tree
+ *     catches up with the relation when it is next used, and searches
+ *     scan the relation instead for as long as it cannot.
+ *
+ *     Modified nodes are kept in a small RAM cache and are written
+ *     back in a batch, deepest nodes first, when the cache needs room,
+ *     when a search starts, and when the index is released. Sorted
+ *     insertions keep the rightmost leaf full when it splits, so the
+ *     initial load of an index over an existing relation produces a
+ *     densely packed tree. Deletions remove entries from the leaves
+ *     without merging nodes.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/memb.h"
+
+#include "db-options.h"
+#include "index.h"
+#include "result.h"
+#include "storage.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+#define ORDER		DB_BTREE_ORDER
+#define NODE_LIMIT	DB_BTREE_NODE_LIMIT
+#define MAX_HEIGHT	6
+/* The file can grow until the slot IDs reach TEMP_NODE. */
+#define NODE_MAX	TEMP_NODE
+
+#define NODE_MAGIC	0xb7
+#define NODE_FLAG_LEAF	0x01
+#define NODE_FLAG_ROOT	0x02
+
+/* Nodes created since the last write-back have no slot yet, and are
+   identified by their cache entry instead. */
+#define TEMP_NODE	0x8000
+#define INVALID_NODE	0xffff
+
+#if ORDER < 3 || ORDER > 255
+#error "DB_BTREE_ORDER must be between 3 and 255."
+#endif
+
+#if NODE_LIMIT > NODE_MAX
+#error "DB_BTREE_NODE_LIMIT is too large."
+#endif
+
+typedef int32_t btree_key_t;
+typedef uint16_t btree_node_id_t;
+
+#define KEY_MIN		INT32_MIN
+#define KEY_MAX		INT32_MAX
+
+/*
+ * A leaf holds count (key, tuple ID) pairs. An internal node holds
+ * count keys and count + 1 child node IDs, where the child at index i
+ * covers the keys between keys[i - 1] and keys[i], inclusive.
+ */
+struct btree_node {
+  uint8_t magic;
+  uint8_t flags;
+  uint8_t count;
+  /* The height and the number of indexed rows are only set in roots. */
+  uint8_t height;
+  tuple_id_t rows;
+  btree_key_t keys[ORDER];
+  tuple_id_t values[ORDER + 1];
+};
+
+#define NODE_OFFSET(id)	((unsigned long)(id) * sizeof(struct btree_node))
+
+struct btree {
+  index_t *index;
+  db_storage_id_t storage;
+  btree_node_id_t root;
+  btree_node_id_t next_node;
+  /* The number of slots in the file. */
+  btree_node_id_t node_limit;
+  uint8_t height;
+  /* Set if rows of the relation may be missing from a loaded tree. */
+  uint8_t pending;
+  tuple_id_t rows;
+};
+typedef struct btree btree_t;
+
+struct node_cache {
+  btree_t *tree;
+  btree_node_id_t id;
+  uint16_t used;
+  uint8_t level;
+  uint8_t dirty;
+  struct btree_node node;
+};
+
+/* Keep a cache of nodes read from storage. Dirty nodes stay in the
+   cache until they are written back. */
+static struct node_cache node_cache[DB_BTREE_CACHE_LIMIT];
+static uint16_t cache_clock;
+MEMB(btrees, btree_t, DB_BTREE_INDEX_LIMIT);
+
+/* Temporary space for a node that overflows during an insertion. */
+static btree_key_t split_keys[ORDER + 1];
+static tuple_id_t split_values[ORDER + 2];
+
+static struct node_cache *get_cache(btree_t *, btree_node_id_t);
+static struct node_cache *get_cache_free(void);
+static void invalidate_cache(btree_t *);
+static int cache_available(void);
+static struct node_cache *get_node(btree_t *, btree_node_id_t, uint8_t);
+static struct node_cache *new_node(btree_t *, uint8_t);
+static int write_node(btree_t *, struct node_cache *);
+static int write_back(btree_t *);
+static int write_back_all(void);
+static btree_node_id_t copy_subtree(btree_t *, db_storage_id_t,
+                                    btree_node_id_t, uint8_t,
+                                    btree_node_id_t *);
+static int compact(btree_t *);
+static int reserve_file(const char *, btree_node_id_t);
+static int reset_tree(btree_t *);
+static int get_key(btree_t *, tuple_id_t, long *);
+static int update_tree(btree_t *, tuple_id_t);
+static int insert_cost(btree_t *, btree_key_t);
+static int insert_item(btree_t *, btree_key_t, tuple_id_t);
+static btree_node_id_t delete_item(btree_t *, btree_node_id_t, uint8_t,
+                                   btree_key_t);
+static btree_key_t value_to_key(attribute_value_t *);
+
+static db_result_t create(index_t *);
+static db_result_t destroy(index_t *);
+static db_result_t load(index_t *);
+static db_result_t release(index_t *);
+static db_result_t insert(index_t *, attribute_value_t *, tuple_id_t);
+static db_result_t delete(index_t *, attribute_value_t *);
+static tuple_id_t get_next(index_iterator_t *);
+
+index_api_t index_btree = {
+  INDEX_BTREE,
+  INDEX_API_EXTERNAL | INDEX_API_RANGE_QUERIES,
+  create,
+  destroy,
+  load,
+  release,
+  insert,
+  delete,
+  get_next
+};
+
+/* The position of the first key that is not smaller than the given key. */
+static int
+lower_bound(struct btree_node *node, btree_key_t key)
+{
+  int low, high, mid;
+
+  low = 0;
+  high = node->count;
+  while(low < high) {
+    mid = (low + high) / 2;
+    if(node->keys[mid] < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+/* The position of the first key that is larger than the given key. */
+static int
+upper_bound(struct btree_node *node, btree_key_t key)
+{
+  int low, high, mid;
+
+  low = 0;
+  high = node->count;
+  while(low < high) {
+    mid = (low + high) / 2;
+    if(node->keys[mid] <= key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static struct node_cache *
+get_cache(btree_t *tree, btree_node_id_t id)
+{
+  int i;
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree && node_cache[i].id == id) {
+      return &node_cache[i];
+    }
+  }
+  return NULL;
+}
+
+/* Find an unused entry, or else the least recently used clean entry. */
+static struct node_cache *
+get_cache_free(void)
+{
+  struct node_cache *victim;
+  int i;
+
+  victim = NULL;
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == NULL) {
+      return &node_cache[i];
+    }
+    if(!node_cache[i].dirty &&
+       (victim == NULL ||
+        (uint16_t)(cache_clock - node_cache[i].used) >
+        (uint16_t)(cache_clock - victim->used))) {
+      victim = &node_cache[i];
+    }
+  }
+  return victim;
+}
+
+static void
+invalidate_cache(btree_t *tree)
+{
+  int i;
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree) {
+      node_cache[i].tree = NULL;
+      node_cache[i].dirty = 0;
+    }
+  }
+}
+
+static int
+cache_available(void)
+{
+  int i;
+  int count;
+
+  for(i = count = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(!node_cache[i].dirty) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/*
+ * Get a node through the cache. The returned pointer is valid until
+ * the next call that may load a node, unless the node is dirty. Dirty
+ * nodes are not written back here, because that would change the IDs
+ * that the caller has read from their parents.
+ */
+static struct node_cache *
+get_node(btree_t *tree, btree_node_id_t id, uint8_t level)
+{
+  struct node_cache *cache;
+
+  cache = get_cache(tree, id);
+  if(cache == NULL) {
+    if(id & TEMP_NODE) {
+      return NULL;
+    }
+
+    cache = get_cache_free();
+    if(cache == NULL) {
+      PRINTF("DB: No clean B+-tree node in the cache\n");
+      return NULL;
+    }
+
+    cache->tree = NULL;
+    if(DB_ERROR(storage_read(tree->storage, &cache->node,
+                             NODE_OFFSET(id), sizeof(cache->node)))) {
+      PRINTF("DB: Failed to read B+-tree node %u\n", (unsigned)id);
+      return NULL;
+    }
+    if(cache->node.magic != NODE_MAGIC) {
+      PRINTF("DB: Invalid B+-tree node %u\n", (unsigned)id);
+      return NULL;
+    }
+    cache->tree = tree;
+    cache->id = id;
+    cache->dirty = 0;
+  }
+
+  cache->level = level;
+  cache->used = ++cache_clock;
+  return cache;
+}
+
+static struct node_cache *
+new_node(btree_t *tree, uint8_t level)
+{
+  struct node_cache *cache;
+
+  cache = get_cache_free();
+  if(cache == NULL) {
+    return NULL;
+  }
+
+  memset(&cache->node, 0, sizeof(cache->node));
+  cache->node.magic = NODE_MAGIC;
+  cache->tree = tree;
+  cache->id = TEMP_NODE | (cache - node_cache);
+  cache->level = level;
+  cache->dirty = 1;
+  cache->used = ++cache_clock;
+  return cache;
+}
+
+/*
+ * Write a dirty node to the next free slot, and redirect the
+ * reference from its parent, which is always dirty as well.
+ */
+static int
+write_node(btree_t *tree, struct node_cache *cache)
+{
+  btree_node_id_t id;
+  int i, j;
+
+  id = tree->next_node;
+
+  if(cache->level == 0) {
+    cache->node.flags |= NODE_FLAG_ROOT;
+    cache->node.height = tree->height;
+    cache->node.rows = tree->rows;
+  } else {
+    cache->node.flags &= ~NODE_FLAG_ROOT;
+    cache->node.height = 0;
+    cache->node.rows = 0;
+  }
+
+  if(DB_ERROR(storage_write(tree->storage, &cache->node,
+                            NODE_OFFSET(id), sizeof(cache->node)))) {
+    PRINTF("DB: Failed to write B+-tree node %u\n", (unsigned)id);
+    return -1;
+  }
+  tree->next_node++;
+
+  if(cache->level == 0) {
+    tree->root = id;
+  } else {
+    for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+      if(node_cache[i].tree != tree || !node_cache[i].dirty ||
+         node_cache[i].level != cache->level - 1) {
+        continue;
+      }
+      for(j = 0; j <= node_cache[i].node.count; j++) {
+        if(node_cache[i].node.values[j] == cache->id) {
+          node_cache[i].node.values[j] = id;
+          break;
+        }
+      }
+    }
+  }
+
+  cache->id = id;
+  cache->dirty = 0;
+  return 0;
+}
+
+/* Write back all dirty nodes of a tree, ending with a new root. */
+static int
+write_back(btree_t *tree)
+{
+  int i;
+  int dirty;
+  int level;
+
+  for(i = dirty = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree && node_cache[i].dirty) {
+      dirty++;
+    }
+  }
+
+  if(dirty == 0) {
+    return 0;
+  }
+
+  if(tree->next_node + dirty > tree->node_limit) {
+    return compact(tree);
+  }
+
+  PRINTF("DB: Writing back %d B+-tree nodes\n", dirty);
+
+  for(level = MAX_HEIGHT - 1; level >= 0; level--) {
+    for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+      if(node_cache[i].tree == tree && node_cache[i].dirty &&
+         node_cache[i].level == level) {
+        if(write_node(tree, &node_cache[i]) < 0) {
+          return -1;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int
+write_back_all(void)
+{
+  int i;
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree != NULL && node_cache[i].dirty) {
+      if(write_back(node_cache[i].tree) < 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * Copy the nodes that are reachable from a node into the beginning
+ * of another file, children before parents. Returns the new ID of
+ * the node.
+ */
+static btree_node_id_t
+copy_subtree(btree_t *tree, db_storage_id_t fd, btree_node_id_t id,
+             uint8_t level, btree_node_id_t *next)
+{
+  struct btree_node node;
+  struct node_cache *cache;
+  btree_node_id_t child;
+  int i;
+
+  cache = get_cache(tree, id);
+  if(cache != NULL) {
+    memcpy(&node, &cache->node, sizeof(node));
+  } else if(DB_ERROR(storage_read(tree->storage, &node,
+                                  NODE_OFFSET(id), sizeof(node)))) {
+    return INVALID_NODE;
+  }
+
+  if(!(node.flags & NODE_FLAG_LEAF)) {
+    for(i = 0; i <= node.count; i++) {
+      child = copy_subtree(tree, fd, node.values[i], level + 1, next);
+      if(child == INVALID_NODE) {
+        return INVALID_NODE;
+      }
+      node.values[i] = child;
+    }
+  }
+
+  if(*next >= NODE_MAX) {
+    return INVALID_NODE;
+  }
+
+  if(level == 0) {
+    node.flags |= NODE_FLAG_ROOT;
+    node.height = tree->height;
+    node.rows = tree->rows;
+  } else {
+    node.flags &= ~NODE_FLAG_ROOT;
+  }
+
+  if(DB_ERROR(storage_write(fd, &node, NODE_OFFSET(*next), sizeof(node)))) {
+    return INVALID_NODE;
+  }
+
+  return (*next)++;
+}
+
+static int
+reserve_file(const char *filename, btree_node_id_t node_limit)
+{
+#if DB_FEATURE_COFFEE
+  return cfs_coffee_reserve(filename, NODE_OFFSET(node_limit));
+#else
+  int fd;
+
+  fd = cfs_open(filename, CFS_WRITE);
+  if(fd < 0) {
+    return -1;
+  }
+  cfs_close(fd);
+  return 0;
+#endif /* DB_FEATURE_COFFEE */
+}
+
+/*
+ * Reclaim the slots of obsolete nodes. The live nodes, including
+ * those that are dirty in the cache, are copied into a temporary
+ * file, which is then copied back over a new tree file. The new file
+ * is twice as large if the live nodes would fill more than half of
+ * it, so that the compactions become rarer as the tree grows.
+ */
+static int
+compact(btree_t *tree)
+{
+  char tmp_filename[DB_MAX_FILENAME_LENGTH];
+  struct btree_node node;
+  db_storage_id_t fd;
+  btree_node_id_t next;
+  btree_node_id_t node_limit;
+  btree_node_id_t i;
+  char *filename;
+  int result;
+
+  PRINTF("DB: Compacting the B+-tree in %s\n", tree->index->descriptor_file);
+
+  filename = storage_generate_file("btmp", NODE_OFFSET(tree->node_limit));
+  if(filename == NULL) {
+    return -1;
+  }
+  memcpy(tmp_filename, filename, sizeof(tmp_filename));
+
+  result = -1;
+  fd = storage_open(tmp_filename);
+  if(fd < 0) {
+    goto end;
+  }
+
+  next = 0;
+  if(copy_subtree(tree, fd, tree->root, 0, &next) == INVALID_NODE) {
+    PRINTF("DB: The B+-tree does not fit in %d nodes\n", NODE_MAX);
+    goto end;
+  }
+
+  node_limit = tree->node_limit;
+  while(next > node_limit / 2 && node_limit < NODE_MAX) {
+    node_limit = node_limit > NODE_MAX / 2 ? NODE_MAX : node_limit * 2;
+  }
+
+  invalidate_cache(tree);
+  storage_close(tree->storage);
+  cfs_remove(tree->index->descriptor_file);
+  if(reserve_file(tree->index->descriptor_file, node_limit) < 0) {
+    /* Keep the old size if there is no room for a larger file. */
+    node_limit = tree->node_limit;
+    if(reserve_file(tree->index->descriptor_file, node_limit) < 0) {
+      tree->storage = -1;
+      goto end;
+    }
+  }
+  tree->storage = storage_open(tree->index->descriptor_file);
+  if(tree->storage < 0) {
+    goto end;
+  }
+
+  for(i = 0; i < next; i++) {
+    if(DB_ERROR(storage_read(fd, &node, NODE_OFFSET(i), sizeof(node))) ||
+       DB_ERROR(storage_write(tree->storage, &node,
+                              NODE_OFFSET(i), sizeof(node)))) {
+      goto end;
+    }
+  }
+
+  tree->root = next - 1;
+  tree->next_node = next;
+  tree->node_limit = node_limit;
+  result = 0;
+
+  PRINTF("DB: Compacted the B+-tree into %u of %u nodes\n",
+         (unsigned)next, (unsigned)node_limit);
+
+ end:
+  if(fd >= 0) {
+    storage_close(fd);
+  }
+  cfs_remove(tmp_filename);
+  return result;
+}
+
+/* Start over with an empty tree, which is written back when needed. */
+static int
+reset_tree(btree_t *tree)
+{
+  struct node_cache *root;
+
+  invalidate_cache(tree);
+  root = new_node(tree, 0);
+  if(root == NULL) {
+    if(write_back_all() < 0 || (root = new_node(tree, 0)) == NULL) {
+      return -1;
+    }
+  }
+
+  root->node.flags = NODE_FLAG_LEAF;
+  tree->root = root->id;
+  tree->height = 1;
+  tree->rows = 0;
+  return 0;
+}
+
+/* Read the indexed value of a row from the relation. */
+static int
+get_key(btree_t *tree, tuple_id_t tuple_id, long *key)
+{
+  unsigned char row[DB_MAX_ATTRIBUTES_PER_RELATION * DB_MAX_ELEMENT_SIZE];
+  attribute_value_t value;
+  relation_t *rel;
+
+  rel = tree->index->rel;
+  if(storage_get_row(rel, &tuple_id, row) != DB_OK ||
+     DB_ERROR(relation_get_value(rel, tree->index->attr, row, &value))) {
+    return -1;
+  }
+  *key = db_value_to_long(&value);
+  return 0;
+}
+
+/*
+ * Insert the rows that were added to the relation after the last
+ * write-back of a loaded tree, up to the given tuple ID. This waits
+ * until the index is first used, because the relation is still being
+ * loaded when the index is.
+ */
+static int
+update_tree(btree_t *tree, tuple_id_t end)
+{
+  tuple_id_t tuple_id;
+  long key;
+
+  if(tree->rows > end && reset_tree(tree) < 0) {
+    return -1;
+  }
+
+  PRINTF("DB: Adding rows %lu to %lu to the B+-tree\n",
+	 (unsigned long)tree->rows, (unsigned long)end);
+
+  for(tuple_id = tree->rows; tuple_id < end; tuple_id++) {
+    if(get_key(tree, tuple_id, &key) < 0 ||
+       key < KEY_MIN || key > KEY_MAX ||
+       insert_item(tree, (btree_key_t)key, tuple_id) < 0) {
+      return -1;
+    }
+  }
+
+  tree->pending = 0;
+  return 0;
+}
+
+/*
+ * Count the cache entries that an insertion of the key needs: one for
+ * each clean node on the path to the leaf, and one for each node that
+ * a split would add.
+ */
+static int
+insert_cost(btree_t *tree, btree_key_t key)
+{
+  struct node_cache *node;
+  btree_node_id_t id;
+  int level;
+  int clean;
+  int splits;
+
+  id = tree->root;
+  clean = splits = 0;
+  for(level = 0;; level++) {
+    node = get_node(tree, id, level);
+    if(node == NULL) {
+      return -1;
+    }
+    clean += !node->dirty;
+    /* Only the full nodes nearest to the leaf are split. */
+    splits = node->node.count < ORDER ? 0 : splits + 1;
+    if(node->node.flags & NODE_FLAG_LEAF) {
+      break;
+    }
+    id = node->node.values[upper_bound(&node->node, key)];
+  }
+
+  /* A split of the root adds a new root as well. */
+  return clean + splits + (splits == level + 1);
+}
+
+static int
+insert_item(btree_t *tree, btree_key_t key, tuple_id_t value)
+{
+  struct node_cache *path[MAX_HEIGHT];
+  uint8_t child[MAX_HEIGHT];
+  struct node_cache *node;
+  struct node_cache *right;
+  struct node_cache *root;
+  btree_node_id_t id;
+  btree_key_t split_key;
+  int level;
+  int pos;
+  int split;
+  int rightmost;
+  int needed;
+  int i;
+
+  /* Make room in the cache for the clean nodes on the path, which
+     become dirty, and for the nodes that the insertion adds. */
+  if(cache_available() == 0 && write_back_all() < 0) {
+    return -1;
+  }
+  needed = insert_cost(tree, key);
+  if(needed < 0) {
+    return -1;
+  }
+  if(cache_available() < needed) {
+    if(write_back_all() < 0) {
+      return -1;
+    }
+    needed = insert_cost(tree, key);
+    if(needed < 0 || cache_available() < needed) {
+      PRINTF("DB: The B+-tree node cache is too small\n");
+      return -1;
+    }
+  }
+
+  /* Find the leaf, and mark the path to it dirty. */
+  id = tree->root;
+  rightmost = 1;
+  for(level = 0;; level++) {
+    node = get_node(tree, id, level);
+    if(node == NULL) {
+      return -1;
+    }
+    node->dirty = 1;
+    path[level] = node;
+    if(node->node.flags & NODE_FLAG_LEAF) {
+      break;
+    }
+    child[level] = upper_bound(&node->node, key);
+    rightmost &= child[level] == node->node.count;
+    id = node->node.values[child[level]];
+  }
+
+  if(value >= tree->rows) {
+    tree->rows = value + 1;
+  }
+
+  pos = upper_bound(&node->node, key);
+  if(node->node.count < ORDER) {
+    memmove(&node->node.keys[pos + 1], &node->node.keys[pos],
+            (node->node.count - pos) * sizeof(btree_key_t));
+    memmove(&node->node.values[pos + 1], &node->node.values[pos],
+            (node->node.count - pos) * sizeof(tuple_id_t));
+    node->node.keys[pos] = key;
+    node->node.values[pos] = value;
+    node->node.count++;
+    return 0;
+  }
+
+  /* Split the leaf. An append to the rightmost leaf leaves the old
+     leaf full, which packs the tree when the keys arrive in order. */
+  memcpy(split_keys, node->node.keys, pos * sizeof(btree_key_t));
+  memcpy(split_values, node->node.values, pos * sizeof(tuple_id_t));
+  split_keys[pos] = key;
+  split_values[pos] = value;
+  memcpy(&split_keys[pos + 1], &node->node.keys[pos],
+         (ORDER - pos) * sizeof(btree_key_t));
+  memcpy(&split_values[pos + 1], &node->node.values[pos],
+         (ORDER - pos) * sizeof(tuple_id_t));
+
+  split = rightmost && pos == ORDER ? ORDER : (ORDER + 1) / 2;
+
+  right = new_node(tree, level);
+  if(right == NULL) {
+    return -1;
+  }
+  right->node.flags = NODE_FLAG_LEAF;
+  right->node.count = ORDER + 1 - split;
+  memcpy(right->node.keys, &split_keys[split],
+         right->node.count * sizeof(btree_key_t));
+  memcpy(right->node.values, &split_values[split],
+         right->node.count * sizeof(tuple_id_t));
+  node->node.count = split;
+  memcpy(node->node.keys, split_keys, split * sizeof(btree_key_t));
+  memcpy(node->node.values, split_values, split * sizeof(tuple_id_t));
+
+  split_key = right->node.keys[0];
+  id = right->id;
+
+  /* Insert the new node into the parents, splitting them as needed. */
+  for(level--; level >= 0; level--) {
+    node = path[level];
+    pos = child[level];
+
+    if(node->node.count < ORDER) {
+      memmove(&node->node.keys[pos + 1], &node->node.keys[pos],
+              (node->node.count - pos) * sizeof(btree_key_t));
+      memmove(&node->node.values[pos + 2], &node->node.values[pos + 1],
+              (node->node.count - pos) * sizeof(tuple_id_t));
+      node->node.keys[pos] = split_key;
+      node->node.values[pos + 1] = id;
+      node->node.count++;
+      return 0;
+    }
+
+    memcpy(split_keys, node->node.keys, pos * sizeof(btree_key_t));
+    memcpy(split_values, node->node.values, (pos + 1) * sizeof(tuple_id_t));
+    split_keys[pos] = split_key;
+    split_values[pos + 1] = id;
+    memcpy(&split_keys[pos + 1], &node->node.keys[pos],
+           (ORDER - pos) * sizeof(btree_key_t));
+    memcpy(&split_values[pos + 2], &node->node.values[pos + 1],
+           (ORDER - pos) * sizeof(tuple_id_t));
+
+    /* The key at the split position moves up to the parent. */
+    split = rightmost && pos == ORDER ? ORDER - 1 : ORDER / 2;
+
+    right = new_node(tree, level);
+    if(right == NULL) {
+      return -1;
+    }
+    right->node.count = ORDER - split;
+    memcpy(right->node.keys, &split_keys[split + 1],
+           right->node.count * sizeof(btree_key_t));
+    memcpy(right->node.values, &split_values[split + 1],
+           (right->node.count + 1) * sizeof(tuple_id_t));
+    node->node.count = split;
+    memcpy(node->node.keys, split_keys, split * sizeof(btree_key_t));
+    memcpy(node->node.values, split_values, (split + 1) * sizeof(tuple_id_t));
+
+    split_key = split_keys[split];
+    id = right->id;
+  }
+
+  /* The root was split. */
+  if(tree->height == MAX_HEIGHT) {
+    PRINTF("DB: The B+-tree is too high\n");
+    return -1;
+  }
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree) {
+      node_cache[i].level++;
+    }
+  }
+
+  root = new_node(tree, 0);
+  if(root == NULL) {
+    return -1;
+  }
+  root->node.count = 1;
+  root->node.keys[0] = split_key;
+  root->node.values[0] = path[0]->id;
+  root->node.values[1] = id;
+  tree->root = root->id;
+  tree->height++;
+
+  return 0;
+}
+
+/*
+ * Remove all entries with the given key from a subtree whose nodes
+ * are all clean, and write the modified nodes to new slots. Returns
+ * the new ID of the subtree root, which is unchanged if the subtree
+ * did not contain the key.
+ */
+static btree_node_id_t
+delete_item(btree_t *tree, btree_node_id_t id, uint8_t level,
+            btree_key_t key)
+{
+  struct btree_node node;
+  struct node_cache *cache;
+  btree_node_id_t child;
+  int changed;
+  int i, j;
+
+  cache = get_node(tree, id, level);
+  if(cache == NULL) {
+    return INVALID_NODE;
+  }
+  memcpy(&node, &cache->node, sizeof(node));
+
+  changed = 0;
+  if(node.flags & NODE_FLAG_LEAF) {
+    for(i = j = 0; i < node.count; i++) {
+      if(node.keys[i] != key) {
+        node.keys[j] = node.keys[i];
+        node.values[j] = node.values[i];
+        j++;
+      }
+    }
+    changed = j != node.count;
+    node.count = j;
+  } else {
+    for(i = lower_bound(&node, key); i <= upper_bound(&node, key); i++) {
+      child = delete_item(tree, node.values[i], level + 1, key);
+      if(child == INVALID_NODE) {
+        return INVALID_NODE;
+      }
+      if(child != node.values[i]) {
+        node.values[i] = child;
+        changed = 1;
+      }
+    }
+  }
+
+  if(!changed) {
+    return id;
+  }
+
+  if(tree->next_node >= tree->node_limit) {
+    return INVALID_NODE;
+  }
+
+  /* Cache the new version of the node and write it out. */
+  cache = new_node(tree, level);
+  if(cache == NULL) {
+    return INVALID_NODE;
+  }
+  memcpy(&cache->node, &node, sizeof(node));
+  if(write_node(tree, cache) < 0) {
+    cache->tree = NULL;
+    cache->dirty = 0;
+    return INVALID_NODE;
+  }
+
+  return cache->id;
+}
+
+static btree_key_t
+value_to_key(attribute_value_t *value)
+{
+  long key;
+
+  key = db_value_to_long(value);
+  if(key < KEY_MIN) {
+    return KEY_MIN;
+  } else if(key > KEY_MAX) {
+    return KEY_MAX;
+  }
+  return (btree_key_t)key;
+}
+
+static db_result_t
+create(index_t *index)
+{
+  char *filename;
+  btree_t *tree;
+
+  filename = storage_generate_file("btree", NODE_OFFSET(NODE_LIMIT));
+  if(filename == NULL) {
+    PRINTF("DB: Failed to generate a B+-tree file\n");
+    return DB_INDEX_ERROR;
+  }
+
+  memcpy(index->descriptor_file, filename,
+	 sizeof(index->descriptor_file));
+
+  PRINTF("DB: Generated the B+-tree file \"%s\" using %lu bytes of space\n",
+	 index->descriptor_file, (unsigned long)NODE_OFFSET(NODE_LIMIT));
+
+  index->opaque_data = tree = memb_alloc(&btrees);
+  if(tree == NULL) {
+    PRINTF("DB: Failed to allocate a B+-tree\n");
+    cfs_remove(index->descriptor_file);
+    return DB_ALLOCATION_ERROR;
+  }
+
+  tree->index = index;
+  tree->next_node = 0;
+  tree->node_limit = NODE_LIMIT;
+  tree->pending = 0;
+  tree->storage = storage_open(index->descriptor_file);
+  if(tree->storage < 0 || reset_tree(tree) < 0 || write_back(tree) < 0) {
+    release(index);
+    cfs_remove(index->descriptor_file);
+    return DB_STORAGE_ERROR;
+  }
+
+  PRINTF("DB: Created a B+-tree index\n");
+  return DB_OK;
+}
+
+static db_result_t
+destroy(index_t *index)
+{
+  /* The index has already been released. */
+  cfs_remove(index->descriptor_file);
+  return DB_OK;
+}
+
+static db_result_t
+load(index_t *index)
+{
+  struct btree_node node;
+  btree_node_id_t id;
+  btree_t *tree;
+
+  index->opaque_data = tree = memb_alloc(&btrees);
+  if(tree == NULL) {
+    PRINTF("DB: Failed to allocate a B+-tree\n");
+    return DB_ALLOCATION_ERROR;
+  }
+
+  tree->index = index;
+  tree->storage = storage_open(index->descriptor_file);
+  if(tree->storage < 0) {
+    memb_free(&btrees, tree);
+    return DB_STORAGE_ERROR;
+  }
+
+  /* The slots are used in order, so the tree is described by the
+     last root before the first unused slot. */
+  tree->root = INVALID_NODE;
+  for(id = 0; id < NODE_MAX; id++) {
+    if(DB_ERROR(storage_read(tree->storage, &node, NODE_OFFSET(id),
+                             offsetof(struct btree_node, keys))) ||
+       node.magic != NODE_MAGIC) {
+      break;
+    }
+    if(node.flags & NODE_FLAG_ROOT) {
+      tree->root = id;
+      tree->height = node.height;
+      tree->rows = node.rows;
+    }
+  }
+  tree->next_node = id;
+  for(tree->node_limit = NODE_LIMIT; tree->node_limit < id;) {
+    tree->node_limit = tree->node_limit > NODE_MAX / 2 ?
+                       NODE_MAX : tree->node_limit * 2;
+  }
+
+  if(tree->root == INVALID_NODE && reset_tree(tree) < 0) {
+    release(index);
+    return DB_INDEX_ERROR;
+  }
+
+  /* Rows that were inserted after the last write-back are missing
+     from the tree, and are added from the relation later. */
+  tree->pending = 1;
+
+  PRINTF("DB: Loaded a B+-tree of height %u from file %s\n",
+	 (unsigned)tree->height, index->descriptor_file);
+
+  return DB_OK;
+}
+
+static db_result_t
+release(index_t *index)
+{
+  btree_t *tree;
+
+  tree = index->opaque_data;
+
+  /* Rows that are lost if the write-back fails are added again from
+     the relation when the tree is loaded. */
+  if(tree->storage >= 0 && write_back(tree) < 0) {
+    PRINTF("DB: Failed to write back the B+-tree\n");
+  }
+
+  invalidate_cache(tree);
+  if(tree->storage >= 0) {
+    storage_close(tree->storage);
+  }
+  memb_free(&btrees, tree);
+  return DB_OK;
+}
+
+static db_result_t
+insert(index_t *index, attribute_value_t *key, tuple_id_t value)
+{
+  btree_t *tree;
+  long long_key;
+
+  tree = (btree_t *)index->opaque_data;
+
+  long_key = db_value_to_long(key);
+  if(long_key < KEY_MIN || long_key > KEY_MAX) {
+    PRINTF("DB: Key %ld is out of range for a B+-tree index\n", long_key);
+    return DB_INDEX_ERROR;
+  }
+
+  /* If the row cannot be inserted now, it is added from the relation
+     when the tree is next used. */
+  if((tree->pending && update_tree(tree, value) < 0) ||
+     insert_item(tree, (btree_key_t)long_key, value) < 0) {
+    PRINTF("DB: Deferred the insertion of key %ld into a B+-tree index\n",
+           long_key);
+    tree->pending = 1;
+  }
+  return DB_OK;
+}
+
+static db_result_t
+delete(index_t *index, attribute_value_t *value)
+{
+  btree_t *tree;
+  btree_node_id_t root;
+
+  tree = (btree_t *)index->opaque_data;
+
+  if(write_back_all() < 0) {
+    return DB_INDEX_ERROR;
+  }
+
+  root = delete_item(tree, tree->root, 0, value_to_key(value));
+  if(root == INVALID_NODE && tree->next_node >= tree->node_limit &&
+     compact(tree) == 0) {
+    /* The file was full; the nodes written so far are unreachable. */
+    root = delete_item(tree, tree->root, 0, value_to_key(value));
+  }
+  if(root == INVALID_NODE) {
+    return DB_INDEX_ERROR;
+  }
+  tree->root = root;
+  return DB_OK;
+}
+
+/*
+ * Find the next row of the relation in the search range by reading
+ * the rows in order. This is used instead of the tree when it cannot
+ * be brought up to date with the relation.
+ */
+static tuple_id_t
+scan_next(btree_t *tree, index_iterator_t *iterator, tuple_id_t *next_tuple)
+{
+  tuple_id_t cardinality;
+  tuple_id_t tuple_id;
+  long key;
+
+  cardinality = relation_cardinality(tree->index->rel);
+  while(*next_tuple < cardinality) {
+    tuple_id = (*next_tuple)++;
+    if(get_key(tree, tuple_id, &key) < 0) {
+      return INVALID_TUPLE;
+    }
+    if(key >= db_value_to_long(&iterator->min_value) &&
+       key <= db_value_to_long(&iterator->max_value)) {
+      iterator->next_item_no++;
+      return tuple_id;
+    }
+  }
+  return INVALID_TUPLE;
+}
+
+static tuple_id_t
+get_next(index_iterator_t *iterator)
+{
+  struct iteration_cache {
+    index_iterator_t *index_iterator;
+    uint8_t leaf;
+    uint8_t scan;
+    tuple_id_t next_tuple;
+    btree_node_id_t path[MAX_HEIGHT];
+    uint8_t position[MAX_HEIGHT];
+  };
+  static struct iteration_cache cache;
+  struct node_cache *node;
+  btree_t *tree;
+  btree_key_t key;
+  btree_node_id_t id;
+  int level;
+
+  tree = (btree_t *)iterator->index->opaque_data;
+
+  if(cache.index_iterator != iterator || iterator->next_item_no == 0) {
+    cache.index_iterator = iterator;
+    cache.scan = 0;
+    cache.next_tuple = 0;
+
+    /* Write back the dirty nodes so that the node IDs stay the same
+       during the search, and find the first leaf that may hold the key. */
+    if((tree->pending &&
+        update_tree(tree, relation_cardinality(tree->index->rel)) < 0) ||
+       write_back_all() < 0) {
+      cache.scan = 1;
+    }
+
+    key = value_to_key(&iterator->min_value);
+    id = tree->root;
+    for(level = 0; !cache.scan; level++) {
+      node = get_node(tree, id, level);
+      if(node == NULL) {
+        cache.scan = 1;
+        break;
+      }
+      cache.path[level] = id;
+      cache.position[level] = lower_bound(&node->node, key);
+      if(node->node.flags & NODE_FLAG_LEAF) {
+        break;
+      }
+      id = node->node.values[cache.position[level]];
+    }
+    cache.leaf = level;
+
+    if(cache.scan) {
+      PRINTF("DB: Scanning the relation instead of the B+-tree\n");
+    }
+  }
+
+  if(cache.scan) {
+    return scan_next(tree, iterator, &cache.next_tuple);
+  }
+
+  for(;;) {
+    node = get_node(tree, cache.path[cache.leaf], cache.leaf);
+    if(node == NULL) {
+      return INVALID_TUPLE;
+    }
+
+    if(cache.position[cache.leaf] < node->node.count) {
+      if(node->node.keys[cache.position[cache.leaf]] >
+         value_to_key(&iterator->max_value)) {
+        return INVALID_TUPLE;
+      }
+      iterator->next_item_no++;
+      return node->node.values[cache.position[cache.leaf]++];
+    }
+
+    /* Step up to the nearest ancestor with another child, and down
+       to the leftmost leaf below that child. */
+    for(level = cache.leaf - 1; level >= 0; level--) {
+      node = get_node(tree, cache.path[level], level);
+      if(node == NULL) {
+        return INVALID_TUPLE;
+      }
+      if(cache.position[level] < node->node.count) {
+        break;
+      }
+    }
+    if(level < 0) {
+      return INVALID_TUPLE;
+    }
+
+    cache.position[level]++;
+    for(; level < cache.leaf; level++) {
+      node = get_node(tree, cache.path[level], level);
+      if(node == NULL) {
+        return INVALID_TUPLE;
+      }
+      cache.path[level + 1] = node->node.values[cache.position[level]];
+      cache.position[level + 1] = 0;
+    }
+  }
+}
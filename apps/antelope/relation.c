@@ -481,6 +481,13 @@ relation_insert(relation_t *rel, attribute_value_t *values)
   attribute_value_t *value;
   db_result_t result;
 
+  /* The new row gets the next tuple ID, which for a relation loaded
+     from storage is only known after its cardinality has been read. */
+  rel->next_row = relation_cardinality(rel);
+  if(rel->next_row == INVALID_TUPLE) {
+    return DB_STORAGE_ERROR;
+  }
+
   value = values;
 
   PRINTF("DB: Relation %s has a record size of %u bytes\n",
@@ -542,8 +549,8 @@ relation_insert(relation_t *rel, attribute_value_t *values)
 
   PRINTF(")\n");
 
-  rel->cardinality++;
   rel->next_row++;
+  rel->cardinality = rel->next_row;
   return storage_put_row(rel, record);
 }
 
@@ -655,7 +662,7 @@ select_index(db_handle_t *handle, lvm_instance_t *lvm_instance)
 
       if(range <= min_range) {
         index = attr->index;
-        av_min.domain = av_max.domain = DOMAIN_INT;
+        av_min.domain = av_max.domain = DOMAIN_LONG;
         VALUE_LONG(&av_min) = min.l;
         VALUE_LONG(&av_max) = max.l;
       }
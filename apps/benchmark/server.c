@@ -113,6 +113,21 @@ static void benchmark_parse_control(uint8_t * data){
 	}
 }
 /*---------------------------------------------------------------------------*/
+static const char *
+of_name(rpl_of_t *of)
+{
+  switch(of->ocp) {
+  case 0:
+    return "of0";
+  case 1:
+    return "mrhof";
+  case RPL_OF_COMPOSITE_OCP:
+    return "composite";
+  default:
+    return "unknown";
+  }
+}
+/*---------------------------------------------------------------------------*/
 static void
 print_local_addresses(void)
 {
@@ -203,11 +218,7 @@ PROCESS_THREAD(udp_server_process, ev, data)
   Benchmark_Packet_Type bm_packet;
 
   // Inform observer with necessary information
-#if OF_IS_MRHOF == 1
-  printf("server: contiki mrhof\n");
-#else
-  printf("server: contiki of0\n");
-#endif
+  printf("server: contiki %s\n", of_name(rpl_get_of()));
 
 
   // Get from observer the number of nodes
@@ -260,6 +271,15 @@ PROCESS_THREAD(udp_server_process, ev, data)
 
 
     } else if(ev == serial_line_event_message){
+      /* "of <ocp>" switches the objective function of the DAG. */
+      if(strncmp((char *)data, "of ", 3) == 0) {
+        if(rpl_set_of(atoi((char *)data + 3))) {
+          printf("server: contiki %s\n", of_name(rpl_get_of()));
+        } else {
+          printf("server: unsupported OF\n");
+        }
+        continue;
+      }
 //     	bm_ctrl.ctrl = ((char *)data)[0];
      	benchmark_parse_control((uint8_t *) data);
      	if(bm_ctrl.c.reset){
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Shell command that prints the netstack statistics
+ */
+
+#include "contiki.h"
+#include "shell.h"
+#include "net/netstats.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if NETSTATS_ENABLED
+struct counter {
+  const char *name;
+  uint16_t offset;
+};
+
+#define COUNTER(x) { #x, offsetof(struct netstats, x) }
+
+static const struct counter counters[] = {
+  COUNTER(ip_in), COUNTER(ip_out), COUNTER(ip_noroute),
+  COUNTER(ip_ndwait), COUNTER(ip_drop),
+  COUNTER(lowpan_in), COUNTER(lowpan_out),
+  COUNTER(lowpan_frag_in), COUNTER(lowpan_frag_out),
+  COUNTER(lowpan_reass_ok), COUNTER(lowpan_reass_timeout),
+  COUNTER(lowpan_reass_evict), COUNTER(lowpan_frag_fwd),
+  COUNTER(lowpan_hc_saved), COUNTER(lowpan_hc_cache_hit),
+  COUNTER(lowpan_hc_cache_miss), COUNTER(lowpan_ghc_in),
+  COUNTER(lowpan_ghc_saved_rpl), COUNTER(lowpan_ghc_saved_nd),
+  COUNTER(lowpan_ghc_saved_icmp), COUNTER(lowpan_ghc_saved_udp),
+  COUNTER(lowpan_drop),
+  COUNTER(mac_enqueue), COUNTER(mac_queue_full), COUNTER(mac_retx),
+  COUNTER(mac_tx_ok), COUNTER(mac_tx_fail),
+  COUNTER(rdc_tx), COUNTER(rdc_tx_ok), COUNTER(rdc_tx_noack),
+  COUNTER(rdc_tx_collision), COUNTER(rdc_tx_err), COUNTER(rdc_rx),
+  COUNTER(rdc_tx_burst),
+  COUNTER(qbuf_alloc), COUNTER(qbuf_alloc_fail),
+  COUNTER(phase_predict),
+};
+#endif /* NETSTATS_ENABLED */
+
+#define BUFLEN 100
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_netstats_process, "netstats");
+SHELL_COMMAND(netstats_command,
+	      "netstats",
+	      "netstats [reset]: show or reset the netstack statistics",
+	      &shell_netstats_process);
+/*---------------------------------------------------------------------------*/
+#if NETSTATS_ENABLED
+static void
+print_hist(const char *name, const struct netstats_hist *h)
+{
+  char buf[BUFLEN];
+  int i, len;
+
+  len = 0;
+  for(i = 0; i < NETSTATS_HIST_BINS && len < BUFLEN; i++) {
+    len += snprintf(buf + len, BUFLEN - len, " %u", h->bin[i]);
+  }
+  shell_output_str(&netstats_command, name, buf);
+}
+#endif /* NETSTATS_ENABLED */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_netstats_process, ev, data)
+{
+#if NETSTATS_ENABLED
+  char buf[BUFLEN];
+  int i;
+#endif /* NETSTATS_ENABLED */
+
+  PROCESS_BEGIN();
+
+#if NETSTATS_ENABLED
+  if(data != NULL && strcmp(data, "reset") == 0) {
+    netstats_reset();
+    PROCESS_EXIT();
+  }
+
+  for(i = 0; i < (int)(sizeof(counters) / sizeof(counters[0])); i++) {
+    snprintf(buf, BUFLEN, " %lu",
+             *(unsigned long *)((char *)&netstats + counters[i].offset));
+    shell_output_str(&netstats_command, counters[i].name, buf);
+  }
+  print_hist("mac_queue", &netstats.mac_queue);
+  print_hist("qbuf_used", &netstats.qbuf_used);
+  print_hist("mac_latency", &netstats.mac_latency);
+  print_hist("phase_error", &netstats.phase_error);
+#else /* NETSTATS_ENABLED */
+  shell_output_str(&netstats_command,
+                   "netstats: not enabled, set NETSTATS_CONF_ENABLED", "");
+#endif /* NETSTATS_ENABLED */
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_netstats_init(void)
+{
+  shell_register_command(&netstats_command);
+}
+/*---------------------------------------------------------------------------*/
@@ -384,6 +384,7 @@ struct shell_input {
 #include "shell-memdebug.h"
 #include "shell-netperf.h"
 #include "shell-netstat.h"
+#include "shell-netstats.h"
 #include "shell-ping.h"
 #include "shell-power.h"
 #include "shell-powertrace.h"
@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         An append-only time-series log on top of CFS.
+ *
+ *         A block starts with a header of HEADER_SIZE bytes:
+ *
+ *         magic(1) fields(1) count(2) seq(4) first time(4) last time(4)
+ *
+ *         and is followed by the records. The first record of a block
+ *         is stored with absolute values, and the following ones as the
+ *         difference to the previous record. Differences of the time
+ *         are stored as unsigned varints, and those of the values as
+ *         zigzag-encoded varints, so that slowly changing samples take
+ *         one byte per field.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "tslog.h"
+#if TSLOG_COFFEE
+#include "cfs/cfs-coffee.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define MAGIC         0x7c
+#define HEADER_SIZE   16
+#define RECORD_MAX    (5 + 5 * TSLOG_FIELDS)
+
+#define HDR_COUNT(b)  get16((b) + 2)
+#define HDR_SEQ(b)    get32((b) + 4)
+#define HDR_FIRST(b)  get32((b) + 8)
+#define HDR_LAST(b)   get32((b) + 12)
+
+#if TSLOG_BLOCK_SIZE < HEADER_SIZE + RECORD_MAX
+#error TSLOG_BLOCK_SIZE is too small for one record.
+#endif
+/*---------------------------------------------------------------------------*/
+static void
+put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put32(uint8_t *p, uint32_t v)
+{
+  put16(p, v);
+  put16(p + 2, v >> 16);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+get16(const uint8_t *p)
+{
+  return p[0] | ((uint16_t)p[1] << 8);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get32(const uint8_t *p)
+{
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+/*---------------------------------------------------------------------------*/
+static int
+put_varint(uint8_t *p, uint32_t v)
+{
+  int len;
+
+  for(len = 0; v >= 0x80; len++) {
+    p[len] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  p[len++] = v;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_varint(const uint8_t *p, int max, uint32_t *v)
+{
+  int len;
+  uint8_t shift;
+
+  *v = 0;
+  for(len = 0, shift = 0; len < max && shift < 35; len++, shift += 7) {
+    *v |= (uint32_t)(p[len] & 0x7f) << shift;
+    if(!(p[len] & 0x80)) {
+      return len + 1;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+encode(uint8_t *p, const struct tslog_record *record,
+       const struct tslog_record *previous)
+{
+  uint32_t delta;
+  int i, len;
+
+  len = put_varint(p, record->time - (previous ? previous->time : 0));
+  for(i = 0; i < TSLOG_FIELDS; i++) {
+    delta = (uint32_t)record->values[i] -
+      (previous ? (uint32_t)previous->values[i] : 0);
+    /* Zigzag encoding maps small negative differences to small numbers. */
+    len += put_varint(p + len, (delta << 1) ^ -(delta >> 31));
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+decode(const uint8_t *p, int max, struct tslog_record *record,
+       const struct tslog_record *previous)
+{
+  uint32_t v;
+  int i, len, n;
+
+  len = get_varint(p, max, &v);
+  if(len < 0) {
+    return -1;
+  }
+  record->time = v + (previous ? previous->time : 0);
+  for(i = 0; i < TSLOG_FIELDS; i++) {
+    n = get_varint(p + len, max - len, &v);
+    if(n < 0) {
+      return -1;
+    }
+    len += n;
+    v = (v >> 1) ^ -(v & 1);
+    record->values[i] = (int32_t)(v +
+                                  (previous ? (uint32_t)previous->values[i] : 0));
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+segment_name(const struct tslog *log, uint8_t segment, char *name)
+{
+  sprintf(name, "%s.%u", log->name, (unsigned)segment);
+}
+/*---------------------------------------------------------------------------*/
+static int
+read_block(const struct tslog *log, uint8_t segment, uint16_t block,
+           uint8_t *buf, int len)
+{
+  char name[TSLOG_NAME_LENGTH + 4];
+  int fd, r;
+
+  segment_name(log, segment, name);
+  fd = cfs_open(name, CFS_READ);
+  if(fd < 0) {
+    return -1;
+  }
+  /* Coffee takes the last non-zero byte as the end of a file, so the
+     unused end of the last block may be missing. */
+  memset(buf, 0, len);
+  r = -1;
+  if(cfs_seek(fd, (cfs_offset_t)block * TSLOG_BLOCK_SIZE, CFS_SEEK_SET) >= 0) {
+    r = cfs_read(fd, buf, len);
+  }
+  cfs_close(fd);
+  if(r < HEADER_SIZE || buf[0] != MAGIC || buf[1] != TSLOG_FIELDS) {
+    return -1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+write_block(struct tslog *log)
+{
+  char name[TSLOG_NAME_LENGTH + 4];
+  uint8_t segment;
+  int fd, r;
+
+  segment = log->current;
+  if(log->segment_blocks[segment] == TSLOG_SEGMENT_BLOCKS) {
+    /* Continue in the next segment, which holds the oldest records. */
+    segment = (segment + 1) % TSLOG_SEGMENTS;
+    log->segment_blocks[segment] = 0;
+    log->current = segment;
+  }
+
+  segment_name(log, segment, name);
+  if(log->segment_blocks[segment] == 0) {
+    cfs_remove(name);
+#if TSLOG_COFFEE
+    if(cfs_coffee_reserve(name, (cfs_offset_t)TSLOG_SEGMENT_BLOCKS *
+                          TSLOG_BLOCK_SIZE) < 0) {
+      PRINTF("tslog: failed to reserve %s\n", name);
+      return -1;
+    }
+#endif
+    log->segment_start[segment] = log->first_time;
+  }
+
+  log->buf[0] = MAGIC;
+  log->buf[1] = TSLOG_FIELDS;
+  put16(log->buf + 2, log->count);
+  put32(log->buf + 4, log->seq);
+  put32(log->buf + 8, log->first_time);
+  put32(log->buf + 12, log->last.time);
+  memset(log->buf + log->used, 0, TSLOG_BLOCK_SIZE - log->used);
+
+  fd = cfs_open(name, CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    return -1;
+  }
+  r = -1;
+  if(cfs_seek(fd, (cfs_offset_t)log->segment_blocks[segment] * TSLOG_BLOCK_SIZE,
+              CFS_SEEK_SET) >= 0) {
+    r = cfs_write(fd, log->buf, TSLOG_BLOCK_SIZE);
+  }
+  cfs_close(fd);
+  if(r != TSLOG_BLOCK_SIZE) {
+    PRINTF("tslog: failed to write block %u of %s\n",
+           log->segment_blocks[segment], name);
+    return -1;
+  }
+
+  log->segment_blocks[segment]++;
+  log->seq++;
+  log->used = HEADER_SIZE;
+  log->count = 0;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_open(struct tslog *log, const char *name)
+{
+  char file[TSLOG_NAME_LENGTH + 4];
+  uint8_t hdr[HEADER_SIZE];
+  cfs_offset_t end;
+  uint8_t segment;
+  uint32_t seq;
+  int fd, found;
+
+  if(strlen(name) >= sizeof(log->name)) {
+    return -1;
+  }
+  memset(log, 0, sizeof(*log));
+  strcpy(log->name, name);
+  log->used = HEADER_SIZE;
+
+  /* The segment whose first block has the highest sequence number is
+     the one being written. */
+  found = 0;
+  for(segment = 0; segment < TSLOG_SEGMENTS; segment++) {
+    if(read_block(log, segment, 0, hdr, sizeof(hdr)) < 0) {
+      continue;
+    }
+    segment_name(log, segment, file);
+    fd = cfs_open(file, CFS_READ);
+    end = fd < 0 ? -1 : cfs_seek(fd, 0, CFS_SEEK_END);
+    cfs_close(fd);
+    if(end <= 0) {
+      continue;
+    }
+
+    log->segment_start[segment] = HDR_FIRST(hdr);
+    log->segment_blocks[segment] = (end + TSLOG_BLOCK_SIZE - 1) /
+      TSLOG_BLOCK_SIZE;
+    seq = HDR_SEQ(hdr) + log->segment_blocks[segment];
+    if(!found || (int32_t)(seq - log->seq) > 0) {
+      log->seq = seq;
+      log->current = segment;
+      found = 1;
+    }
+  }
+
+  if(found) {
+    if(read_block(log, log->current,
+                  log->segment_blocks[log->current] - 1, hdr, sizeof(hdr)) < 0) {
+      return -1;
+    }
+    log->last.time = HDR_LAST(hdr);
+  }
+
+  PRINTF("tslog: opened %s, segment %u, block %u\n", name,
+         log->current, log->segment_blocks[log->current]);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_append(struct tslog *log, const struct tslog_record *record)
+{
+  uint8_t buf[RECORD_MAX];
+  int len;
+
+  if(record->time < log->last.time) {
+    return -1;
+  }
+
+  len = encode(buf, record, log->count > 0 ? &log->last : NULL);
+  if(log->used + len > TSLOG_BLOCK_SIZE) {
+    if(write_block(log) < 0) {
+      return -1;
+    }
+    len = encode(buf, record, NULL);
+  }
+
+  if(log->count == 0) {
+    log->first_time = record->time;
+  }
+  memcpy(log->buf + log->used, buf, len);
+  log->used += len;
+  log->count++;
+  log->last = *record;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_flush(struct tslog *log)
+{
+  if(log->count == 0) {
+    return 0;
+  }
+  return write_block(log);
+}
+/*---------------------------------------------------------------------------*/
+void
+tslog_remove(struct tslog *log)
+{
+  char name[TSLOG_NAME_LENGTH + 4];
+  uint8_t segment;
+
+  for(segment = 0; segment < TSLOG_SEGMENTS; segment++) {
+    segment_name(log, segment, name);
+    cfs_remove(name);
+    log->segment_blocks[segment] = 0;
+  }
+  log->current = 0;
+  log->used = HEADER_SIZE;
+  log->count = 0;
+  log->last.time = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the first block of the current segment of a cursor that may
+   hold records in its time range. */
+static uint16_t
+first_block(struct tslog_cursor *c)
+{
+  struct tslog *log;
+  uint8_t hdr[HEADER_SIZE];
+  uint8_t next;
+  uint16_t low, high, mid;
+
+  log = c->log;
+  if(log->segment_blocks[c->segment] == 0) {
+    return 0;
+  }
+
+  if(log->segment_start[c->segment] > c->to) {
+    /* This and all later records are too new. */
+    c->segments_left = 0;
+    c->ram_block_done = 1;
+    return 0;
+  }
+
+  next = (c->segment + 1) % TSLOG_SEGMENTS;
+  if(c->segments_left > 1 && log->segment_blocks[next] > 0 &&
+     log->segment_start[next] < c->from) {
+    /* All records of this segment are too old. */
+    return log->segment_blocks[c->segment];
+  }
+
+  /* Binary search on the block headers for the first block that ends
+     at or after the start of the range. */
+  low = 0;
+  high = log->segment_blocks[c->segment] - 1;
+  while(low < high) {
+    mid = (low + high) / 2;
+    if(read_block(log, c->segment, mid, hdr, sizeof(hdr)) < 0) {
+      return low;
+    }
+    if(HDR_LAST(hdr) < c->from) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+/*---------------------------------------------------------------------------*/
+static int
+next_block(struct tslog_cursor *c)
+{
+  struct tslog *log;
+
+  log = c->log;
+  while(c->segments_left > 0) {
+    if(c->block < log->segment_blocks[c->segment]) {
+      if(read_block(log, c->segment, c->block, c->buf, TSLOG_BLOCK_SIZE) < 0) {
+        return -1;
+      }
+      c->block++;
+      c->pos = HEADER_SIZE;
+      c->count = c->total = HDR_COUNT(c->buf);
+      return 1;
+    }
+    c->segment = (c->segment + 1) % TSLOG_SEGMENTS;
+    c->block = 0;
+    if(--c->segments_left > 0) {
+      c->block = first_block(c);
+    }
+  }
+
+  /* The records that have not been written to storage yet. */
+  if(!c->ram_block_done && log->count > 0) {
+    c->ram_block_done = 1;
+    memcpy(c->buf, log->buf, log->used);
+    c->pos = HEADER_SIZE;
+    c->count = c->total = log->count;
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+tslog_query(struct tslog *log, struct tslog_cursor *cursor,
+            uint32_t from, uint32_t to)
+{
+  memset(cursor, 0, sizeof(*cursor));
+  cursor->log = log;
+  cursor->from = from;
+  cursor->to = to;
+  /* Start from the oldest segment. */
+  cursor->segment = (log->current + 1) % TSLOG_SEGMENTS;
+  cursor->segments_left = TSLOG_SEGMENTS;
+  cursor->block = first_block(cursor);
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_next(struct tslog_cursor *cursor, struct tslog_record *record)
+{
+  int len, r;
+
+  for(;;) {
+    while(cursor->count == 0) {
+      r = next_block(cursor);
+      if(r <= 0) {
+        return r;
+      }
+    }
+
+    len = decode(cursor->buf + cursor->pos, TSLOG_BLOCK_SIZE - cursor->pos,
+                 record, cursor->count < cursor->total ? &cursor->last : NULL);
+    if(len < 0) {
+      return -1;
+    }
+    cursor->pos += len;
+    cursor->count--;
+    cursor->last = *record;
+
+    if(record->time > cursor->to) {
+      cursor->count = 0;
+      cursor->segments_left = 0;
+      cursor->ram_block_done = 1;
+      return 0;
+    }
+    if(record->time >= cursor->from) {
+      return 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
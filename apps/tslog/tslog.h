@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         An append-only time-series log on top of CFS.
+ *
+ *         Records are packed into fixed-size blocks, which are written
+ *         whole and never rewritten. Each block starts with a header
+ *         with the time range of its records. The blocks are stored in a
+ *         ring of segment files; when the ring is full, the oldest
+ *         segment is removed.
+ */
+
+#ifndef TSLOG_H
+#define TSLOG_H
+
+#include "contiki-conf.h"
+
+/* The number of values in each record. */
+#ifdef TSLOG_CONF_FIELDS
+#define TSLOG_FIELDS TSLOG_CONF_FIELDS
+#else
+#define TSLOG_FIELDS 2
+#endif
+
+/* The size of a block, which is written to storage in one piece. */
+#ifdef TSLOG_CONF_BLOCK_SIZE
+#define TSLOG_BLOCK_SIZE TSLOG_CONF_BLOCK_SIZE
+#else
+#define TSLOG_BLOCK_SIZE 256
+#endif
+
+/* The number of blocks in each segment file. */
+#ifdef TSLOG_CONF_SEGMENT_BLOCKS
+#define TSLOG_SEGMENT_BLOCKS TSLOG_CONF_SEGMENT_BLOCKS
+#else
+#define TSLOG_SEGMENT_BLOCKS 16
+#endif
+
+/* The number of segment files. The log keeps between
+   TSLOG_SEGMENTS - 1 and TSLOG_SEGMENTS full segments. */
+#ifdef TSLOG_CONF_SEGMENTS
+#define TSLOG_SEGMENTS TSLOG_CONF_SEGMENTS
+#else
+#define TSLOG_SEGMENTS 4
+#endif
+
+/* Reserve the segment files in Coffee, so that they are never
+   extended or moved. */
+#ifdef TSLOG_CONF_COFFEE
+#define TSLOG_COFFEE TSLOG_CONF_COFFEE
+#else
+#define TSLOG_COFFEE 1
+#endif
+
+#define TSLOG_NAME_LENGTH 10
+
+struct tslog_record {
+  uint32_t time;
+  int32_t values[TSLOG_FIELDS];
+};
+
+struct tslog {
+  char name[TSLOG_NAME_LENGTH];
+  uint32_t seq;
+  uint32_t segment_start[TSLOG_SEGMENTS];
+  uint16_t segment_blocks[TSLOG_SEGMENTS];
+  uint8_t current;
+  uint16_t used;
+  uint16_t count;
+  uint32_t first_time;
+  struct tslog_record last;
+  uint8_t buf[TSLOG_BLOCK_SIZE];
+};
+
+struct tslog_cursor {
+  struct tslog *log;
+  uint32_t from;
+  uint32_t to;
+  uint8_t segment;
+  uint8_t segments_left;
+  uint8_t ram_block_done;
+  uint16_t block;
+  uint16_t pos;
+  uint16_t count;
+  uint16_t total;
+  struct tslog_record last;
+  uint8_t buf[TSLOG_BLOCK_SIZE];
+};
+
+/**
+ * \brief Open a log, and recover the blocks stored by earlier runs.
+ * \param log The log.
+ * \param name The name of the log, used as a prefix of the segment files.
+ * \return 0 on success, -1 on failure.
+ */
+int tslog_open(struct tslog *log, const char *name);
+
+/**
+ * \brief Append a record to the log.
+ * \param log The log.
+ * \param record The record. Its time must not be earlier than that of
+ *               the previous record.
+ * \return 0 on success, -1 on failure.
+ *
+ * The record is kept in RAM until its block is full, or until
+ * tslog_flush() is called.
+ */
+int tslog_append(struct tslog *log, const struct tslog_record *record);
+
+/**
+ * \brief Write the partially filled block to storage.
+ * \param log The log.
+ * \return 0 on success, -1 on failure.
+ *
+ * The rest of the block is left unused, so that it is never rewritten.
+ */
+int tslog_flush(struct tslog *log);
+
+/**
+ * \brief Remove all segment files of a log.
+ * \param log The log.
+ */
+void tslog_remove(struct tslog *log);
+
+/**
+ * \brief Start a query for the records in a time range.
+ * \param log The log.
+ * \param cursor The cursor to use with tslog_next().
+ * \param from The earliest time to return.
+ * \param to The latest time to return.
+ */
+void tslog_query(struct tslog *log, struct tslog_cursor *cursor,
+                 uint32_t from, uint32_t to);
+
+/**
+ * \brief Get the next record of a query.
+ * \param cursor The cursor.
+ * \param record The record to fill in.
+ * \return 1 if a record was found, 0 at the end of the query, and -1
+ *         on a storage error.
+ *
+ * The log must not be appended to while the query runs.
+ */
+int tslog_next(struct tslog_cursor *cursor, struct tslog_record *record);
+
+#endif /* TSLOG_H */
@@ -58,6 +58,9 @@
 #include "cfs/cfs.h"
 #include "cfs-coffee-arch.h"
 #include "cfs/cfs-coffee.h"
+#include "sys/cc.h"
+#include "sys/process.h"
+#include "sys/rtimer.h"
 
 /* Micro logs enable modifications on storage types that do not support
    in-place updates. This applies primarily to flash memories. */
@@ -90,6 +93,67 @@
 #define COFFEE_EXTENDED_WEAR_LEVELLING  1
 #endif
 
+/*
+ * Keep an index from file names to the first pages of the files and a
+ * bitmap of the free pages in RAM, so that files can be found and
+ * space be reserved without reading through the headers of the file
+ * system. Both are built on the first access and are then kept up to
+ * date. They take 4 bytes per index entry and one bit per page.
+ */
+#ifndef COFFEE_INDEX
+#define COFFEE_INDEX  0
+#endif
+
+/* The number of files that fit in the index. Files that do not fit
+   are found by scanning the storage. Must be a power of two. */
+#ifndef COFFEE_INDEX_SIZE
+#define COFFEE_INDEX_SIZE 64
+#endif
+
+#if COFFEE_INDEX && (COFFEE_INDEX_SIZE & (COFFEE_INDEX_SIZE - 1))
+#error COFFEE_INDEX_SIZE must be a power of two.
+#endif
+
+/* Count the accesses to the storage, see cfs_coffee_get_stats(). */
+#ifndef COFFEE_STATS
+#define COFFEE_STATS  0
+#endif
+
+/* Reclaim obsolete sectors in a background process, one sector at a
+   time while no other events are pending. Reservations that still run
+   out of space erase only as many sectors as they need. */
+#ifndef COFFEE_GC_INCREMENTAL
+#define COFFEE_GC_INCREMENTAL 0
+#endif
+
+/* The background process stops erasing sectors when this many pages
+   are free. */
+#ifndef COFFEE_GC_WATERMARK
+#define COFFEE_GC_WATERMARK (2 * COFFEE_PAGES_PER_SECTOR)
+#endif
+
+/* Keep the most recently used storage pages in a RAM cache. Writes
+   stay in the cache until the page is evicted or the file operation
+   that made them completes, e.g., at cfs_close(). */
+#ifndef COFFEE_CACHE
+#define COFFEE_CACHE  0
+#endif
+
+/* The number of pages in the cache. */
+#ifndef COFFEE_CACHE_PAGES
+#define COFFEE_CACHE_PAGES  4
+#endif
+
+/* The number of pages to read ahead in the same direction when a read
+   misses the page next to the previously accessed one. */
+#ifndef COFFEE_CACHE_READ_AHEAD
+#define COFFEE_CACHE_READ_AHEAD 1
+#endif
+
+#if COFFEE_CACHE && COFFEE_CACHE_READ_AHEAD >= COFFEE_CACHE_PAGES
+#error COFFEE_CACHE_READ_AHEAD must be less than COFFEE_CACHE_PAGES.
+#endif
+
 #if COFFEE_START & (COFFEE_SECTOR_SIZE - 1)
 #error COFFEE_START must point to the first byte in a sector.
 #endif
@@ -159,6 +223,7 @@ struct sector_status {
   coffee_page_t active;
   coffee_page_t obsolete;
   coffee_page_t free;
+  coffee_page_t carried;
 };
 
 /* The structure of cached file objects. */
@@ -217,18 +282,294 @@ static struct file_desc *const coffee_fd_set = protected_mem.coffee_fd_set;
 static coffee_page_t *const next_free = &protected_mem.next_free;
 static char *const gc_wait = &protected_mem.gc_wait;
 
+#if COFFEE_STATS
+static struct cfs_coffee_stats coffee_stats;
+#define STATS_ADD(x, n) coffee_stats.x += (n)
+#else
+#define STATS_ADD(x, n)
+#endif
+
+#if COFFEE_GC_INCREMENTAL
+PROCESS(coffee_gc_process, "Coffee GC");
+#endif
+
+/* All accesses to the storage driver go through these macros. */
+#define FLASH_READ(buf, size, offset) do { \
+    STATS_ADD(reads, 1);                   \
+    STATS_ADD(read_bytes, (size));         \
+    COFFEE_READ((buf), (size), (offset));  \
+  } while(0)
+#define FLASH_WRITE(buf, size, offset) do { \
+    STATS_ADD(writes, 1);                   \
+    STATS_ADD(write_bytes, (size));         \
+    COFFEE_WRITE((buf), (size), (offset));  \
+  } while(0)
+#define FLASH_ERASE(sector) do { \
+    STATS_ADD(erases, 1);        \
+    COFFEE_ERASE(sector);        \
+  } while(0)
+
+/* All storage accesses of Coffee go through these macros. */
+#if COFFEE_CACHE
+#define STORAGE_READ(buf, size, offset)   cache_read((buf), (size), (offset))
+#define STORAGE_WRITE(buf, size, offset)  cache_write((buf), (size), (offset))
+#define STORAGE_ERASE(sector) do { \
+    cache_erase(sector);           \
+    FLASH_ERASE(sector);           \
+  } while(0)
+#define CACHE_FLUSH() cache_flush()
+#else /* COFFEE_CACHE */
+#define STORAGE_READ(buf, size, offset)   FLASH_READ(buf, size, offset)
+#define STORAGE_WRITE(buf, size, offset)  FLASH_WRITE(buf, size, offset)
+#define STORAGE_ERASE(sector)             FLASH_ERASE(sector)
+#define CACHE_FLUSH()
+#endif /* COFFEE_CACHE */
+
+#if COFFEE_INDEX
+/* Index entries map a hash of the file name to the first page of the
+   file. Collisions are resolved by linear probing. */
+struct index_entry {
+  coffee_page_t page;
+  uint16_t hash;
+};
+
+static struct index_entry name_index[COFFEE_INDEX_SIZE];
+/* One bit per page, set if the page is erased and not reserved. */
+static uint8_t free_pages[(COFFEE_PAGE_COUNT + 7) / 8];
+static char index_ready;
+/* Set when a file did not fit in the index. */
+static char index_incomplete;
+
+#define INDEX_MASK          (COFFEE_INDEX_SIZE - 1)
+#define PAGE_IS_FREE(page)  (free_pages[(page) >> 3] & (1 << ((page) & 7)))
+
+static void index_check(void);
+#endif /* COFFEE_INDEX */
+
+/*---------------------------------------------------------------------------*/
+#if COFFEE_CACHE
+/*
+ * A cache line holds one storage page. The lines are adjacent in
+ * cache_data, so that a page and the pages read ahead with it can be
+ * filled with a single driver read. A write marks the range of
+ * modified bytes, which is written back as one driver write.
+ */
+struct cache_line {
+  uint32_t used;
+  coffee_page_t page;
+  uint16_t dirty_start;
+  uint16_t dirty_end;
+};
+
+static struct cache_line cache_lines[COFFEE_CACHE_PAGES];
+static uint8_t cache_data[COFFEE_CACHE_PAGES][COFFEE_PAGE_SIZE];
+static uint32_t cache_clock;
+static coffee_page_t cache_last = INVALID_PAGE;
+static char cache_ready;
+/*---------------------------------------------------------------------------*/
+static void
+cache_write_back(int i)
+{
+  struct cache_line *line;
+
+  line = &cache_lines[i];
+  if(line->dirty_end > line->dirty_start) {
+    FLASH_WRITE(&cache_data[i][line->dirty_start],
+                line->dirty_end - line->dirty_start,
+                (cfs_offset_t)line->page * COFFEE_PAGE_SIZE + line->dirty_start);
+    line->dirty_start = line->dirty_end = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_flush(void)
+{
+  int i;
+
+  for(i = 0; i < COFFEE_CACHE_PAGES; i++) {
+    cache_write_back(i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_erase(uint16_t sector)
+{
+  coffee_page_t first;
+  int i;
+
+  /* Pending writes to the sector are lost in the erase anyway. */
+  first = sector * COFFEE_PAGES_PER_SECTOR;
+  for(i = 0; i < COFFEE_CACHE_PAGES; i++) {
+    if(cache_lines[i].page >= first &&
+       cache_lines[i].page < first + COFFEE_PAGES_PER_SECTOR) {
+      cache_lines[i].page = INVALID_PAGE;
+      cache_lines[i].dirty_start = cache_lines[i].dirty_end = 0;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+cache_lookup(coffee_page_t page)
+{
+  int i;
+
+  if(!cache_ready) {
+    for(i = 0; i < COFFEE_CACHE_PAGES; i++) {
+      cache_lines[i].page = INVALID_PAGE;
+    }
+    cache_ready = 1;
+  }
+
+  for(i = 0; i < COFFEE_CACHE_PAGES; i++) {
+    if(cache_lines[i].page == page) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+cache_fill(coffee_page_t page)
+{
+  coffee_page_t first, count;
+  uint32_t oldest, newest;
+  int i, j, start;
+
+  /* Read ahead in the direction of sequential access, but only pages
+     that are not cached yet. */
+  first = page;
+  count = 1;
+  if(cache_last != INVALID_PAGE && page == cache_last + 1) {
+    while(count <= COFFEE_CACHE_READ_AHEAD &&
+          page + count < COFFEE_PAGE_COUNT &&
+          cache_lookup(page + count) < 0) {
+      count++;
+    }
+  } else if(page == cache_last - 1) {
+    while(count <= COFFEE_CACHE_READ_AHEAD && first > 0 &&
+          cache_lookup(first - 1) < 0) {
+      first--;
+      count++;
+    }
+  }
+
+  /* Replace the adjacent lines that have been least recently used. */
+  start = -1;
+  oldest = 0;
+  for(i = 0; i + count <= COFFEE_CACHE_PAGES; i++) {
+    newest = 0;
+    for(j = i; j < i + count; j++) {
+      if(cache_lines[j].page != INVALID_PAGE && cache_lines[j].used > newest) {
+        newest = cache_lines[j].used;
+      }
+    }
+    if(start < 0 || newest < oldest) {
+      oldest = newest;
+      start = i;
+    }
+  }
+
+  for(j = start; j < start + count; j++) {
+    cache_write_back(j);
+    cache_lines[j].page = first + (j - start);
+    cache_lines[j].used = cache_clock;
+  }
+  FLASH_READ(cache_data[start], count * COFFEE_PAGE_SIZE,
+             (cfs_offset_t)first * COFFEE_PAGE_SIZE);
+
+  return start + (page - first);
+}
+/*---------------------------------------------------------------------------*/
+/* Find the line for a page and mark it as used. Returns -1 if the
+   access should go directly to the storage. */
+static int
+cache_get(coffee_page_t page)
+{
+  int i;
+
+  cache_clock++;
+  i = cache_lookup(page);
+  if(i >= 0) {
+    STATS_ADD(cache_hits, 1);
+  } else {
+    STATS_ADD(cache_misses, 1);
+    /* A page is cached only if it is at or next to the previously
+       accessed one, so that scans over file headers, which jump from
+       file to file, do not evict the cache. */
+    if(cache_last == INVALID_PAGE ||
+       page < cache_last - 1 || page > cache_last + 1) {
+      cache_last = page;
+      return -1;
+    }
+    i = cache_fill(page);
+  }
+  cache_lines[i].used = cache_clock;
+  cache_last = page;
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_read(void *buf, cfs_offset_t size, cfs_offset_t offset)
+{
+  cfs_offset_t in_page, len;
+  char *p;
+  int i;
+
+  for(p = buf; size > 0; p += len, offset += len, size -= len) {
+    in_page = offset % COFFEE_PAGE_SIZE;
+    len = MIN(size, COFFEE_PAGE_SIZE - in_page);
+    i = cache_get(offset / COFFEE_PAGE_SIZE);
+    if(i < 0) {
+      FLASH_READ(p, len, offset);
+      continue;
+    }
+    memcpy(p, &cache_data[i][in_page], len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_write(const void *buf, cfs_offset_t size, cfs_offset_t offset)
+{
+  struct cache_line *line;
+  cfs_offset_t in_page, len;
+  const char *p;
+  int i;
+
+  for(p = buf; size > 0; p += len, offset += len, size -= len) {
+    in_page = offset % COFFEE_PAGE_SIZE;
+    len = MIN(size, COFFEE_PAGE_SIZE - in_page);
+    i = cache_get(offset / COFFEE_PAGE_SIZE);
+    if(i < 0) {
+      FLASH_WRITE(p, len, offset);
+      continue;
+    }
+    memcpy(&cache_data[i][in_page], p, len);
+
+    /* Writing back the unmodified bytes between two writes programs
+       them with the values that they already have. */
+    line = &cache_lines[i];
+    if(line->dirty_end == line->dirty_start) {
+      line->dirty_start = in_page;
+      line->dirty_end = in_page + len;
+    } else {
+      line->dirty_start = MIN(line->dirty_start, in_page);
+      line->dirty_end = MAX(line->dirty_end, in_page + len);
+    }
+  }
+}
+#endif /* COFFEE_CACHE */
 /*---------------------------------------------------------------------------*/
 static void
 write_header(struct file_header *hdr, coffee_page_t page)
 {
   hdr->flags |= HDR_FLAG_VALID;
-  COFFEE_WRITE(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
+  STORAGE_WRITE(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
 }
 /*---------------------------------------------------------------------------*/
 static void
 read_header(struct file_header *hdr, coffee_page_t page)
 {
-  COFFEE_READ(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
+  STORAGE_READ(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
 #if DEBUG
   if(HDR_ACTIVE(*hdr) && !HDR_VALID(*hdr)) {
     PRINTF("Invalid header at page %u!\n", (unsigned)page);
@@ -273,6 +614,8 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
    * segment that extends into this segment. If the whole segment is
    * covered, we do not need to continue counting pages in this iteration.
    */
+  stats->carried = skip_pages < COFFEE_PAGES_PER_SECTOR ?
+                   skip_pages : COFFEE_PAGES_PER_SECTOR;
   if(last_pages_are_active) {
     if(skip_pages >= COFFEE_PAGES_PER_SECTOR) {
       stats->active = COFFEE_PAGES_PER_SECTOR;
@@ -361,42 +704,226 @@ isolate_pages(coffee_page_t start, coffee_page_t skip_pages)
          (unsigned)skip_pages, (int)start / COFFEE_PAGES_PER_SECTOR);
 }
 /*---------------------------------------------------------------------------*/
+static coffee_page_t
+next_file(coffee_page_t page, struct file_header *hdr)
+{
+  /*
+   * The quick-skip algorithm for finding file extents is the most
+   * essential part of Coffee. The file allocation rules enables this
+   * algorithm to quickly jump over free areas and allocated extents
+   * after reading single headers and determining their status.
+   *
+   * The worst-case performance occurs when we encounter multiple long
+   * sequences of isolated pages, but such sequences are uncommon and
+   * always shorter than a sector.
+   */
+  if(HDR_FREE(*hdr)) {
+    return (page + COFFEE_PAGES_PER_SECTOR) & ~(COFFEE_PAGES_PER_SECTOR - 1);
+  } else if(HDR_ISOLATED(*hdr)) {
+    return page + 1;
+  }
+  return page + hdr->max_pages;
+}
+/*---------------------------------------------------------------------------*/
+#if COFFEE_INDEX
+static uint16_t
+name_hash(const char *name)
+{
+  uint16_t hash;
+  int i;
+
+  /* Only the part of the name that fits in a file header counts. */
+  hash = 5381;
+  for(i = 0; i < COFFEE_NAME_LENGTH - 1 && name[i] != '\0'; i++) {
+    hash = (hash << 5) + hash + (unsigned char)name[i];
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_add(const char *name, coffee_page_t page)
+{
+  uint16_t hash;
+  unsigned i, n;
+
+  if(!index_ready) {
+    return;
+  }
+
+  hash = name_hash(name);
+  for(i = hash & INDEX_MASK, n = 0; n < COFFEE_INDEX_SIZE;
+      i = (i + 1) & INDEX_MASK, n++) {
+    if(name_index[i].page == INVALID_PAGE) {
+      name_index[i].page = page;
+      name_index[i].hash = hash;
+      return;
+    }
+  }
+  index_incomplete = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_remove(const char *name, coffee_page_t page)
+{
+  unsigned i, j, k, n;
+
+  if(!index_ready) {
+    return;
+  }
+
+  for(i = name_hash(name) & INDEX_MASK, n = 0; name_index[i].page != page;
+      i = (i + 1) & INDEX_MASK, n++) {
+    if(name_index[i].page == INVALID_PAGE || n == COFFEE_INDEX_SIZE) {
+      return;
+    }
+  }
+
+  /* Move back the entries that would otherwise not be found through
+     the probe sequence anymore. */
+  name_index[i].page = INVALID_PAGE;
+  for(j = (i + 1) & INDEX_MASK; name_index[j].page != INVALID_PAGE;
+      j = (j + 1) & INDEX_MASK) {
+    k = name_index[j].hash & INDEX_MASK;
+    if(i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+      continue;
+    }
+    name_index[i] = name_index[j];
+    name_index[j].page = INVALID_PAGE;
+    i = j;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static coffee_page_t
+index_lookup(const char *name, struct file_header *hdr)
+{
+  uint16_t hash;
+  unsigned i, n;
+
+  hash = name_hash(name);
+  for(i = hash & INDEX_MASK, n = 0;
+      n < COFFEE_INDEX_SIZE && name_index[i].page != INVALID_PAGE;
+      i = (i + 1) & INDEX_MASK, n++) {
+    if(name_index[i].hash == hash) {
+      read_header(hdr, name_index[i].page);
+      if(HDR_ACTIVE(*hdr) && !HDR_LOG(*hdr) && strcmp(name, hdr->name) == 0) {
+        return name_index[i].page;
+      }
+    }
+  }
+  return INVALID_PAGE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mark_pages(coffee_page_t start, coffee_page_t count, int free)
+{
+  coffee_page_t page;
+
+  if(!index_ready) {
+    return;
+  }
+
+  for(page = start; page < start + count; page++) {
+    if(free) {
+      free_pages[page >> 3] |= 1 << (page & 7);
+    } else {
+      free_pages[page >> 3] &= ~(1 << (page & 7));
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_check(void)
+{
+  struct file_header hdr;
+  coffee_page_t page;
+  unsigned i;
+
+  if(index_ready) {
+    return;
+  }
+
+  for(i = 0; i < COFFEE_INDEX_SIZE; i++) {
+    name_index[i].page = INVALID_PAGE;
+  }
+  memset(free_pages, 0, sizeof(free_pages));
+  index_incomplete = 0;
+  index_ready = 1;
+
+  for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
+    read_header(&hdr, page);
+    if(HDR_FREE(hdr)) {
+      mark_pages(page, next_file(page, &hdr) - page, 1);
+    } else if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr)) {
+      index_add(hdr.name, page);
+    }
+  }
+}
+#endif /* COFFEE_INDEX */
+/*---------------------------------------------------------------------------*/
+/*
+ * The first "carried" pages of the sector continue a file extent whose
+ * header is in an earlier sector. next_file() skips over them until
+ * that earlier sector is erased, so they must not be allocated to a new
+ * file even though they are erased here.
+ */
+static void
+erase_sector(uint16_t sector, coffee_page_t isolation_count,
+             coffee_page_t carried)
+{
+  coffee_page_t first_page;
+
+  first_page = sector * COFFEE_PAGES_PER_SECTOR;
+  if(first_page + carried < *next_free) {
+    *next_free = first_page + carried;
+  }
+
+  if(isolation_count > 0) {
+    isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
+  }
+
+  STORAGE_ERASE(sector);
+#if COFFEE_INDEX
+  mark_pages(first_page + carried, COFFEE_PAGES_PER_SECTOR - carried, 1);
+#endif
+  PRINTF("Coffee: Erased sector %d!\n", sector);
+}
+/*---------------------------------------------------------------------------*/
+#if !COFFEE_GC_INCREMENTAL
 static void
 collect_garbage(int mode)
 {
   uint16_t sector;
   struct sector_status stats;
-  coffee_page_t first_page, isolation_count;
+  coffee_page_t isolation_count;
+  char erased;
 
   PRINTF("Coffee: Running the file system garbage collector in %s mode\n",
          mode == GC_RELUCTANT ? "reluctant" : "greedy");
   /*
    * The garbage collector erases as many sectors as possible. A sector is
-   * erasable if there are only free or obsolete pages in it.
+   * erasable if there are only free or obsolete pages in it. Pages carried
+   * over from a file extent in the previous sector are freed only if that
+   * sector was erased as well; otherwise erasing would gain nothing.
    */
+  erased = 0;
   for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
     isolation_count = get_sector_status(sector, &stats);
     PRINTF("Coffee: Sector %u has %u active, %u obsolete, and %u free pages.\n",
            sector, (unsigned)stats.active,
            (unsigned)stats.obsolete, (unsigned)stats.free);
 
-    if(stats.active > 0) {
+    if(erased) {
+      stats.carried = 0;
+    }
+    erased = 0;
+    if(stats.active > 0 || stats.obsolete == stats.carried) {
       continue;
     }
 
     if((mode == GC_RELUCTANT && stats.free == 0) ||
        (mode == GC_GREEDY && stats.obsolete > 0)) {
-      first_page = sector * COFFEE_PAGES_PER_SECTOR;
-      if(first_page < *next_free) {
-        *next_free = first_page;
-      }
-
-      if(isolation_count > 0) {
-        isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
-      }
-
-      COFFEE_ERASE(sector);
-      PRINTF("Coffee: Erased sector %d!\n", sector);
+      erase_sector(sector, isolation_count, stats.carried);
+      erased = 1;
 
       if(mode == GC_RELUCTANT && isolation_count > 0) {
         break;
@@ -404,28 +931,103 @@ collect_garbage(int mode)
     }
   }
 }
+#endif /* !COFFEE_GC_INCREMENTAL */
 /*---------------------------------------------------------------------------*/
-static coffee_page_t
-next_file(coffee_page_t page, struct file_header *hdr)
+#if COFFEE_GC_INCREMENTAL
+/*
+ * Erase the first sector that holds obsolete pages headed in it but no
+ * active ones, along with the following sectors that its last obsolete
+ * extent covers completely, since they cannot be read without the
+ * header. Unless forced, the sectors are erased only if fewer than
+ * COFFEE_GC_WATERMARK pages are free. Returns 1 if a sector was erased.
+ */
+static int
+gc_step(int force)
 {
-  /*
-   * The quick-skip algorithm for finding file extents is the most
-   * essential part of Coffee. The file allocation rules enables this
-   * algorithm to quickly jump over free areas and allocated extents
-   * after reading single headers and determining their status.
-   *
-   * The worst-case performance occurs when we encounter multiple long
-   * sequences of isolated pages, but such sequences are uncommon and
-   * always shorter than a sector.
-   */
-  if(HDR_FREE(*hdr)) {
-    return (page + COFFEE_PAGES_PER_SECTOR) & ~(COFFEE_PAGES_PER_SECTOR - 1);
-  } else if(HDR_ISOLATED(*hdr)) {
-    return page + 1;
+  uint16_t sector, candidate, last;
+  struct sector_status stats;
+  coffee_page_t isolation_count, candidate_isolation, candidate_carried, free;
+
+  candidate = last = COFFEE_SECTOR_COUNT;
+  candidate_isolation = candidate_carried = 0;
+  free = 0;
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+    isolation_count = get_sector_status(sector, &stats);
+    free += stats.free;
+    if(candidate == COFFEE_SECTOR_COUNT) {
+      if(stats.active == 0 && stats.obsolete > stats.carried) {
+        candidate = last = sector;
+        candidate_isolation = isolation_count;
+        candidate_carried = stats.carried;
+      }
+    } else if(last == sector - 1 &&
+              stats.carried == COFFEE_PAGES_PER_SECTOR && stats.active == 0) {
+      last = sector;
+      candidate_isolation = isolation_count;
+    } else if(force) {
+      break;
+    }
+  }
+
+  if(candidate == COFFEE_SECTOR_COUNT ||
+     (!force && free >= COFFEE_GC_WATERMARK)) {
+    return 0;
+  }
+
+  for(sector = candidate; sector <= last; sector++) {
+    erase_sector(sector, sector == last ? candidate_isolation : 0,
+                 sector == candidate ? candidate_carried : 0);
+  }
+  *gc_wait = 0;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+gc_poll(void)
+{
+  if(process_is_running(&coffee_gc_process)) {
+    process_poll(&coffee_gc_process);
+  } else {
+    process_start(&coffee_gc_process, NULL);
   }
-  return page + hdr->max_pages;
 }
 /*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_gc_process, ev, data)
+{
+#if COFFEE_STATS
+  rtimer_clock_t start, pause;
+#endif
+
+  PROCESS_BEGIN();
+
+  for(;;) {
+    /* Erase only when the event queue is empty, so that the erase
+       does not delay other processes. */
+    do {
+      PROCESS_PAUSE();
+    } while(process_nevents() > 0);
+
+#if COFFEE_STATS
+    start = RTIMER_NOW();
+#endif
+    if(gc_step(0)) {
+      CACHE_FLUSH();
+#if COFFEE_STATS
+      pause = RTIMER_NOW() - start;
+      coffee_stats.gc_steps++;
+      if(pause > coffee_stats.gc_step_max) {
+        coffee_stats.gc_step_max = pause;
+      }
+#endif
+    } else {
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* COFFEE_GC_INCREMENTAL */
+/*---------------------------------------------------------------------------*/
 static struct file *
 load_file(coffee_page_t start, struct file_header *hdr)
 {
@@ -475,6 +1077,22 @@ find_file(const char *name)
   struct file_header hdr;
   coffee_page_t page;
 
+#if COFFEE_INDEX
+  index_check();
+  page = index_lookup(name, &hdr);
+  if(page != INVALID_PAGE) {
+    for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
+      if(!FILE_FREE(&coffee_files[i]) && coffee_files[i].page == page) {
+        return &coffee_files[i];
+      }
+    }
+    return load_file(page, &hdr);
+  }
+  if(!index_incomplete) {
+    return NULL;
+  }
+#endif /* COFFEE_INDEX */
+
   /* First check if the file metadata is cached. */
   for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
     if(FILE_FREE(&coffee_files[i])) {
@@ -517,7 +1135,7 @@ file_end(coffee_page_t start)
    */
 
   for(page = hdr.max_pages - 1; page >= 0; page--) {
-    COFFEE_READ(buf, sizeof(buf), (start + page) * COFFEE_PAGE_SIZE);
+    STORAGE_READ(buf, sizeof(buf), (start + page) * COFFEE_PAGE_SIZE);
     for(i = COFFEE_PAGE_SIZE - 1; i >= 0; i--) {
       if(buf[i] != 0) {
         if(page == 0 && i < sizeof(hdr)) {
@@ -536,6 +1154,35 @@ static coffee_page_t
 find_contiguous_pages(coffee_page_t amount)
 {
   coffee_page_t page, start;
+#if COFFEE_INDEX
+  index_check();
+
+  /* The same first fit as below, but on the bitmap. */
+  start = INVALID_PAGE;
+  for(page = *next_free; page < COFFEE_PAGE_COUNT; page++) {
+    if(!PAGE_IS_FREE(page)) {
+      start = INVALID_PAGE;
+      if((page & 7) == 0 && free_pages[page >> 3] == 0) {
+        /* Skip eight reserved pages at once. */
+        page += 7;
+      }
+      continue;
+    }
+    if(start == INVALID_PAGE) {
+      start = page;
+      if(start + amount >= COFFEE_PAGE_COUNT) {
+        break;
+      }
+    }
+    if(start + amount <= page + 1) {
+      if(start == *next_free) {
+        *next_free = start + amount;
+      }
+      return start;
+    }
+  }
+  return INVALID_PAGE;
+#else /* COFFEE_INDEX */
   struct file_header hdr;
 
   start = INVALID_PAGE;
@@ -566,6 +1213,7 @@ find_contiguous_pages(coffee_page_t amount)
     }
   }
   return INVALID_PAGE;
+#endif /* COFFEE_INDEX */
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -588,8 +1236,16 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
 
   hdr.flags |= HDR_FLAG_OBSOLETE;
   write_header(&hdr, page);
+#if COFFEE_INDEX
+  if(!HDR_LOG(hdr)) {
+    index_remove(hdr.name, page);
+  }
+#endif
 
   *gc_wait = 0;
+#if COFFEE_GC_INCREMENTAL
+  gc_poll();
+#endif
 
   /* Close all file descriptors that reference the removed file. */
   if(close_fds) {
@@ -608,7 +1264,7 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
     }
   }
 
-#if !COFFEE_EXTENDED_WEAR_LEVELLING
+#if !COFFEE_EXTENDED_WEAR_LEVELLING && !COFFEE_GC_INCREMENTAL
   if(gc_allowed) {
     collect_garbage(GC_RELUCTANT);
   }
@@ -631,6 +1287,9 @@ reserve(const char *name, coffee_page_t pages,
   struct file_header hdr;
   coffee_page_t page;
   struct file *file;
+#if COFFEE_STATS
+  rtimer_clock_t start, pause;
+#endif
 
   if(!allow_duplicates && find_file(name) != NULL) {
     return NULL;
@@ -641,8 +1300,25 @@ reserve(const char *name, coffee_page_t pages,
     if(*gc_wait) {
       return NULL;
     }
+#if COFFEE_STATS
+    start = RTIMER_NOW();
+#endif
+#if COFFEE_GC_INCREMENTAL
+    /* Erase one sector at a time until the reservation fits. */
+    while(page == INVALID_PAGE && gc_step(1)) {
+      page = find_contiguous_pages(pages);
+    }
+#else
     collect_garbage(GC_GREEDY);
     page = find_contiguous_pages(pages);
+#endif
+#if COFFEE_STATS
+    pause = RTIMER_NOW() - start;
+    coffee_stats.gc_runs++;
+    if(pause > coffee_stats.gc_pause_max) {
+      coffee_stats.gc_pause_max = pause;
+    }
+#endif
     if(page == INVALID_PAGE) {
       *gc_wait = 1;
       return NULL;
@@ -654,9 +1330,18 @@ reserve(const char *name, coffee_page_t pages,
   hdr.max_pages = pages;
   hdr.flags = HDR_FLAG_ALLOCATED | flags;
   write_header(&hdr, page);
+#if COFFEE_INDEX
+  mark_pages(page, pages, 0);
+  if(!(flags & HDR_FLAG_LOG)) {
+    index_add(hdr.name, page);
+  }
+#endif
 
   PRINTF("Coffee: Reserved %u pages starting from %u for file %s\n",
          pages, page, name);
+#if COFFEE_GC_INCREMENTAL
+  gc_poll();
+#endif
 
   file = load_file(page, &hdr);
   if(file != NULL) {
@@ -721,7 +1406,7 @@ get_record_index(coffee_page_t log_page, uint16_t search_records,
       }
 
       base -= batch_size * sizeof(indices[0]);
-      COFFEE_READ(&indices, sizeof(indices[0]) * batch_size, base);
+      STORAGE_READ(&indices, sizeof(indices[0]) * batch_size, base);
 
       for(i = batch_size - 1; i >= 0; i--) {
         if(indices[i] - 1 == region) {
@@ -762,7 +1447,7 @@ read_log_page(struct file_header *hdr, int16_t record_count,
   base = absolute_offset(hdr->log_page, log_records * sizeof(region));
   base += (cfs_offset_t)match_index * log_record_size;
   base += lp->offset;
-  COFFEE_READ(lp->buf, lp->size, base);
+  STORAGE_READ(lp->buf, lp->size, base);
 
   return lp->size;
 }
@@ -832,7 +1517,7 @@ merge_log(coffee_page_t file_page, int extend)
       cfs_close(fd);
       return -1;
     } else if(n > 0) {
-      COFFEE_WRITE(buf, n, absolute_offset(new_file->page, offset));
+      STORAGE_WRITE(buf, n, absolute_offset(new_file->page, offset));
       offset += n;
     }
   } while(n != 0);
@@ -889,7 +1574,7 @@ find_next_record(struct file *file, coffee_page_t log_page,
       batch_size = log_records - processed >= preferred_batch_size ?
         preferred_batch_size : log_records - processed;
 
-      COFFEE_READ(&indices, batch_size * sizeof(indices[0]),
+      STORAGE_READ(&indices, batch_size * sizeof(indices[0]),
                   absolute_offset(log_page, processed * sizeof(indices[0])));
       for(log_record = 0; log_record < batch_size; log_record++) {
         if(indices[log_record] == 0) {
@@ -953,7 +1638,7 @@ write_log_page(struct file *file, struct log_param *lp)
 
     if((lp->offset > 0 || lp->size != log_record_size) &&
        read_log_page(&hdr, log_record, &lp_out) < 0) {
-      COFFEE_READ(copy_buf, sizeof(copy_buf),
+      STORAGE_READ(copy_buf, sizeof(copy_buf),
                   absolute_offset(file->page, offset));
     }
 
@@ -965,11 +1650,11 @@ write_log_page(struct file *file, struct log_param *lp)
      */
     offset = absolute_offset(log_page, 0);
     ++region;
-    COFFEE_WRITE(&region, sizeof(region),
+    STORAGE_WRITE(&region, sizeof(region),
                  offset + log_record * sizeof(region));
 
     offset += log_records * sizeof(region);
-    COFFEE_WRITE(copy_buf, sizeof(copy_buf),
+    STORAGE_WRITE(copy_buf, sizeof(copy_buf),
                  offset + log_record * log_record_size);
     file->record_count = log_record + 1;
   }
@@ -1035,6 +1720,7 @@ cfs_close(int fd)
     coffee_fd_set[fd].file->references--;
     coffee_fd_set[fd].file = NULL;
   }
+  CACHE_FLUSH();
 }
 /*---------------------------------------------------------------------------*/
 cfs_offset_t
@@ -1073,6 +1759,7 @@ int
 cfs_remove(const char *name)
 {
   struct file *file;
+  int r;
 
   /*
    * Coffee removes files by marking them as obsolete. The space
@@ -1085,7 +1772,9 @@ cfs_remove(const char *name)
     return -1;
   }
 
-  return remove_by_page(file->page, REMOVE_LOG, CLOSE_FDS, ALLOW_GC);
+  r = remove_by_page(file->page, REMOVE_LOG, CLOSE_FDS, ALLOW_GC);
+  CACHE_FLUSH();
+  return r;
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -1112,7 +1801,7 @@ cfs_read(int fd, void *buf, unsigned size)
 
   /* If the file is allocated, read directly in the file. */
   if(!FILE_MODIFIED(file)) {
-    COFFEE_READ(buf, size, absolute_offset(file->page, fdp->offset));
+    STORAGE_READ(buf, size, absolute_offset(file->page, fdp->offset));
     fdp->offset += size;
     return size;
   }
@@ -1132,7 +1821,7 @@ cfs_read(int fd, void *buf, unsigned size)
 
     /* Read from the original file if we cannot find the data in the log. */
     if(r < 0) {
-      COFFEE_READ(buf, lp.size, absolute_offset(file->page, fdp->offset));
+      STORAGE_READ(buf, lp.size, absolute_offset(file->page, fdp->offset));
       r = lp.size;
     }
     fdp->offset += r;
@@ -1223,7 +1912,7 @@ cfs_write(int fd, const void *buf, unsigned size)
        * corresponding end offset in the original extent to ensure that
        * the correct file size is calculated when opening the file again.
        */
-      COFFEE_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset - 1));
+      STORAGE_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset - 1));
     }
   } else {
 #endif /* COFFEE_MICRO_LOGS */
@@ -1233,7 +1922,7 @@ cfs_write(int fd, const void *buf, unsigned size)
   }
 #endif /* COFFEE_APPEND_ONLY */
 
-  COFFEE_WRITE(buf, size, absolute_offset(file->page, fdp->offset));
+  STORAGE_WRITE(buf, size, absolute_offset(file->page, fdp->offset));
   fdp->offset += size;
 #if COFFEE_MICRO_LOGS
 }
@@ -1292,7 +1981,11 @@ cfs_closedir(struct cfs_dir *dir)
 int
 cfs_coffee_reserve(const char *name, cfs_offset_t size)
 {
-  return reserve(name, page_count(size), 0, 0) == NULL ? -1 : 0;
+  struct file *file;
+
+  file = reserve(name, page_count(size), 0, 0);
+  CACHE_FLUSH();
+  return file == NULL ? -1 : 0;
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -1321,6 +2014,7 @@ cfs_coffee_configure_log(const char *filename, unsigned log_size,
   hdr.log_records = log_size / log_record_size;
   hdr.log_record_size = log_record_size;
   write_header(&hdr, file->page);
+  CACHE_FLUSH();
 
   return 0;
 }
@@ -1349,12 +2043,15 @@ cfs_coffee_format(void)
   *next_free = 0;
 
   for(i = 0; i < COFFEE_SECTOR_COUNT; i++) {
-    COFFEE_ERASE(i);
+    STORAGE_ERASE(i);
     PRINTF(".");
   }
 
   /* Formatting invalidates the file information. */
   memset(&protected_mem, 0, sizeof(protected_mem));
+#if COFFEE_INDEX
+  index_ready = 0;
+#endif
 
   PRINTF(" done!\n");
 
@@ -1367,3 +2064,18 @@ cfs_coffee_get_protected_mem(unsigned *size)
   *size = sizeof(protected_mem);
   return &protected_mem;
 }
+/*---------------------------------------------------------------------------*/
+#if COFFEE_STATS
+void
+cfs_coffee_get_stats(struct cfs_coffee_stats *stats)
+{
+  memcpy(stats, &coffee_stats, sizeof(*stats));
+}
+/*---------------------------------------------------------------------------*/
+void
+cfs_coffee_reset_stats(void)
+{
+  memset(&coffee_stats, 0, sizeof(coffee_stats));
+}
+#endif /* COFFEE_STATS */
+/*---------------------------------------------------------------------------*/
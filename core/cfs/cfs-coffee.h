@@ -138,6 +138,46 @@ int cfs_coffee_format(void);
  */
 void *cfs_coffee_get_protected_mem(unsigned *size);
 
+/**
+ * \brief Counters of the storage accesses made by Coffee.
+ * The read, write, and erase counters count the accesses to the
+ * storage driver, which with COFFEE_CACHE are fewer than those made by
+ * Coffee.
+ *
+ * The counters are kept if COFFEE_STATS is set to 1 in the
+ * configuration of the platform or the project.
+ */
+struct cfs_coffee_stats {
+  unsigned long reads;
+  unsigned long read_bytes;
+  unsigned long writes;
+  unsigned long write_bytes;
+  unsigned long erases;
+  /** Garbage collections run because a reservation did not fit. */
+  unsigned long gc_runs;
+  /** Longest of these collections, in rtimer ticks. */
+  unsigned long gc_pause_max;
+  /** Sectors erased by the background collector (COFFEE_GC_INCREMENTAL). */
+  unsigned long gc_steps;
+  /** Longest background erase step, in rtimer ticks. */
+  unsigned long gc_step_max;
+  /** Accesses served from the page cache (COFFEE_CACHE). */
+  unsigned long cache_hits;
+  /** Accesses that had to fill the page cache from the storage. */
+  unsigned long cache_misses;
+};
+
+/**
+ * \brief Get the storage access counters.
+ * \param stats The structure to copy the counters to.
+ */
+void cfs_coffee_get_stats(struct cfs_coffee_stats *stats);
+
+/**
+ * \brief Set the storage access counters to zero.
+ */
+void cfs_coffee_reset_stats(void);
+
 /** @} */
 /** @} */
 
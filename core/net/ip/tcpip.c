@@ -41,6 +41,7 @@
 #include "contiki-net.h"
 #include "net/ip/uip-split.h"
 #include "net/ip/uip-packetqueue.h"
+#include "net/netstats.h"
 
 #if NETSTACK_CONF_WITH_IPV6
 #include "net/ipv6/uip-nd6.h"
@@ -528,6 +529,7 @@ eventhandler(process_event_t ev, process_data_t data)
 void
 tcpip_input(void)
 {
+  NETSTATS_ADD(ip_in);
   process_post_synch(&tcpip_process, PACKET_INPUT, NULL);
   uip_len = 0;
 #if NETSTACK_CONF_WITH_IPV6
@@ -545,15 +547,18 @@ tcpip_ipv6_output(void)
   if(uip_len == 0) {
     return;
   }
+  NETSTATS_ADD(ip_out);
 
   if(uip_len > UIP_LINK_MTU) {
     UIP_LOG("tcpip_ipv6_output: Packet to big");
+    NETSTATS_ADD(ip_drop);
     uip_len = 0;
     return;
   }
 
   if(uip_is_addr_unspecified(&UIP_IP_BUF->destipaddr)){
     UIP_LOG("tcpip_ipv6_output: Destination address unspecified");
+    NETSTATS_ADD(ip_drop);
     uip_len = 0;
     return;
   }
@@ -576,6 +581,11 @@ tcpip_ipv6_output(void)
       if(route == NULL) {
         PRINTF("tcpip_ipv6_output: no route found, using default route\n");
         nexthop = uip_ds6_defrt_choose();
+#if UIP_CONF_IPV6_RPL && RPL_MULTIPATH
+        if(nexthop != NULL) {
+          nexthop = rpl_multipath_nexthop(nexthop);
+        }
+#endif /* UIP_CONF_IPV6_RPL && RPL_MULTIPATH */
         if(nexthop == NULL) {
 #ifdef UIP_FALLBACK_INTERFACE
 	  PRINTF("FALLBACK: removing ext hdrs & setting proto %d %d\n", 
@@ -591,6 +601,7 @@ tcpip_ipv6_output(void)
 #else
           PRINTF("tcpip_ipv6_output: Destination off-link but no route\n");
 #endif /* !UIP_FALLBACK_INTERFACE */
+          NETSTATS_ADD(ip_noroute);
           uip_len = 0;
           return;
         }
@@ -598,7 +609,8 @@ tcpip_ipv6_output(void)
       } else {
         /* A route was found, so we look up the nexthop neighbor for
            the route. */
-        nexthop = uip_ds6_route_nexthop(route);
+        nbr = uip_ds6_route_nexthop_nbr(route);
+        nexthop = nbr != NULL ? &nbr->ipaddr : NULL;
 
         /* If the nexthop is dead, for example because the neighbor
            never responded to link-layer acks, we drop its route. */
@@ -621,6 +633,7 @@ tcpip_ipv6_output(void)
 
           /* We don't have a nexthop to send the packet to, so we drop
              it. */
+          NETSTATS_ADD(ip_noroute);
           return;
         }
       }
@@ -643,12 +656,16 @@ tcpip_ipv6_output(void)
 
 #if UIP_CONF_IPV6_RPL
     if(rpl_update_header_final(nexthop)) {
+      NETSTATS_ADD(ip_drop);
       uip_len = 0;
       return;
     }
 #endif /* UIP_CONF_IPV6_RPL */
-    nbr = uip_ds6_nbr_lookup(nexthop);
     if(nbr == NULL) {
+      nbr = uip_ds6_nbr_lookup(nexthop);
+    }
+    if(nbr == NULL) {
+      NETSTATS_ADD(ip_ndwait);
 #if UIP_ND6_SEND_NA
       if((nbr = uip_ds6_nbr_add(nexthop, NULL, 0, NBR_INCOMPLETE)) == NULL) {
         uip_len = 0;
@@ -681,6 +698,7 @@ tcpip_ipv6_output(void)
 #if UIP_ND6_SEND_NA
       if(nbr->state == NBR_INCOMPLETE) {
         PRINTF("tcpip_ipv6_output: nbr cache entry incomplete\n");
+        NETSTATS_ADD(ip_ndwait);
 #if UIP_CONF_IPV6_QUEUE_PKT
         /* Copy outgoing pkt in the queuing buffer for later transmit and set
            the destination nbr to nbr. */
@@ -795,6 +813,9 @@ tcpip_uipcall(void)
 PROCESS_THREAD(tcpip_process, ev, data)
 {
   PROCESS_BEGIN();
+
+  /* Let packet processing overtake queued application events. */
+  process_set_priority(&tcpip_process, PROCESS_PRIO_HIGH);
   
 #if UIP_TCP
  {
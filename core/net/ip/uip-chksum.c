@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Portable Internet checksum
+ */
+
+#include "net/ip/uip-chksum.h"
+
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+#if UIP_CHKSUM_WIDTH == 64
+  /* The one's complement sum does not depend on the byte order, so
+     the words are added in host byte order and the result is swapped
+     once at the end (RFC 1071, section 2). */
+  uint64_t acc;
+  uint32_t w;
+  uint16_t h;
+
+  acc = UIP_HTONS(sum);
+  while(len >= 16) {
+    memcpy(&w, data, 4);
+    acc += w;
+    memcpy(&w, data + 4, 4);
+    acc += w;
+    memcpy(&w, data + 8, 4);
+    acc += w;
+    memcpy(&w, data + 12, 4);
+    acc += w;
+    data += 16;
+    len -= 16;
+  }
+  while(len >= 4) {
+    memcpy(&w, data, 4);
+    acc += w;
+    data += 4;
+    len -= 4;
+  }
+  if(len >= 2) {
+    memcpy(&h, data, 2);
+    acc += h;
+    data += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    h = 0;
+    memcpy(&h, data, 1);
+    acc += h;
+  }
+
+  acc = (acc >> 32) + (acc & 0xffffffff);
+  acc = (acc >> 32) + (acc & 0xffffffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  return UIP_HTONS((uint16_t)acc);
+#elif UIP_CHKSUM_WIDTH == 32
+  uint32_t acc;
+
+  /* At most 2^15 words are added, so the accumulator cannot
+     overflow. */
+  acc = sum;
+  while(len >= 2) {
+    acc += ((uint16_t)data[0] << 8) | data[1];
+    data += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    acc += (uint16_t)data[0] << 8;
+  }
+
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  return (uint16_t)acc;
+#else /* UIP_CHKSUM_WIDTH */
+  uint16_t t;
+  const uint8_t *dataptr;
+  const uint8_t *last_byte;
+
+  dataptr = data;
+  last_byte = data + len - 1;
+
+  while(dataptr < last_byte) {   /* At least two more bytes */
+    t = (dataptr[0] << 8) + dataptr[1];
+    sum += t;
+    if(sum < t) {
+      sum++;      /* carry */
+    }
+    dataptr += 2;
+  }
+
+  if(dataptr == last_byte) {
+    t = (dataptr[0] << 8) + 0;
+    sum += t;
+    if(sum < t) {
+      sum++;      /* carry */
+    }
+  }
+
+  /* Return sum in host byte order. */
+  return sum;
+#endif /* UIP_CHKSUM_WIDTH */
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_adjust(uint16_t chksum,
+                  const void *old, uint16_t oldlen,
+                  const void *new, uint16_t newlen)
+{
+  uint32_t sum;
+
+  /* HC' = ~(~HC + ~m + m') */
+  sum = (uint16_t)~UIP_HTONS(chksum);
+  sum += (uint16_t)~uip_chksum_add(0, old, oldlen);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = uip_chksum_add((uint16_t)sum, new, newlen);
+  return UIP_HTONS((uint16_t)~sum);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Portable Internet checksum (RFC 1071) and incremental
+ *         checksum update (RFC 1624).
+ *
+ *         The accumulator width is chosen with UIP_CONF_CHKSUM_WIDTH.
+ *         The result does not depend on it.
+ */
+
+#ifndef UIP_CHKSUM_H_
+#define UIP_CHKSUM_H_
+
+#include "net/ip/uip.h"
+
+/**
+ * Add the 16-bit words of a buffer to a one's complement sum.
+ *
+ * \param sum The sum so far, in host byte order.
+ * \param data The buffer. It does not need to be aligned.
+ * \param len The length of the buffer. An odd last byte is padded
+ * with a zero byte.
+ * \return The new sum, in host byte order.
+ */
+uint16_t uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len);
+
+/**
+ * Update a checksum after some of the data it covers has changed,
+ * without summing the unchanged data again (RFC 1624, equation 3).
+ *
+ * The old and new data do not need to have the same length, so this
+ * can also replace a pseudo-header by one of another IP version.
+ * Both must start at an even offset of the checksummed data.
+ *
+ * \param chksum The checksum field, in network byte order.
+ * \param old The data that is no longer covered.
+ * \param oldlen The length of the old data.
+ * \param new The data that is now covered.
+ * \param newlen The length of the new data.
+ * \return The new checksum field, in network byte order.
+ */
+uint16_t uip_chksum_adjust(uint16_t chksum,
+                           const void *old, uint16_t oldlen,
+                           const void *new, uint16_t newlen);
+
+#endif /* UIP_CHKSUM_H_ */
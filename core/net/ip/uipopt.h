@@ -354,6 +354,25 @@ void uip_log(char *msg);
 #define UIP_UDP_CHECKSUMS (NETSTACK_CONF_WITH_IPV6)
 #endif
 
+/**
+ * The width in bits of the accumulator used by the portable Internet
+ * checksum, which is used unless UIP_ARCH_CHKSUM is set.
+ *
+ * With 16, one 16-bit word is added at a time and the carry is
+ * wrapped around after every addition. With 32, 16-bit words are
+ * added to a 32-bit accumulator that is folded once at the end. With
+ * 64, 32-bit words are loaded in host byte order and added to a
+ * 64-bit accumulator, which suits 64-bit hosts such as the native
+ * platform.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_CHKSUM_WIDTH
+#define UIP_CHKSUM_WIDTH (UIP_CONF_CHKSUM_WIDTH)
+#else
+#define UIP_CHKSUM_WIDTH 16
+#endif
+
 /**
  * The maximum amount of concurrent UDP connections.
  *
@@ -570,6 +589,42 @@ void uip_log(char *msg);
 #define SICSLOWPAN_REASS_MAXAGE 20
 #endif
 
+/**
+ * Number of datagrams the 6lowpan layer can reassemble at the same
+ * time. Each reassembly context holds a uip_buf_t, so this bounds the
+ * memory used for reassembly.
+ */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS SICSLOWPAN_CONF_REASS_CONTEXTS
+#else
+#define SICSLOWPAN_REASS_CONTEXTS 1
+#endif
+
+/**
+ * Relay the fragments of datagrams that are only passing through
+ * straight to the next hop instead of reassembling them first. The
+ * first fragment is uncompressed, updated and recompressed for the
+ * next hop; the following fragments are sent on with a new tag only.
+ * Only routers forward, so this is off unless UIP_CONF_ROUTER is set.
+ * (default: no)
+ */
+#if defined(SICSLOWPAN_CONF_FRAG_FORWARDING) && UIP_CONF_ROUTER
+#define SICSLOWPAN_FRAG_FORWARDING SICSLOWPAN_CONF_FRAG_FORWARDING
+#else
+#define SICSLOWPAN_FRAG_FORWARDING 0
+#endif
+
+/**
+ * Number of datagrams that can be relayed fragment by fragment at the
+ * same time. Each entry only holds the addresses and tags needed to
+ * relay the following fragments.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_FWD_ENTRIES
+#define SICSLOWPAN_FRAG_FWD_ENTRIES SICSLOWPAN_CONF_FRAG_FWD_ENTRIES
+#else
+#define SICSLOWPAN_FRAG_FWD_ENTRIES 4
+#endif
+
 /**
  * Do we compress the IP header or not (default: no)
  */
@@ -583,6 +638,46 @@ void uip_log(char *msg);
 #ifndef SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS 
 #define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS 1
 #endif
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 16
+#error IPHC supports at most 16 address contexts
+#endif
+
+/**
+ * Number of recent flows (source, destination and link-layer
+ * destination) for which IPHC remembers the compressed addresses, so
+ * that further packets skip the context lookups. Each entry takes
+ * about 80 bytes. (default: 0, no cache)
+ */
+#ifdef SICSLOWPAN_CONF_IPHC_CACHE_ENTRIES
+#define SICSLOWPAN_IPHC_CACHE_ENTRIES SICSLOWPAN_CONF_IPHC_CACHE_ENTRIES
+#else
+#define SICSLOWPAN_IPHC_CACHE_ENTRIES 0
+#endif
+
+/**
+ * Compress ICMPv6 messages and UDP payloads with 6LoWPAN-GHC (RFC
+ * 7400) when they then fit in a single frame, and accept GHC from
+ * neighbors. GHC is sent to a neighbor once it has sent GHC itself or
+ * announced it in the 6LoWPAN Capability Indication Option that is
+ * added to our NS, NA, RS and RA messages. (default: no)
+ */
+#ifdef SICSLOWPAN_CONF_GHC
+#define SICSLOWPAN_GHC SICSLOWPAN_CONF_GHC
+#else
+#define SICSLOWPAN_GHC 0
+#endif
+
+/**
+ * Assume that every neighbor understands GHC, so that GHC is also
+ * used for broadcasts such as RPL DIOs and for the first packets to a
+ * neighbor. Only for networks where all nodes have SICSLOWPAN_GHC.
+ * (default: no)
+ */
+#ifdef SICSLOWPAN_CONF_GHC_ALL_NEIGHBORS
+#define SICSLOWPAN_GHC_ALL_NEIGHBORS SICSLOWPAN_CONF_GHC_ALL_NEIGHBORS
+#else
+#define SICSLOWPAN_GHC_ALL_NEIGHBORS 0
+#endif
 
 /**
  * Do we support 6lowpan fragmentation
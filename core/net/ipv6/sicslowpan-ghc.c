@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         6LoWPAN Generic Header Compression (RFC 7400) codec.
+ */
+
+#include "net/ipv6/sicslowpan-ghc.h"
+
+#include <string.h>
+
+/* Bytecodes */
+#define GHC_LITERAL_MAX   95   /* 0kkkkkkk: k literal bytes follow */
+#define GHC_ZEROES        0x80 /* 1000nnnn: nnnn + 2 zero bytes */
+#define GHC_ZEROES_MAX    17
+#define GHC_STOP          0x90 /* end of the compressed data */
+#define GHC_EXTEND        0xa0 /* 101nssss: na += n << 3, sa += ssss << 3 */
+#define GHC_BACKREF       0xc0 /* 11nnnkkk: copy na + nnn + 2 bytes from
+                                  kkk + sa + n bytes back */
+
+static const uint8_t static_dict[16] = {
+  0x16, 0xfe, 0xfd, 0x17, 0xfe, 0xfd, 0x00, 0x01,
+  0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09
+};
+
+#define PREFIX_LEN (UIP_IPH_LEN + 16)
+
+/* Start of the dictionary: pseudo-header and static dictionary */
+static uint8_t prefix[PREFIX_LEN];
+/*---------------------------------------------------------------------------*/
+static void
+init_prefix(const uip_ipaddr_t *src, const uip_ipaddr_t *dest, uint8_t proto)
+{
+  memcpy(prefix, src, sizeof(uip_ipaddr_t));
+  memcpy(prefix + 16, dest, sizeof(uip_ipaddr_t));
+  /* The receiver only learns the payload length by decoding it, so
+     the length of the pseudo-header is left zero. */
+  memset(prefix + 32, 0, 7);
+  prefix[39] = proto;
+  memcpy(prefix + UIP_IPH_LEN, static_dict, sizeof(static_dict));
+}
+/*---------------------------------------------------------------------------*/
+/* Byte i of the dictionary prefix followed by buf */
+static uint8_t
+dict_at(const uint8_t *buf, int i)
+{
+  return i < PREFIX_LEN ? prefix[i] : buf[i - PREFIX_LEN];
+}
+/*---------------------------------------------------------------------------*/
+/* Number of extension codes needed for a backreference */
+static int
+extensions(int s, int n)
+{
+  int na, sa;
+
+  na = (n - 2) >> 3;
+  sa = ((s - n) >> 3) + 14;
+  sa /= 15;
+  return na > sa ? na : sa;
+}
+/*---------------------------------------------------------------------------*/
+/* Append n literal bytes, returns the new length or -1 if out is full */
+static int
+put_literals(uint8_t *out, int olen, int max, const uint8_t *data, int n)
+{
+  if(n == 0) {
+    return olen;
+  }
+  if(olen + 1 + n > max) {
+    return -1;
+  }
+  out[olen++] = n;
+  memcpy(out + olen, data, n);
+  return olen + n;
+}
+/*---------------------------------------------------------------------------*/
+int
+sicslowpan_ghc_compress(const uip_ipaddr_t *src, const uip_ipaddr_t *dest,
+                        uint8_t proto, const uint8_t *data, int len,
+                        uint8_t *out, int max)
+{
+  int pos, olen, lit, zeroes, n, s, j, k, na, sa, cost;
+
+  init_prefix(src, dest, proto);
+
+  olen = 0;
+  lit = 0;
+  for(pos = 0; pos < len && olen >= 0; ) {
+    zeroes = 0;
+    while(pos + zeroes < len && zeroes < GHC_ZEROES_MAX &&
+          data[pos + zeroes] == 0) {
+      zeroes++;
+    }
+
+    /* Longest match that ends before the current position, the
+       nearest one if several are equally long */
+    n = s = 0;
+    for(j = 0; j < PREFIX_LEN + pos; j++) {
+      for(k = 0; pos + k < len && j + k < PREFIX_LEN + pos &&
+            dict_at(data, j + k) == data[pos + k]; k++);
+      if(k >= 2 && k >= n) {
+        n = k;
+        s = PREFIX_LEN + pos - j;
+      }
+    }
+    cost = n > 0 ? 1 + extensions(s, n) : 0;
+
+    if(zeroes < 2 && n - cost <= 0) {
+      /* Nothing gained, keep the byte as a literal */
+      lit++;
+      pos++;
+      if(lit == GHC_LITERAL_MAX) {
+        olen = put_literals(out, olen, max, data + pos - lit, lit);
+        lit = 0;
+      }
+      continue;
+    }
+
+    olen = put_literals(out, olen, max, data + pos - lit, lit);
+    lit = 0;
+    if(olen < 0) {
+      break;
+    }
+
+    if(zeroes - 1 >= n - cost) {
+      if(olen + 1 > max) {
+        return 0;
+      }
+      out[olen++] = GHC_ZEROES | (zeroes - 2);
+      pos += zeroes;
+    } else {
+      if(olen + cost > max) {
+        return 0;
+      }
+      na = (n - 2) & ~7;
+      sa = (s - n) & ~7;
+      while(na > 0 || sa > 0) {
+        out[olen] = GHC_EXTEND;
+        if(na > 0) {
+          out[olen] |= 0x10;
+          na -= 8;
+        }
+        k = (sa >> 3) > 15 ? 15 : (sa >> 3);
+        out[olen++] |= k;
+        sa -= k << 3;
+      }
+      out[olen++] = GHC_BACKREF | (((n - 2) & 7) << 3) | ((s - n) & 7);
+      pos += n;
+    }
+  }
+  if(olen >= 0) {
+    olen = put_literals(out, olen, max, data + pos - lit, lit);
+  }
+
+  return olen > 0 && olen < len ? olen : 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+sicslowpan_ghc_uncompress(const uip_ipaddr_t *src, const uip_ipaddr_t *dest,
+                          uint8_t proto, const uint8_t *data, int len,
+                          uint8_t *out, int max)
+{
+  int i, olen, na, sa, n, s, j, k;
+  uint8_t c;
+
+  init_prefix(src, dest, proto);
+
+  olen = 0;
+  na = sa = 0;
+  for(i = 0; i < len; ) {
+    c = data[i++];
+    if(c <= GHC_LITERAL_MAX) {
+      if(i + c > len || olen + c > max) {
+        return -1;
+      }
+      memcpy(out + olen, data + i, c);
+      i += c;
+      olen += c;
+    } else if((c & 0xf0) == GHC_ZEROES) {
+      n = (c & 0x0f) + 2;
+      if(olen + n > max) {
+        return -1;
+      }
+      memset(out + olen, 0, n);
+      olen += n;
+    } else if(c == GHC_STOP) {
+      break;
+    } else if((c & 0xe0) == GHC_EXTEND) {
+      na += (c & 0x10) >> 1;
+      sa += (c & 0x0f) << 3;
+    } else if((c & 0xc0) == GHC_BACKREF) {
+      n = na + ((c >> 3) & 7) + 2;
+      s = (c & 7) + sa + n;
+      na = sa = 0;
+      j = PREFIX_LEN + olen - s;
+      if(j < 0 || olen + n > max) {
+        return -1;
+      }
+      for(k = 0; k < n; k++) {
+        out[olen + k] = dict_at(out, j + k);
+      }
+      olen += n;
+    } else {
+      /* Unassigned bytecode */
+      return -1;
+    }
+  }
+
+  return olen;
+}
+/*---------------------------------------------------------------------------*/
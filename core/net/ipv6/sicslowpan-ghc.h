@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         6LoWPAN Generic Header Compression (RFC 7400) codec.
+ *
+ *         The payload is coded as literals, runs of zeroes and
+ *         backreferences into a dictionary made of the IPv6
+ *         pseudo-header, a short static dictionary and the bytes
+ *         decoded so far.
+ */
+
+#ifndef SICSLOWPAN_GHC_H_
+#define SICSLOWPAN_GHC_H_
+
+#include "net/ip/uip.h"
+
+/** NHC dispatch of a GHC-compressed UDP header, ORed with C and PP */
+#define SICSLOWPAN_NHC_UDP_GHC_ID   0xD0
+/** NHC dispatch of a GHC-compressed ICMPv6 message */
+#define SICSLOWPAN_NHC_ICMP6_GHC    0xDF
+
+/**
+ * Compress a payload.
+ *
+ * \param src, dest The addresses of the IPv6 header.
+ * \param proto The next header value of the payload.
+ * \param data The payload.
+ * \param len The length of the payload.
+ * \param out Where to write the compressed payload.
+ * \param max The space available at out.
+ * \return The length of the compressed payload, or 0 if it does not
+ * fit in max bytes or is not shorter than the payload.
+ */
+int sicslowpan_ghc_compress(const uip_ipaddr_t *src, const uip_ipaddr_t *dest,
+                            uint8_t proto, const uint8_t *data, int len,
+                            uint8_t *out, int max);
+
+/**
+ * Uncompress a payload. Decoding ends at a STOP code or after len
+ * bytes.
+ *
+ * \param src, dest The addresses of the IPv6 header.
+ * \param proto The next header value of the payload.
+ * \param data The compressed payload.
+ * \param len The length of the compressed payload.
+ * \param out Where to write the payload.
+ * \param max The space available at out.
+ * \return The length of the payload, or -1 if the compressed data is
+ * invalid or the payload does not fit in max bytes.
+ */
+int sicslowpan_ghc_uncompress(const uip_ipaddr_t *src, const uip_ipaddr_t *dest,
+                              uint8_t proto, const uint8_t *data, int len,
+                              uint8_t *out, int max);
+
+#endif /* SICSLOWPAN_GHC_H_ */
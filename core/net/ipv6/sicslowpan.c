@@ -65,9 +65,15 @@
 #include "net/ip/tcpip.h"
 #include "net/ip/uip.h"
 #include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
 #include "net/rime/rime.h"
 #include "net/ipv6/sicslowpan.h"
+#include "net/ipv6/sicslowpan-ghc.h"
 #include "net/netstack.h"
+#include "net/netstats.h"
+#if SICSLOWPAN_FRAG_FORWARDING && UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#endif /* SICSLOWPAN_FRAG_FORWARDING && UIP_CONF_IPV6_RPL */
 
 #include "apps/benchmark/benchmark.h"
 
@@ -83,7 +89,7 @@ uint8_t p;
 #define PRINTFO(...) PRINTF(__VA_ARGS__)
 #define PRINTPACKETBUF() PRINTF("packetbuf buffer: "); for(p = 0; p < packetbuf_datalen(); p++){PRINTF("%.2X", *(packetbuf_ptr + p));} PRINTF("\n")
 #define PRINTUIPBUF() PRINTF("UIP buffer: "); for(p = 0; p < uip_len; p++){PRINTF("%.2X", uip_buf[p]);}PRINTF("\n")
-#define PRINTSICSLOWPANBUF() PRINTF("SICSLOWPAN buffer: "); for(p = 0; p < sicslowpan_len; p++){PRINTF("%.2X", sicslowpan_buf[p]);}PRINTF("\n")
+#define PRINTSICSLOWPANBUF() PRINTF("SICSLOWPAN buffer: "); for(p = 0; p < uip_len; p++){PRINTF("%.2X", sicslowpan_buf[p]);}PRINTF("\n")
 #else
 #define PRINTFI(...)
 #define PRINTFO(...)
@@ -218,47 +224,79 @@ static uint8_t uncomp_hdr_len;
 static int last_tx_status;
 /** @} */
 
+static int max_payload(linkaddr_t *dest);
+
 #if SICSLOWPAN_CONF_FRAG
 /** \name Fragmentation related variables
  *  @{
  */
 
-static uint16_t sicslowpan_len;
+/** Datagram tag to be put in the fragments I send. */
+static uint16_t my_tag;
 
-/**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
- */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+/** Packetbuf attributes of the datagram being fragmented. */
+static struct packetbuf_attr frag_attrs[PACKETBUF_NUM_ATTRS];
+static struct packetbuf_addr frag_addrs[PACKETBUF_NUM_ADDRS];
 
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+/** Number of 8-byte blocks a reassembly buffer can hold. */
+#define REASS_BLOCKS ((UIP_BUFSIZE + 7) / 8)
 
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * A datagram being reassembled. A context is identified by the link
+ * layer sender, the datagram tag and the datagram size. Fragments may
+ * arrive in any order; the received bitmap has one bit per 8-byte
+ * block of the datagram and the datagram is complete when all blocks
+ * up to its size have been received.
  */
-static uint16_t processed_ip_in_len;
+struct reass_context {
+  uip_buf_t buf;
+  struct timer timer;
+  linkaddr_t sender;
+  uint16_t tag;
+  /** Size of the datagram, 0 if the context is unused. */
+  uint16_t size;
+  /** Number of distinct blocks received so far. */
+  uint16_t blocks;
+  uint8_t received[(REASS_BLOCKS + 7) / 8];
+};
 
-/** Datagram tag to be put in the fragments I send. */
-static uint16_t my_tag;
+static struct reass_context reass_contexts[SICSLOWPAN_REASS_CONTEXTS];
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+#if SICSLOWPAN_FRAG_FORWARDING
+/**
+ * A datagram whose fragments are relayed to the next hop as they
+ * arrive. Entries are looked up like reassembly contexts, by sender,
+ * tag and size.
+ */
+struct fwd_entry {
+  struct timer timer;
+  linkaddr_t sender;
+  linkaddr_t nexthop;
+  uint16_t tag;
+  /** Size of the datagram, 0 if the entry is unused. */
+  uint16_t size;
+  /** Tag of the fragments sent to the next hop. */
+  uint16_t out_tag;
+  /** Number of distinct 8-byte blocks of the datagram relayed so far. */
+  uint16_t relayed;
+  uint8_t received[(REASS_BLOCKS + 7) / 8];
+};
 
-/** When reassembling, the source address of the fragments being merged */
-linkaddr_t frag_sender;
+static struct fwd_entry fwd_entries[SICSLOWPAN_FRAG_FWD_ENTRIES];
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+/**
+ * The buffer the incoming packet is uncompressed into: the buffer of
+ * its reassembly context if it is a fragment, uip_buf otherwise.
+ * It contains only the IPv6 packet (no MAC header, 6lowpan, etc).
+ */
+static uint8_t *sicslowpan_buf;
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
 /** The buffer used for the 6lowpan processing is uip_buf.
     We do not use any additional buffer.*/
 #define sicslowpan_buf uip_buf
-#define sicslowpan_len uip_len
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 static int last_rssi;
@@ -326,6 +364,38 @@ addr_contexts[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
 /** pointer to an address context. */
 static struct sicslowpan_addr_context *context;
 
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/** Ages contexts learned with a lifetime, once per minute. */
+static struct ctimer context_timer;
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+
+#if SICSLOWPAN_IPHC_CACHE_ENTRIES > 0
+/**
+ * The address encoding of a recently sent flow. The addresses make up
+ * most of the IPHC header and are the expensive part to compress, so
+ * further packets of the flow just copy the stored bytes.
+ */
+struct iphc_cache_entry {
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  linkaddr_t lldest;
+  uint8_t used;
+  uint8_t iphc1;    /* CID, SAC, SAM, M, DAC and DAM bits */
+  uint8_t cid;      /* SCI and DCI */
+  uint8_t len;      /* Number of inline address bytes */
+  uint8_t addr[32];
+};
+
+static struct iphc_cache_entry iphc_cache[SICSLOWPAN_IPHC_CACHE_ENTRIES];
+/** The entry to replace next, entries are reused round robin. */
+static uint8_t iphc_cache_next;
+#endif /* SICSLOWPAN_IPHC_CACHE_ENTRIES > 0 */
+
+#if SICSLOWPAN_GHC
+/** Neighbors that have sent us GHC and so can uncompress it. */
+NBR_TABLE(uint8_t, ghc_nbrs);
+#endif /* SICSLOWPAN_GHC */
+
 /** pointer to the byte where to write next inline field. */
 static uint8_t *hc06_ptr;
 
@@ -370,7 +440,7 @@ addr_context_lookup_by_prefix(uip_ipaddr_t *ipaddr)
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
   int i;
   for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
-    if((addr_contexts[i].used == 1) &&
+    if((addr_contexts[i].used == 1) && addr_contexts[i].compress &&
        uip_ipaddr_prefixcmp(&addr_contexts[i].prefix, ipaddr, 64)) {
       return &addr_contexts[i];
     }
@@ -396,6 +466,79 @@ addr_context_lookup_by_number(uint8_t number)
   return NULL;
 }
 /*--------------------------------------------------------------------*/
+#if SICSLOWPAN_IPHC_CACHE_ENTRIES > 0
+/** \brief Forget all cached flows, e.g. after a context changed */
+static void
+iphc_cache_flush(void)
+{
+  memset(iphc_cache, 0, sizeof(iphc_cache));
+}
+/*--------------------------------------------------------------------*/
+/** \brief find the cached address encoding for the packet in uip_buf */
+static struct iphc_cache_entry *
+iphc_cache_lookup(const linkaddr_t *lldest)
+{
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_IPHC_CACHE_ENTRIES; i++) {
+    if(iphc_cache[i].used &&
+       uip_ipaddr_cmp(&iphc_cache[i].destipaddr, &UIP_IP_BUF->destipaddr) &&
+       uip_ipaddr_cmp(&iphc_cache[i].srcipaddr, &UIP_IP_BUF->srcipaddr) &&
+       linkaddr_cmp(&iphc_cache[i].lldest, lldest)) {
+      return &iphc_cache[i];
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/** \brief remember the address encoding of the packet in uip_buf */
+static void
+iphc_cache_add(const linkaddr_t *lldest, uint8_t iphc1, uint8_t cid,
+               const uint8_t *addr, uint8_t len)
+{
+  struct iphc_cache_entry *e;
+
+  e = &iphc_cache[iphc_cache_next];
+  iphc_cache_next = (iphc_cache_next + 1) % SICSLOWPAN_IPHC_CACHE_ENTRIES;
+
+  uip_ipaddr_copy(&e->srcipaddr, &UIP_IP_BUF->srcipaddr);
+  uip_ipaddr_copy(&e->destipaddr, &UIP_IP_BUF->destipaddr);
+  linkaddr_copy(&e->lldest, lldest);
+  e->iphc1 = iphc1;
+  e->cid = cid;
+  e->len = len;
+  memcpy(e->addr, addr, len);
+  e->used = 1;
+}
+#endif /* SICSLOWPAN_IPHC_CACHE_ENTRIES > 0 */
+/*--------------------------------------------------------------------*/
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/** \brief remove the contexts whose lifetime has run out */
+static void
+context_periodic(void *ptr)
+{
+  int i, pending;
+
+  pending = 0;
+  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    if(addr_contexts[i].used == 1 && addr_contexts[i].lifetime > 0) {
+      if(--addr_contexts[i].lifetime == 0) {
+        PRINTF("IPHC: context %d expired\n", addr_contexts[i].number);
+        addr_contexts[i].used = 0;
+#if SICSLOWPAN_IPHC_CACHE_ENTRIES > 0
+        iphc_cache_flush();
+#endif /* SICSLOWPAN_IPHC_CACHE_ENTRIES > 0 */
+      } else {
+        pending = 1;
+      }
+    }
+  }
+  if(pending) {
+    ctimer_reset(&context_timer);
+  }
+}
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+/*--------------------------------------------------------------------*/
 static uint8_t
 compress_addr_64(uint8_t bitpos, uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr)
 {
@@ -456,6 +599,204 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
   PRINTF("\n");
 }
 
+/*--------------------------------------------------------------------*/
+#if SICSLOWPAN_GHC
+/** \brief check whether dest can uncompress GHC */
+static int
+ghc_usable(const linkaddr_t *dest)
+{
+  if(SICSLOWPAN_GHC_ALL_NEIGHBORS) {
+    return 1;
+  }
+  return !linkaddr_cmp(dest, &linkaddr_null) &&
+    nbr_table_get_from_lladdr(ghc_nbrs, dest) != NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief GHC-compress the rest of the packet in uip_buf, after
+ * uncomp_hdr_len bytes of headers
+ * \param dest L2 destination address
+ * \param out Where to write the compressed payload in packetbuf
+ * \return The length of the compressed payload, or 0 if it does not
+ * fit in a single frame or is not shorter
+ */
+static int
+ghc_compress(linkaddr_t *dest, uint8_t *out)
+{
+  int len, n;
+
+  /* Only whole packets: a relayed first fragment is recompressed
+     without the rest of its datagram. */
+  if(uip_len != UIP_IPH_LEN + ((UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1])) {
+    return 0;
+  }
+
+  len = uip_len - uncomp_hdr_len;
+  n = sicslowpan_ghc_compress(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr,
+                              UIP_IP_BUF->proto,
+                              (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, len,
+                              out, max_payload(dest) - (out - packetbuf_ptr));
+  if(n == 0) {
+    return 0;
+  }
+
+  if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
+    NETSTATS_SUM(lowpan_ghc_saved_udp, len - n);
+  } else if(UIP_ICMP_BUF->type == ICMP6_RPL) {
+    NETSTATS_SUM(lowpan_ghc_saved_rpl, len - n);
+  } else if(UIP_ICMP_BUF->type >= ICMP6_RS &&
+            UIP_ICMP_BUF->type <= ICMP6_REDIRECT) {
+    NETSTATS_SUM(lowpan_ghc_saved_nd, len - n);
+  } else {
+    NETSTATS_SUM(lowpan_ghc_saved_icmp, len - n);
+  }
+  uncomp_hdr_len = uip_len;
+  return n;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Uncompress the GHC payload at hc06_ptr, which runs to the end
+ * of the frame, to sicslowpan_buf
+ * \param ip_len The IP length from a first fragment, or 0
+ * \return 1 on success, 0 if the packet must be dropped
+ */
+static int
+ghc_uncompress(uint16_t ip_len)
+{
+  int n;
+
+  if(ip_len != 0) {
+    /* GHC is only sent in unfragmented packets */
+    return 0;
+  }
+
+  n = sicslowpan_ghc_uncompress(&SICSLOWPAN_IP_BUF->srcipaddr,
+                                &SICSLOWPAN_IP_BUF->destipaddr,
+                                SICSLOWPAN_IP_BUF->proto, hc06_ptr,
+                                packetbuf_ptr + packetbuf_datalen() - hc06_ptr,
+                                (uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len,
+                                UIP_BUFSIZE - UIP_LLH_LEN - uncomp_hdr_len);
+  if(n < 0) {
+    PRINTF("sicslowpan uncompress_hdr: invalid GHC payload\n");
+    return 0;
+  }
+  uncomp_hdr_len += n;
+  hc06_ptr = packetbuf_ptr + packetbuf_datalen();
+
+  /* The sender understands GHC, so we can use it in return */
+  sicslowpan_ghc_add_neighbor(packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  NETSTATS_ADD(lowpan_ghc_in);
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+void
+sicslowpan_ghc_add_neighbor(const linkaddr_t *addr)
+{
+  if(!linkaddr_cmp(addr, &linkaddr_null)) {
+    nbr_table_add_lladdr(ghc_nbrs, addr);
+  }
+}
+#endif /* SICSLOWPAN_GHC */
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress the source and destination addresses of the packet
+ * in uip_buf to hc06_ptr
+ *
+ * \param iphc1 The second IPHC byte so far
+ * \param link_destaddr L2 destination address, needed to compress IP
+ * dest
+ * \param srcctx, destctx Contexts matching the source and the
+ * destination address, or NULL
+ * \return iphc1 with the address mode bits added
+ */
+static uint8_t
+compress_addrs(uint8_t iphc1, linkaddr_t *link_destaddr,
+               struct sicslowpan_addr_context *srcctx,
+               struct sicslowpan_addr_context *destctx)
+{
+  /* source address - cannot be multicast */
+  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+    PRINTF("IPHC: compressing unspecified - setting SAC\n");
+    iphc1 |= SICSLOWPAN_IPHC_SAC;
+    iphc1 |= SICSLOWPAN_IPHC_SAM_00;
+  } else if((context = srcctx) != NULL) {
+    /* elide the prefix - indicate by CID and set context + SAC */
+    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
+	   context->number);
+    iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
+    PACKETBUF_IPHC_BUF[2] |= context->number << 4;
+    /* compession compare with this nodes address (source) */
+
+    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+    /* No context found for this address */
+  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
+	    UIP_IP_BUF->destipaddr.u16[1] == 0 &&
+	    UIP_IP_BUF->destipaddr.u16[2] == 0 &&
+	    UIP_IP_BUF->destipaddr.u16[3] == 0) {
+    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+  } else {
+    /* send the full address => SAC = 0, SAM = 00 */
+    iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
+    memcpy(hc06_ptr, &UIP_IP_BUF->srcipaddr.u16[0], 16);
+    hc06_ptr += 16;
+  }
+
+  /* dest address*/
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    /* Address is multicast, try to compress */
+    iphc1 |= SICSLOWPAN_IPHC_M;
+    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
+      iphc1 |= SICSLOWPAN_IPHC_DAM_11;
+      /* use last byte */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[15];
+      hc06_ptr += 1;
+    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
+      iphc1 |= SICSLOWPAN_IPHC_DAM_10;
+      /* second byte + the last three */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
+      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[13], 3);
+      hc06_ptr += 4;
+    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
+      iphc1 |= SICSLOWPAN_IPHC_DAM_01;
+      /* second byte + the last five */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
+      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[11], 5);
+      hc06_ptr += 6;
+    } else {
+      iphc1 |= SICSLOWPAN_IPHC_DAM_00;
+      /* full address */
+      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u8[0], 16);
+      hc06_ptr += 16;
+    }
+  } else {
+    /* Address is unicast, try to compress */
+    if((context = destctx) != NULL) {
+      /* elide the prefix */
+      iphc1 |= SICSLOWPAN_IPHC_DAC;
+      PACKETBUF_IPHC_BUF[2] |= context->number;
+      /* compession compare with link adress (destination) */
+
+      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+	       &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
+      /* No context found for this address */
+    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
+	      UIP_IP_BUF->destipaddr.u16[1] == 0 &&
+	      UIP_IP_BUF->destipaddr.u16[2] == 0 &&
+	      UIP_IP_BUF->destipaddr.u16[3] == 0) {
+      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+               &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
+    } else {
+      /* send the full address */
+      iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
+      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u16[0], 16);
+      hc06_ptr += 16;
+    }
+  }
+
+  return iphc1;
+}
 /*--------------------------------------------------------------------*/
 /**
  * \brief Compress IP/UDP header
@@ -495,6 +836,14 @@ static void
 compress_hdr_hc06(linkaddr_t *link_destaddr)
 {
   uint8_t tmp, iphc0, iphc1;
+#if SICSLOWPAN_GHC
+  uint8_t *nh_ptr, *nhc_ptr;
+  int ghc, n;
+#endif /* SICSLOWPAN_GHC */
+  struct sicslowpan_addr_context *srcctx, *destctx;
+#if SICSLOWPAN_IPHC_CACHE_ENTRIES > 0
+  struct iphc_cache_entry *cached;
+#endif /* SICSLOWPAN_IPHC_CACHE_ENTRIES > 0 */
 #if DEBUG
   { uint16_t ndx;
     PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
@@ -526,13 +875,25 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
 
 
   /* check if dest context exists (for allocating third byte) */
-  /* TODO: fix this so that it remembers the looked up values for
-     avoiding two lookups - or set the lookup values immediately */
-  if(addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr) != NULL ||
-     addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr) != NULL) {
-    /* set context flag and increase hc06_ptr */
-    PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n");
-    iphc1 |= SICSLOWPAN_IPHC_CID;
+#if SICSLOWPAN_IPHC_CACHE_ENTRIES > 0
+  cached = iphc_cache_lookup(link_destaddr);
+  if(cached != NULL) {
+    /* same addresses as a recent packet, reuse its encoding */
+    srcctx = destctx = NULL;
+    iphc1 = cached->iphc1;
+    PACKETBUF_IPHC_BUF[2] = cached->cid;
+  } else
+#endif /* SICSLOWPAN_IPHC_CACHE_ENTRIES > 0 */
+  {
+    srcctx = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr);
+    destctx = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr);
+    if(srcctx != NULL || destctx != NULL) {
+      PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n");
+      iphc1 |= SICSLOWPAN_IPHC_CID;
+    }
+  }
+  if(iphc1 & SICSLOWPAN_IPHC_CID) {
+    /* increase hc06_ptr for the context byte */
     hc06_ptr++;
   }
 
@@ -592,6 +953,15 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
     iphc0 |= SICSLOWPAN_IPHC_NH_C;
   }
 #endif
+#if SICSLOWPAN_GHC
+  /* ICMPv6 is only known to be compressible once GHC has run, see
+     below, until then leave room for the next header */
+  ghc = ghc_usable(link_destaddr);
+  nh_ptr = hc06_ptr;
+  if(ghc && UIP_IP_BUF->proto == UIP_PROTO_ICMP6) {
+    iphc0 |= SICSLOWPAN_IPHC_NH_C;
+  }
+#endif /* SICSLOWPAN_GHC */
   if ((iphc0 & SICSLOWPAN_IPHC_NH_C) == 0) {
     *hc06_ptr = UIP_IP_BUF->proto;
     hc06_ptr += 1;
@@ -620,87 +990,22 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
       break;
   }
 
-  /* source address - cannot be multicast */
-  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
-    PRINTF("IPHC: compressing unspecified - setting SAC\n");
-    iphc1 |= SICSLOWPAN_IPHC_SAC;
-    iphc1 |= SICSLOWPAN_IPHC_SAM_00;
-  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
-     != NULL) {
-    /* elide the prefix - indicate by CID and set context + SAC */
-    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
-	   context->number);
-    iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
-    PACKETBUF_IPHC_BUF[2] |= context->number << 4;
-    /* compession compare with this nodes address (source) */
-
-    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
-    /* No context found for this address */
-  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
-	    UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-	    UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-	    UIP_IP_BUF->destipaddr.u16[3] == 0) {
-    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
-  } else {
-    /* send the full address => SAC = 0, SAM = 00 */
-    iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
-    memcpy(hc06_ptr, &UIP_IP_BUF->srcipaddr.u16[0], 16);
-    hc06_ptr += 16;
-  }
-
-  /* dest address*/
-  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
-    /* Address is multicast, try to compress */
-    iphc1 |= SICSLOWPAN_IPHC_M;
-    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_11;
-      /* use last byte */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[15];
-      hc06_ptr += 1;
-    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_10;
-      /* second byte + the last three */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[13], 3);
-      hc06_ptr += 4;
-    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_01;
-      /* second byte + the last five */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[11], 5);
-      hc06_ptr += 6;
-    } else {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_00;
-      /* full address */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u8[0], 16);
-      hc06_ptr += 16;
-    }
+#if SICSLOWPAN_IPHC_CACHE_ENTRIES > 0
+  if(cached != NULL) {
+    memcpy(hc06_ptr, cached->addr, cached->len);
+    hc06_ptr += cached->len;
+    NETSTATS_ADD(lowpan_hc_cache_hit);
   } else {
-    /* Address is unicast, try to compress */
-    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
-      /* elide the prefix */
-      iphc1 |= SICSLOWPAN_IPHC_DAC;
-      PACKETBUF_IPHC_BUF[2] |= context->number;
-      /* compession compare with link adress (destination) */
+    uint8_t *addr = hc06_ptr;
 
-      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-	       &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
-      /* No context found for this address */
-    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
-	      UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-	      UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-	      UIP_IP_BUF->destipaddr.u16[3] == 0) {
-      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-               &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
-    } else {
-      /* send the full address */
-      iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u16[0], 16);
-      hc06_ptr += 16;
-    }
+    iphc1 = compress_addrs(iphc1, link_destaddr, srcctx, destctx);
+    iphc_cache_add(link_destaddr, iphc1, PACKETBUF_IPHC_BUF[2],
+                   addr, hc06_ptr - addr);
+    NETSTATS_ADD(lowpan_hc_cache_miss);
   }
+#else /* SICSLOWPAN_IPHC_CACHE_ENTRIES > 0 */
+  iphc1 = compress_addrs(iphc1, link_destaddr, srcctx, destctx);
+#endif /* SICSLOWPAN_IPHC_CACHE_ENTRIES > 0 */
 
   uncomp_hdr_len = UIP_IPH_LEN;
 
@@ -709,6 +1014,9 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
   if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
     PRINTF("IPHC: Uncompressed UDP ports on send side: %x, %x\n",
 	   UIP_HTONS(UIP_UDP_BUF->srcport), UIP_HTONS(UIP_UDP_BUF->destport));
+#if SICSLOWPAN_GHC
+    nhc_ptr = hc06_ptr;
+#endif /* SICSLOWPAN_GHC */
     /* Mask out the last 4 bits can be used as a mask */
     if(((UIP_HTONS(UIP_UDP_BUF->srcport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN) &&
        ((UIP_HTONS(UIP_UDP_BUF->destport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN)) {
@@ -752,8 +1060,29 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
       hc06_ptr += 2;
     }
     uncomp_hdr_len += UIP_UDPH_LEN;
+#if SICSLOWPAN_GHC
+    if(ghc && (n = ghc_compress(link_destaddr, hc06_ptr)) > 0) {
+      *nhc_ptr = SICSLOWPAN_NHC_UDP_GHC_ID | (*nhc_ptr & ~SICSLOWPAN_NHC_UDP_MASK);
+      hc06_ptr += n;
+    }
+#endif /* SICSLOWPAN_GHC */
+  }
+#endif /*UIP_CONF_UDP*/
+
+#if SICSLOWPAN_GHC
+  if(ghc && UIP_IP_BUF->proto == UIP_PROTO_ICMP6) {
+    if((n = ghc_compress(link_destaddr, hc06_ptr + 1)) > 0) {
+      *hc06_ptr = SICSLOWPAN_NHC_ICMP6_GHC;
+      hc06_ptr += 1 + n;
+    } else {
+      /* Not worth it, carry the next header inline after all */
+      memmove(nh_ptr + 1, nh_ptr, hc06_ptr - nh_ptr);
+      *nh_ptr = UIP_PROTO_ICMP6;
+      hc06_ptr++;
+      iphc0 &= ~SICSLOWPAN_IPHC_NH_C;
+    }
   }
-#endif /*UIP_CONF_UDP*/
+#endif /* SICSLOWPAN_GHC */
 
 #ifdef SICSLOWPAN_NH_COMPRESSOR
   /* if nothing to compress just return zero  */
@@ -783,8 +1112,9 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
  * \param ip_len Equal to 0 if the packet is not a fragment (IP length
  * is then inferred from the L2 length), non 0 if the packet is a 1st
  * fragment.
+ * \return 1 on success, 0 if the header is invalid
  */
-static void
+static int
 uncompress_hdr_hc06(uint16_t ip_len)
 {
   uint8_t tmp, iphc0, iphc1;
@@ -869,7 +1199,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
       context = addr_context_lookup_by_number(sci);
       if(context == NULL) {
         PRINTF("sicslowpan uncompress_hdr: error context not found\n");
-        return;
+        return 0;
       }
     }
     /* if tmp == 0 we do not have a context and therefore no prefix */
@@ -917,7 +1247,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
       /* all valid cases below need the context! */
       if(context == NULL) {
 	PRINTF("sicslowpan uncompress_hdr: error context not found\n");
-	return;
+	return 0;
       }
       uncompress_addr(&SICSLOWPAN_IP_BUF->destipaddr, context->prefix,
                       unc_ctxconf[tmp],
@@ -934,12 +1264,19 @@ uncompress_hdr_hc06(uint16_t ip_len)
   /* Next header processing - continued */
   if((iphc0 & SICSLOWPAN_IPHC_NH_C)) {
     /* The next header is compressed, NHC is following */
-    if((*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
+    if((*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID
+#if SICSLOWPAN_GHC
+       || (*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_GHC_ID
+#endif /* SICSLOWPAN_GHC */
+       ) {
       uint8_t checksum_compressed;
+#if SICSLOWPAN_GHC
+      uint8_t ghc = (*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_GHC_ID;
+#endif /* SICSLOWPAN_GHC */
       SICSLOWPAN_IP_BUF->proto = UIP_PROTO_UDP;
       checksum_compressed = *hc06_ptr & SICSLOWPAN_NHC_UDP_CHECKSUMC;
       PRINTF("IPHC: Incoming header value: %i\n", *hc06_ptr);
-      switch(*hc06_ptr & SICSLOWPAN_NHC_UDP_CS_P_11) {
+      switch(SICSLOWPAN_NHC_UDP_ID | (*hc06_ptr & 0x03)) {
       case SICSLOWPAN_NHC_UDP_CS_P_00:
 	/* 1 byte for NHC, 4 byte for ports, 2 bytes chksum */
 	memcpy(&SICSLOWPAN_UDP_BUF->srcport, hc06_ptr + 1, 2);
@@ -983,7 +1320,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
 
       default:
 	PRINTF("sicslowpan uncompress_hdr: error unsupported UDP compression\n");
-	return;
+	return 0;
       }
       if(!checksum_compressed) { /* has_checksum, default  */
 	memcpy(&SICSLOWPAN_UDP_BUF->udpchksum, hc06_ptr, 2);
@@ -993,7 +1330,21 @@ uncompress_hdr_hc06(uint16_t ip_len)
 	PRINTF("IPHC: sicslowpan uncompress_hdr: checksum *NOT* included\n");
       }
       uncomp_hdr_len += UIP_UDPH_LEN;
+#if SICSLOWPAN_GHC
+      if(ghc && !ghc_uncompress(ip_len)) {
+        return 0;
+      }
+#endif /* SICSLOWPAN_GHC */
+    }
+#if SICSLOWPAN_GHC
+    else if(*hc06_ptr == SICSLOWPAN_NHC_ICMP6_GHC) {
+      SICSLOWPAN_IP_BUF->proto = UIP_PROTO_ICMP6;
+      hc06_ptr++;
+      if(!ghc_uncompress(ip_len)) {
+        return 0;
+      }
     }
+#endif /* SICSLOWPAN_GHC */
 #ifdef SICSLOWPAN_NH_COMPRESSOR
     else {
       hc06_ptr += SICSLOWPAN_NH_COMPRESSOR.uncompress(hc06_ptr, sicslowpan_buf, &uncomp_hdr_len);
@@ -1020,7 +1371,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
     memcpy(&SICSLOWPAN_UDP_BUF->udplen, &SICSLOWPAN_IP_BUF->len[0], 2);
   }
 
-  return;
+  return 1;
 }
 /** @} */
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
@@ -1339,7 +1690,9 @@ send_packet(linkaddr_t *dest)
 #endif
 
   /* Provide a callback function to receive the result of
-     a packet transmission. */
+     a packet transmission. A MAC layer that queues the frame reports
+     later, so forget the result of an earlier frame first. */
+  last_tx_status = MAC_TX_OK;
   NETSTACK_LLSEC.send(&packet_sent, NULL);
 
   /* If we are sending multiple packets in a row, we need to let the
@@ -1347,6 +1700,47 @@ send_packet(linkaddr_t *dest)
   watchdog_periodic();
 }
 /*--------------------------------------------------------------------*/
+/** \brief Compress the IP header in uip_buf into packetbuf, using the
+ *  compression scheme selected with SICSLOWPAN_COMPRESSION. */
+static void
+compress_hdr(linkaddr_t *dest)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
+  compress_hdr_hc1(dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
+  compress_hdr_ipv6(dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  compress_hdr_hc06(dest);
+  NETSTATS_SUM(lowpan_hc_saved, uncomp_hdr_len - packetbuf_hdr_len);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+}
+/*--------------------------------------------------------------------*/
+/** \brief The number of bytes of 6lowpan header and payload that fit
+ *  in a frame to dest. */
+static int
+max_payload(linkaddr_t *dest)
+{
+  int framer_hdrlen;
+
+  /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC.
+   * We calculate it here only to make a better decision of whether the outgoing packet
+   * needs to be fragmented or not. */
+#define USE_FRAMER_HDRLEN 1
+#if USE_FRAMER_HDRLEN
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, dest);
+  framer_hdrlen = NETSTACK_FRAMER.length();
+  if(framer_hdrlen < 0) {
+    /* Framing failed, we assume the maximum header length */
+    framer_hdrlen = 21;
+  }
+#else /* USE_FRAMER_HDRLEN */
+  framer_hdrlen = 21;
+#endif /* USE_FRAMER_HDRLEN */
+  return MAC_MAX_PAYLOAD - framer_hdrlen - NETSTACK_LLSEC.get_overhead();
+}
+/*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
  *  \param localdest The MAC address of the destination
@@ -1359,8 +1753,7 @@ send_packet(linkaddr_t *dest)
 static uint8_t
 output(const uip_lladdr_t *localdest)
 {
-  int framer_hdrlen;
-  int max_payload;
+  int mac_max_payload;
 
   /* The MAC address of the destination of the packet */
   linkaddr_t dest;
@@ -1376,9 +1769,18 @@ output(const uip_lladdr_t *localdest)
   packetbuf_clear();
   packetbuf_ptr = packetbuf_dataptr();
 
+  NETSTATS_ADD(lowpan_out);
+
   packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
                      SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
 
+  /* ICMPv6 carries neighbor discovery and RPL, let the MAC layer
+     queue it as control traffic. */
+  if(UIP_IP_BUF->proto == UIP_PROTO_ICMP6) {
+    packetbuf_set_attr(PACKETBUF_ATTR_TRAFFIC_CLASS,
+                       PACKETBUF_ATTR_TRAFFIC_CLASS_CONTROL);
+  }
+
   if(callback) {
     /* call the attribution when the callback comes, but set attributes
        here ! */
@@ -1417,45 +1819,30 @@ output(const uip_lladdr_t *localdest)
 
   if(uip_len >= COMPRESSION_THRESHOLD) {
     /* Try to compress the headers */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
-    compress_hdr_hc1(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
-    compress_hdr_ipv6(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
-#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
-    compress_hdr_hc06(&dest);
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+    compress_hdr(&dest);
   } else {
     compress_hdr_ipv6(&dest);
   }
   PRINTFO("sicslowpan output: header of len %d\n", packetbuf_hdr_len);
 
-  /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC.
-   * We calculate it here only to make a better decision of whether the outgoing packet
-   * needs to be fragmented or not. */
-#define USE_FRAMER_HDRLEN 1
-#if USE_FRAMER_HDRLEN
-  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
-  framer_hdrlen = NETSTACK_FRAMER.length();
-  if(framer_hdrlen < 0) {
-    /* Framing failed, we assume the maximum header length */
-    framer_hdrlen = 21;
-  }
-#else /* USE_FRAMER_HDRLEN */
-  framer_hdrlen = 21;
-#endif /* USE_FRAMER_HDRLEN */
-  max_payload = MAC_MAX_PAYLOAD - framer_hdrlen - NETSTACK_LLSEC.get_overhead();
+  mac_max_payload = max_payload(&dest);
 
-  if((int)uip_len - (int)uncomp_hdr_len > max_payload - (int)packetbuf_hdr_len) {
+  if((int)uip_len - (int)uncomp_hdr_len > mac_max_payload - (int)packetbuf_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
-    struct queuebuf *q;
+    uint16_t frag_tag;
+    uint16_t frag_payload_len;
+    int frames;
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
      * packet, so we fragment it into multiple packets and send them.
      * The first fragment contains frag1 dispatch, then
      * IPv6/HC1/HC06/HC_UDP dispatchs/headers.
      * The following fragments contain only the fragn dispatch.
+     *
+     * The MAC layer takes its own copy of every fragment, so the
+     * packetbuf contents are not saved across send_packet(). Only the
+     * attributes are kept, and each FRAGN header is rebuilt in place
+     * before its payload is copied from uip_buf.
      */
     int estimated_fragments = ((int)uip_len) / ((int)MAC_MAX_PAYLOAD - SICSLOWPAN_FRAGN_HDR_LEN) + 1;
     int freebuf = queuebuf_numfree() - 1;
@@ -1482,25 +1869,25 @@ output(const uip_lladdr_t *localdest)
     SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
           ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | uip_len));
 /*     PACKETBUF_FRAG_BUF->tag = uip_htons(my_tag); */
-    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, my_tag);
-    my_tag++;
+    frag_tag = my_tag++;
+    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, frag_tag);
 
     /* Copy payload and send */
     packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-    packetbuf_payload_len = (max_payload - packetbuf_hdr_len) & 0xfffffff8;
+    packetbuf_payload_len = (mac_max_payload - packetbuf_hdr_len) & 0xfffffff8;
     PRINTFO("(len %d, tag %d)\n", packetbuf_payload_len, my_tag);
     memcpy(packetbuf_ptr + packetbuf_hdr_len,
            (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, packetbuf_payload_len);
     packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-    q = queuebuf_new_from_packetbuf();
-    if(q == NULL) {
-      PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
-      return 0;
-    }
+    /* Tell the MAC how many frames the datagram takes, so that it
+       queues either all of them or none */
+    frag_payload_len = (mac_max_payload - SICSLOWPAN_FRAGN_HDR_LEN) & 0xfffffff8;
+    frames = 1 + (uip_len - uncomp_hdr_len - packetbuf_payload_len +
+                  frag_payload_len - 1) / frag_payload_len;
+    packetbuf_set_attr(PACKETBUF_ATTR_FRAGMENTS, frames);
+    packetbuf_attr_copyto(frag_attrs, frag_addrs);
+    NETSTATS_ADD(lowpan_frag_out);
     send_packet(&dest);
-    queuebuf_to_packetbuf(q);
-    queuebuf_free(q);
-    q = NULL;
 
     /* Check tx result. */
     if((last_tx_status == MAC_TX_COLLISION) ||
@@ -1515,17 +1902,23 @@ output(const uip_lladdr_t *localdest)
     
     /*
      * Create following fragments
-     * Datagram tag is already in the buffer, we need to set the
-     * FRAGN dispatch and for each fragment, the offset
+     * The lower layers may have changed the buffer, so for each
+     * fragment we restore the attributes and write the FRAGN
+     * dispatch, the datagram tag and the offset
      */
     packetbuf_hdr_len = SICSLOWPAN_FRAGN_HDR_LEN;
-/*     PACKETBUF_FRAG_BUF->dispatch_size = */
-/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
-    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
-          ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
-    packetbuf_payload_len = (max_payload - packetbuf_hdr_len) & 0xfffffff8;
+    packetbuf_payload_len = frag_payload_len;
     while(processed_ip_out_len < uip_len) {
       PRINTFO("sicslowpan output: fragment ");
+      packetbuf_clear();
+      packetbuf_attr_copyfrom(frag_attrs, frag_addrs);
+      packetbuf_set_attr(PACKETBUF_ATTR_FRAGMENTS, --frames);
+      packetbuf_ptr = packetbuf_dataptr();
+/*       PACKETBUF_FRAG_BUF->dispatch_size = */
+/*         uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
+      SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+            ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
+      SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, frag_tag);
       PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET] = processed_ip_out_len >> 3;
       
       /* Copy payload and send */
@@ -1534,19 +1927,12 @@ output(const uip_lladdr_t *localdest)
         packetbuf_payload_len = uip_len - processed_ip_out_len;
       }
       PRINTFO("(offset %d, len %d, tag %d)\n",
-             processed_ip_out_len >> 3, packetbuf_payload_len, my_tag);
+             processed_ip_out_len >> 3, packetbuf_payload_len, frag_tag);
       memcpy(packetbuf_ptr + packetbuf_hdr_len,
              (uint8_t *)UIP_IP_BUF + processed_ip_out_len, packetbuf_payload_len);
       packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-      q = queuebuf_new_from_packetbuf();
-      if(q == NULL) {
-        PRINTFO("could not allocate queuebuf, dropping fragment\n");
-        return 0;
-      }
+      NETSTATS_ADD(lowpan_frag_out);
       send_packet(&dest);
-      queuebuf_to_packetbuf(q);
-      queuebuf_free(q);
-      q = NULL;
       processed_ip_out_len += packetbuf_payload_len;
 
       /* Check tx result. */
@@ -1577,6 +1963,305 @@ output(const uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/** \brief Free the reassembly contexts that have timed out. */
+static void
+reass_expire(void)
+{
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    if(reass_contexts[i].size > 0 && timer_expired(&reass_contexts[i].timer)) {
+      PRINTFI("sicslowpan input: reassembly timed out (tag %d)\n",
+              reass_contexts[i].tag);
+      reass_contexts[i].size = 0;
+      NETSTATS_ADD(lowpan_reass_timeout);
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the reassembly context of a fragment, or start a new one.
+ * \param create Non-zero for a FRAG1, which may start a new context
+ * \return The context, or NULL if there is none and create is zero
+ *
+ * If all contexts are in use, the one that was started first is
+ * evicted to make room for the new datagram.
+ */
+static struct reass_context *
+reass_lookup(const linkaddr_t *sender, uint16_t tag, uint16_t size,
+             uint8_t create)
+{
+  struct reass_context *c, *free, *oldest;
+  int i;
+
+  free = oldest = NULL;
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    c = &reass_contexts[i];
+    if(c->size == 0) {
+      if(free == NULL) {
+        free = c;
+      }
+    } else if(c->size == size && c->tag == tag &&
+              linkaddr_cmp(&c->sender, sender)) {
+      return c;
+    } else if(oldest == NULL || clock_time() - c->timer.start >
+              clock_time() - oldest->timer.start) {
+      oldest = c;
+    }
+  }
+
+  if(!create) {
+    return NULL;
+  }
+  if(free == NULL) {
+    PRINTFI("sicslowpan input: evicting reassembly of tag %d\n", oldest->tag);
+    NETSTATS_ADD(lowpan_reass_evict);
+    free = oldest;
+  }
+
+  c = free;
+  linkaddr_copy(&c->sender, sender);
+  c->tag = tag;
+  c->size = size;
+  c->blocks = 0;
+  memset(c->received, 0, sizeof(c->received));
+  timer_set(&c->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+          size, tag);
+  return c;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Set the bits of the 8-byte blocks [start, end) of a datagram
+ * of the given size in a bitmap of received blocks.
+ * \return The number of blocks that were not set before
+ */
+static uint16_t
+mark_blocks(uint8_t *received, uint16_t size, uint16_t start, uint16_t end)
+{
+  uint16_t block, n;
+
+  if(end > size) {
+    /* We must be liberal in what we accept: the last fragment may
+       have extraneous bytes at the end. */
+    end = size;
+  }
+  n = 0;
+  for(block = start / 8; block < (end + 7) / 8; block++) {
+    if((received[block / 8] & (1 << (block % 8))) == 0) {
+      received[block / 8] |= 1 << (block % 8);
+      n++;
+    }
+  }
+  return n;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Mark the bytes [start, end) of a datagram as received.
+ * \return 1 if the datagram is complete, 0 otherwise.
+ */
+static int
+reass_mark(struct reass_context *c, uint16_t start, uint16_t end)
+{
+  c->blocks += mark_blocks(c->received, c->size, start, end);
+  return c->blocks == (c->size + 7) / 8;
+}
+#if SICSLOWPAN_FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/** \brief Find the forwarding entry of a fragment, if there is one. */
+static struct fwd_entry *
+fwd_lookup(const linkaddr_t *sender, uint16_t tag, uint16_t size)
+{
+  struct fwd_entry *e;
+
+  for(e = fwd_entries; e < &fwd_entries[SICSLOWPAN_FRAG_FWD_ENTRIES]; e++) {
+    if(e->size > 0 && timer_expired(&e->timer)) {
+      e->size = 0;
+    }
+    if(e->size == size && e->tag == tag && linkaddr_cmp(&e->sender, sender)) {
+      return e;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Relay the FRAGN in packetbuf along its forwarding entry.
+ *
+ * Only the tag changes: the offsets of the following fragments are
+ * counted in the uncompressed datagram and stay the same on every hop.
+ * A FRAGN that was already relayed, e.g. because the previous hop did
+ * not get our link-layer ACK, is dropped.
+ */
+static void
+fwd_relay(struct fwd_entry *e)
+{
+  uint16_t start, n;
+
+  start = (uint16_t)PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET] << 3;
+  n = mark_blocks(e->received, e->size, start,
+                  start + packetbuf_datalen() - SICSLOWPAN_FRAGN_HDR_LEN);
+  if(n == 0) {
+    PRINTFI("sicslowpan input: dropping duplicate FRAGN of tag %d\n", e->tag);
+    NETSTATS_ADD(lowpan_drop);
+    return;
+  }
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, e->out_tag);
+  e->relayed += n;
+  if(e->relayed == (e->size + 7) / 8) {
+    e->size = 0;
+  }
+
+  packetbuf_compact();
+  packetbuf_clear_hdr();
+  packetbuf_attr_clear();
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  NETSTATS_ADD(lowpan_frag_fwd);
+  send_packet(&e->nexthop);
+}
+/*--------------------------------------------------------------------*/
+/** \brief The IPv6 next hop towards the destination in uip_buf. */
+static uip_ipaddr_t *
+fwd_nexthop(void)
+{
+  uip_ds6_route_t *route;
+
+  if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)) {
+    return &UIP_IP_BUF->destipaddr;
+  }
+  route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
+  if(route != NULL) {
+    return uip_ds6_route_nexthop(route);
+  }
+  return uip_ds6_defrt_choose();
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Recompress the header in uip_buf into packetbuf for the next
+ * hop of e, after room for the FRAG1 header. The FRAG1 keeps carrying
+ * the first len bytes of the datagram.
+ * \return 1 if the header is within these bytes and the FRAG1 fits in
+ * a frame, 0 otherwise
+ */
+static int
+fwd_compress(struct fwd_entry *e, uint16_t len)
+{
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+  compress_hdr(&e->nexthop);
+  memmove(packetbuf_ptr + SICSLOWPAN_FRAG1_HDR_LEN, packetbuf_ptr, packetbuf_hdr_len);
+  packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+  return uncomp_hdr_len <= len &&
+    packetbuf_hdr_len + len - uncomp_hdr_len <= max_payload(&e->nexthop);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Start relaying the datagram of the FRAG1 just received.
+ * \param c The reassembly context holding the first len bytes of the
+ * datagram
+ * \return 1 if the FRAG1 was relayed, -1 if the datagram must be
+ * dropped and 0 if it has to be reassembled and handed to uIP.
+ *
+ * The checks of the uIP forwarding path are repeated here. Anything
+ * they do not cover, like a missing neighbor cache entry, is left to
+ * uIP by reassembling the datagram as usual.
+ */
+static int
+fwd_start(struct reass_context *c, uint16_t len)
+{
+  struct fwd_entry *e;
+  uip_ipaddr_t *nexthop;
+  uip_ds6_nbr_t *nbr;
+
+  for(e = fwd_entries; e < &fwd_entries[SICSLOWPAN_FRAG_FWD_ENTRIES]; e++) {
+    if(e->size == 0 || timer_expired(&e->timer)) {
+      break;
+    }
+  }
+  if(e == &fwd_entries[SICSLOWPAN_FRAG_FWD_ENTRIES]) {
+    return 0;
+  }
+
+  /* The recompression reads the header from uip_buf. */
+  memcpy(UIP_IP_BUF, c->buf.u8 + UIP_LLH_LEN, len);
+  uip_len = 0;
+  uip_ext_len = 0;
+
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) ||
+     UIP_IP_BUF->ttl <= 1) {
+    return 0;
+  }
+#if UIP_CONF_IPV6_RPL
+  /* uIP would insert the RPL option if it is missing, which moves the
+     rest of the datagram. */
+  if(UIP_IP_BUF->proto != UIP_PROTO_HBHO || len < UIP_IPH_LEN + 8) {
+    return 0;
+  }
+#else /* UIP_CONF_IPV6_RPL */
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    return 0;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
+  nexthop = fwd_nexthop();
+  if(nexthop == NULL) {
+    return 0;
+  }
+  nbr = uip_ds6_nbr_lookup(nexthop);
+  if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+    return 0;
+  }
+
+  UIP_IP_BUF->ttl--;
+  linkaddr_copy(&e->nexthop, (const linkaddr_t *)uip_ds6_nbr_get_ll(nbr));
+
+  /* Once RPL has checked the datagram, it must not be handed to uIP,
+     which would check it again. So make sure first that the FRAG1
+     fits. Updating the RPL option does not change its length. */
+  if(!fwd_compress(e, len)) {
+    return 0;
+  }
+#if UIP_CONF_IPV6_RPL
+  /* RPL looks up the parent the datagram came from */
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &c->sender);
+  if(rpl_verify_header(2) || rpl_update_header_empty() ||
+     rpl_update_header_final(nexthop)) {
+    return -1;
+  }
+  fwd_compress(e, len);
+#endif /* UIP_CONF_IPV6_RPL */
+
+  e->out_tag = my_tag++;
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | c->size));
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, e->out_tag);
+  memcpy(packetbuf_ptr + packetbuf_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, len - uncomp_hdr_len);
+  packetbuf_set_datalen(packetbuf_hdr_len + len - uncomp_hdr_len);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+
+  linkaddr_copy(&e->sender, &c->sender);
+  e->tag = c->tag;
+  e->size = c->size;
+  memset(e->received, 0, sizeof(e->received));
+  e->relayed = mark_blocks(e->received, e->size, 0, len);
+  timer_set(&e->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  PRINTFI("sicslowpan input: relaying tag %d as tag %d\n", e->tag, e->out_tag);
+
+  NETSTATS_ADD(lowpan_frag_fwd);
+  send_packet(&e->nexthop);
+  return 1;
+}
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1584,8 +2269,13 @@ output(const uip_lladdr_t *localdest)
  *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
  *  a non-fragmented packet we first uncompress the IP header. The
  *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
- *  to uip_buf and the IP layer is called.
+ *  copied in siclowpan_buf, which is uip_buf for a non-fragmented
+ *  packet and the buffer of a reassembly context for a fragment.
+ *  Up to SICSLOWPAN_REASS_CONTEXTS datagrams can be reassembled at
+ *  the same time. A datagram starts with its FRAG1, after which its
+ *  FRAGNs may arrive in any order. When a
+ *  datagram is complete it is copied to uip_buf and the IP layer is
+ *  called.
  *
  * \note We do not check for overlapping sicslowpan fragments
  * (it is a SHALL in the RFC 4944 and should never happen)
@@ -1597,11 +2287,11 @@ input(void)
   uint16_t frag_size = 0;
   /* offset of the fragment in the IP packet */
   uint8_t frag_offset = 0;
-  uint8_t is_fragment = 0;
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   uint16_t frag_tag = 0;
-  uint8_t first_fragment = 0, last_fragment = 0;
+  /* reassembly context of the fragment */
+  struct reass_context *reass = NULL;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1614,12 +2304,9 @@ input(void)
   /* Save the RSSI of the incoming packet in case the upper layer will
      want to query us for it later. */
   last_rssi = (signed short)packetbuf_attr(PACKETBUF_ATTR_RSSI);
+  NETSTATS_ADD(lowpan_in);
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
+  reass_expire();
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1635,9 +2322,7 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-      /*      printf("frag1 %d %d\n", reass_tag, frag_tag);*/
-      first_fragment = 1;
-      is_fragment = 1;
+      NETSTATS_ADD(lowpan_frag_in);
       break;
     case SICSLOWPAN_DISPATCH_FRAGN:
       /*
@@ -1651,77 +2336,46 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
-
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d packetbuf_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - packetbuf_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - packetbuf_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
-      is_fragment = 1;
+      NETSTATS_ADD(lowpan_frag_in);
       break;
     default:
       break;
   }
 
-  /* We are currently reassembling a packet, but have just received the first
-   * fragment of another packet. We can either ignore it and hope to receive
-   * the rest of the under-reassembly packet fragments, or we can discard the
-   * previous packet altogether, and start reassembling the new packet.
-   *
-   * We discard the previous packet, and start reassembling the new packet.
-   * This lessens the negative impacts of too high SICSLOWPAN_REASS_MAXAGE.
-   */
-#define PRIORITIZE_NEW_PACKETS 1
-#if PRIORITIZE_NEW_PACKETS
-
-  if(!is_fragment) {
-    /* Prioritize non-fragment packets too. */
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  } else if(processed_ip_in_len > 0 && first_fragment
-      && !linkaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
-#endif /* PRIORITIZE_NEW_PACKETS */
-
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !linkaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+  if(packetbuf_hdr_len > 0) {
+    /* This is a fragment: find the datagram it belongs to. */
+    if(frag_size == 0 || frag_size > UIP_BUFSIZE - UIP_LLH_LEN) {
+      PRINTFI("sicslowpan input: Dropping fragment of invalid size %d\n",
+              frag_size);
+      NETSTATS_ADD(lowpan_drop);
       return;
     }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      /* We are currently not reassembling a packet, but have received a packet fragment
-       * that is not the first one. */
-      if(is_fragment && !first_fragment) {
+#if SICSLOWPAN_FRAG_FORWARDING
+    if(packetbuf_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
+      struct fwd_entry *fwd;
+
+      fwd = fwd_lookup(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                       frag_tag, frag_size);
+      if(fwd != NULL) {
+        fwd_relay(fwd);
         return;
       }
-
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
-      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      linkaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
     }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+    /* Only a FRAG1 starts a datagram: a FRAGN without one would
+       otherwise evict a datagram that is being reassembled. */
+    reass = reass_lookup(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                         frag_tag, frag_size,
+                         packetbuf_hdr_len == SICSLOWPAN_FRAG1_HDR_LEN);
+    if(reass == NULL) {
+      PRINTFI("sicslowpan input: Dropping FRAGN of unknown datagram (tag %d)\n",
+              frag_tag);
+      NETSTATS_ADD(lowpan_drop);
+      return;
+    }
+    sicslowpan_buf = reass->buf.u8;
+  } else {
+    sicslowpan_buf = uip_buf;
   }
 
   if(packetbuf_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1734,7 +2388,10 @@ input(void)
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
   if((PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH] & 0xe0) == SICSLOWPAN_DISPATCH_IPHC) {
     PRINTFI("sicslowpan input: IPHC\n");
-    uncompress_hdr_hc06(frag_size);
+    if(!uncompress_hdr_hc06(frag_size)) {
+      NETSTATS_ADD(lowpan_drop);
+      return;
+    }
   } else
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
     switch(PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH]) {
@@ -1759,6 +2416,7 @@ input(void)
       /* unknown header */
       PRINTFI("sicslowpan input: unknown dispatch: %u\n",
              PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH]);
+      NETSTATS_ADD(lowpan_drop);
       return;
   }
    
@@ -1775,6 +2433,7 @@ input(void)
    */
   if(packetbuf_datalen() < packetbuf_hdr_len) {
     PRINTF("SICSLOWPAN: packet dropped due to header > total packet\n");
+    NETSTATS_ADD(lowpan_drop);
     return;
   }
   packetbuf_payload_len = packetbuf_datalen() - packetbuf_hdr_len;
@@ -1783,79 +2442,82 @@ input(void)
   {
     int req_size = UIP_LLH_LEN + uncomp_hdr_len + (uint16_t)(frag_offset << 3)
         + packetbuf_payload_len;
-    if(req_size > sizeof(sicslowpan_buf)) {
+    if(req_size > UIP_BUFSIZE) {
       PRINTF(
           "SICSLOWPAN: packet dropped, minimum required SICSLOWPAN_IP_BUF size: %d+%d+%d+%d=%d (current size: %d)\n",
           UIP_LLH_LEN, uncomp_hdr_len, (uint16_t)(frag_offset << 3),
-          packetbuf_payload_len, req_size, sizeof(sicslowpan_buf));
+          packetbuf_payload_len, req_size, UIP_BUFSIZE);
       /// XXX Godoi, buffer overflow check here
       NODESTAT_UPDATE(overbuf);
+      NETSTATS_ADD(lowpan_drop);
       return;
     }
   }
 
   memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), packetbuf_ptr + packetbuf_hdr_len, packetbuf_payload_len);
   
-  /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
-
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
-    /* Add the size of the header only for the first fragment. */
-    if(first_fragment != 0) {
-      processed_ip_in_len += uncomp_hdr_len;
-    }
-    /* For the last fragment, we are OK if there is extrenous bytes at
-       the end of the packet. */
-    if(last_fragment != 0) {
-      processed_ip_in_len = frag_size;
-    } else {
-      processed_ip_in_len += packetbuf_payload_len;
+  if(reass != NULL) {
+#if SICSLOWPAN_FRAG_FORWARDING
+    /* Nothing but the FRAG1 has been received */
+    uint8_t relay = frag_offset == 0 && reass->blocks == 0;
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+    /*
+     * Record the blocks this fragment covers. The first fragment
+     * starts at offset 0 and also carries the uncompressed headers.
+     */
+    if(!reass_mark(reass, (uint16_t)(frag_offset << 3),
+                   uncomp_hdr_len + (uint16_t)(frag_offset << 3) +
+                   packetbuf_payload_len)) {
+#if SICSLOWPAN_FRAG_FORWARDING
+      if(relay) {
+        switch(fwd_start(reass, uncomp_hdr_len + packetbuf_payload_len)) {
+        case 1:
+          reass->size = 0;
+          return;
+        case -1:
+          reass->size = 0;
+          NETSTATS_ADD(lowpan_drop);
+          return;
+        }
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+      PRINTF("sicslowpan input: %d of %d blocks of tag %d received\n",
+             reass->blocks, (reass->size + 7) / 8, reass->tag);
+      return;
     }
-    PRINTF("processed_ip_in_len %d, packetbuf_payload_len %d\n", processed_ip_in_len, packetbuf_payload_len);
-
-  } else {
+    PRINTFI("sicslowpan input: IP packet ready (length %d)\n", reass->size);
+    NETSTATS_ADD(lowpan_reass_ok);
+    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, reass->size);
+    uip_len = reass->size;
+    reass->size = 0;
+    sicslowpan_buf = uip_buf;
+  } else
 #endif /* SICSLOWPAN_CONF_FRAG */
-    sicslowpan_len = packetbuf_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
+  {
+    uip_len = packetbuf_payload_len + uncomp_hdr_len;
+    PRINTFI("sicslowpan input: IP packet ready (length %d)\n", uip_len);
   }
 
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
-    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
-           sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-#endif /* SICSLOWPAN_CONF_FRAG */
-
 #if DEBUG
-    {
-      uint16_t ndx;
-      PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
-      for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
-        uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
-        PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint16_t ndx;
+    PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
+    for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
-    /* if callback is set then set attributes and call */
-    if(callback) {
-      set_packet_attrs();
-      callback->input_callback();
-    }
-
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  /* if callback is set then set attributes and call */
+  if(callback) {
+    set_packet_attrs();
+    callback->input_callback();
   }
-#endif /* SICSLOWPAN_CONF_FRAG */
+
+  tcpip_input();
 }
 /** @} */
 
@@ -1880,6 +2542,7 @@ sicslowpan_init(void)
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 
   addr_contexts[0].used   = 1;
   addr_contexts[0].number = 0;
+  addr_contexts[0].compress = 1;
 #ifdef SICSLOWPAN_CONF_ADDR_CONTEXT_0
 	SICSLOWPAN_CONF_ADDR_CONTEXT_0;
 #else
@@ -1896,11 +2559,13 @@ sicslowpan_init(void)
 	  if (i==1) {
 	    addr_contexts[1].used   = 1;
 		addr_contexts[1].number = 1;
+		addr_contexts[1].compress = 1;
 		SICSLOWPAN_CONF_ADDR_CONTEXT_1;
 #ifdef SICSLOWPAN_CONF_ADDR_CONTEXT_2
       } else if (i==2) {
 	  	addr_contexts[2].used   = 1;
 		addr_contexts[2].number = 2;
+		addr_contexts[2].compress = 1;
 		SICSLOWPAN_CONF_ADDR_CONTEXT_2;
 #endif
       } else {
@@ -1914,6 +2579,65 @@ sicslowpan_init(void)
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
 
+#if SICSLOWPAN_GHC
+  nbr_table_register(ghc_nbrs, NULL);
+#endif /* SICSLOWPAN_GHC */
+
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+}
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_context_set(uint8_t number, const uint8_t *prefix,
+                       uint8_t compress, uint16_t lifetime)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && \
+    SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  struct sicslowpan_addr_context *c;
+  int i;
+
+  if(number > 15) {
+    return 0;
+  }
+
+  c = NULL;
+  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    if(addr_contexts[i].used == 1 && addr_contexts[i].number == number) {
+      c = &addr_contexts[i];
+      break;
+    }
+    if(addr_contexts[i].used == 0 && c == NULL) {
+      c = &addr_contexts[i];
+    }
+  }
+
+  if(lifetime == 0) {
+    if(c != NULL && c->used == 1) {
+      c->used = 0;
+    }
+  } else if(c == NULL) {
+    PRINTF("IPHC: no room for context %d\n", number);
+    return 0;
+  } else {
+    c->used = 1;
+    c->number = number;
+    memcpy(c->prefix, prefix, sizeof(c->prefix));
+    c->compress = compress;
+    if(lifetime == SICSLOWPAN_CONTEXT_INFINITE) {
+      c->lifetime = 0;
+    } else {
+      c->lifetime = lifetime;
+      if(ctimer_expired(&context_timer)) {
+        ctimer_set(&context_timer, 60 * CLOCK_SECOND, context_periodic, NULL);
+      }
+    }
+  }
+
+#if SICSLOWPAN_IPHC_CACHE_ENTRIES > 0
+  iphc_cache_flush();
+#endif /* SICSLOWPAN_IPHC_CACHE_ENTRIES > 0 */
+  return 1;
+#else
+  return 0;
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
 }
 /*--------------------------------------------------------------------*/
@@ -223,8 +223,13 @@ struct sicslowpan_addr_context {
   uint8_t used; /* possibly use as prefix-length */
   uint8_t number;
   uint8_t prefix[8];
+  uint8_t compress; /* 0 if the context may only be used to uncompress */
+  uint16_t lifetime; /* minutes left, 0 if the context does not expire */
 };
 
+/** Lifetime of a context that is kept until it is removed */
+#define SICSLOWPAN_CONTEXT_INFINITE 0xffff
+
 /**
  * \name Address compressibility test functions
  * @{
@@ -321,6 +326,28 @@ struct sicslowpan_nh_compressor {
 
 int sicslowpan_get_last_rssi(void);
 
+/**
+ * \brief Add, update or remove an IPHC address context, e.g. from a
+ * 6LoWPAN Context Option (RFC 6775) in a router advertisement.
+ * \param number Context identifier, 0-15
+ * \param prefix The 64-bit prefix of the context
+ * \param compress 0 if the context may only be used to uncompress
+ * received headers
+ * \param lifetime Lifetime in minutes, 0 removes the context and
+ * SICSLOWPAN_CONTEXT_INFINITE keeps it until it is removed
+ * \return 1 if the context was stored or removed, 0 if the table is full
+ */
+int sicslowpan_context_set(uint8_t number, const uint8_t *prefix,
+                           uint8_t compress, uint16_t lifetime);
+
+/**
+ * \brief Record that a neighbor can uncompress 6LoWPAN-GHC, e.g. from
+ * a 6LoWPAN Capability Indication Option (RFC 7400), so that GHC is
+ * also sent to it. Only available with SICSLOWPAN_GHC.
+ * \param addr The link-layer address of the neighbor
+ */
+void sicslowpan_ghc_add_neighbor(const linkaddr_t *addr);
+
 extern const struct network_driver sicslowpan_driver;
 
 #endif /* SICSLOWPAN_H_ */
@@ -72,12 +72,139 @@ LIST(notificationlist);
 
 static int num_routes = 0;
 
+#if UIP_DS6_ROUTE_HASH
+/* Hash table of host routes, using linear probing. Each slot holds
+   the index of a route in routememb, or HASH_EMPTY. */
+typedef uint16_t route_hash_slot_t;
+#define HASH_EMPTY ((route_hash_slot_t)~0)
+static route_hash_slot_t route_hash[UIP_DS6_ROUTE_HASH_SIZE];
+/* Routes with a prefix shorter than 128 bits */
+static uip_ds6_route_t *prefix_routes;
+/* Incremented on every route use, used to find the least recently
+   used route when the table is full */
+static uint32_t lookup_counter;
+
+#define ROUTE_INDEX(r) ((r) - (uip_ds6_route_t *)routememb.mem)
+#define ROUTE_FROM_INDEX(i) (&((uip_ds6_route_t *)routememb.mem)[i])
+#endif /* UIP_DS6_ROUTE_HASH */
+
 #undef DEBUG
 #define DEBUG DEBUG_NONE
 #include "net/ip/uip-debug.h"
 
 static void rm_routelist_callback(nbr_table_item_t *ptr);
 /*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_HASH
+/* FNV-1a hash of the address. Addresses in a network mostly differ in
+   a few trailing bytes, which needs a hash that mixes well. */
+static int
+hash_slot(const uip_ipaddr_t *addr)
+{
+  uint32_t h = 2166136261UL;
+  int i;
+  for(i = 0; i < sizeof(uip_ipaddr_t); i++) {
+    h = (h ^ addr->u8[i]) * 16777619UL;
+  }
+  return h % UIP_DS6_ROUTE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the slot of the host route for an address, or -1 */
+static int
+hash_find(const uip_ipaddr_t *addr)
+{
+  int slot;
+  int n;
+
+  slot = hash_slot(addr);
+  for(n = 0; n < UIP_DS6_ROUTE_HASH_SIZE; n++) {
+    if(route_hash[slot] == HASH_EMPTY) {
+      return -1;
+    }
+    if(uip_ipaddr_cmp(addr, &ROUTE_FROM_INDEX(route_hash[slot])->ipaddr)) {
+      return slot;
+    }
+    slot = (slot + 1) % UIP_DS6_ROUTE_HASH_SIZE;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Add a newly created route to the host route table or prefix list */
+static void
+index_route(uip_ds6_route_t *r)
+{
+  int slot;
+
+  r->last_used = ++lookup_counter;
+  if(r->length < 128) {
+    r->prefix_next = prefix_routes;
+    prefix_routes = r;
+    return;
+  }
+  /* There are more slots than routes, so a free slot always exists */
+  slot = hash_slot(&r->ipaddr);
+  while(route_hash[slot] != HASH_EMPTY) {
+    slot = (slot + 1) % UIP_DS6_ROUTE_HASH_SIZE;
+  }
+  route_hash[slot] = ROUTE_INDEX(r);
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a route from the host route table or prefix list. Host routes
+   after it in the probe sequence are shifted back, so that no
+   tombstones are needed. */
+static void
+unindex_route(uip_ds6_route_t *r)
+{
+  uip_ds6_route_t **rp;
+  int hole, slot, home;
+
+  if(r->length < 128) {
+    for(rp = &prefix_routes; *rp != NULL; rp = &(*rp)->prefix_next) {
+      if(*rp == r) {
+        *rp = r->prefix_next;
+        break;
+      }
+    }
+    return;
+  }
+
+  hole = hash_find(&r->ipaddr);
+  if(hole == -1) {
+    return;
+  }
+  slot = hole;
+  while(1) {
+    slot = (slot + 1) % UIP_DS6_ROUTE_HASH_SIZE;
+    if(route_hash[slot] == HASH_EMPTY) {
+      break;
+    }
+    home = hash_slot(&ROUTE_FROM_INDEX(route_hash[slot])->ipaddr);
+    /* Leave the entry if its home slot lies cyclically in (hole, slot] */
+    if(hole <= slot ? (hole < home && home <= slot)
+                    : (hole < home || home <= slot)) {
+      continue;
+    }
+    route_hash[hole] = route_hash[slot];
+    hole = slot;
+  }
+  route_hash[hole] = HASH_EMPTY;
+}
+/*---------------------------------------------------------------------------*/
+/* The route that was used least recently */
+static uip_ds6_route_t *
+least_recently_used(void)
+{
+  uip_ds6_route_t *r, *oldest;
+
+  oldest = list_head(routelist);
+  for(r = oldest; r != NULL; r = list_item_next(r)) {
+    if((int32_t)(r->last_used - oldest->last_used) < 0) {
+      oldest = r;
+    }
+  }
+  return oldest;
+}
+#endif /* UIP_DS6_ROUTE_HASH */
+/*---------------------------------------------------------------------------*/
 #if DEBUG != DEBUG_NONE
 static void
 assert_nbr_routes_list_sane(void)
@@ -148,6 +275,10 @@ uip_ds6_route_init(void)
 {
   memb_init(&routememb);
   list_init(routelist);
+#if UIP_DS6_ROUTE_HASH
+  memset(route_hash, 0xff, sizeof(route_hash));
+  prefix_routes = NULL;
+#endif /* UIP_DS6_ROUTE_HASH */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 
@@ -159,12 +290,14 @@ uip_ds6_route_init(void)
 #endif
 }
 /*---------------------------------------------------------------------------*/
-static uip_lladdr_t *
-uip_ds6_route_nexthop_lladdr(uip_ds6_route_t *route)
+/* The neighbor cache entry of the nexthop, found without an address
+   search since both tables are indexed by neighbor. */
+uip_ds6_nbr_t *
+uip_ds6_route_nexthop_nbr(uip_ds6_route_t *route)
 {
   if(route != NULL) {
-    return (uip_lladdr_t *)nbr_table_get_lladdr(nbr_routes,
-                                                route->neighbor_routes);
+    return nbr_table_get_from_item(ds6_neighbors, nbr_routes,
+                                   route->neighbor_routes);
   } else {
     return NULL;
   }
@@ -173,11 +306,8 @@ uip_ds6_route_nexthop_lladdr(uip_ds6_route_t *route)
 uip_ipaddr_t *
 uip_ds6_route_nexthop(uip_ds6_route_t *route)
 {
-  if(route != NULL) {
-    return uip_ds6_nbr_ipaddr_from_lladdr(uip_ds6_route_nexthop_lladdr(route));
-  } else {
-    return NULL;
-  }
+  uip_ds6_nbr_t *nbr = uip_ds6_route_nexthop_nbr(route);
+  return nbr != NULL ? &nbr->ipaddr : NULL;
 }
 /*---------------------------------------------------------------------------*/
 uip_ds6_route_t *
@@ -216,6 +346,22 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
 
   found_route = NULL;
   longestmatch = 0;
+#if UIP_DS6_ROUTE_HASH
+  {
+    int slot = hash_find(addr);
+    if(slot != -1) {
+      found_route = ROUTE_FROM_INDEX(route_hash[slot]);
+    } else {
+      for(r = prefix_routes; r != NULL; r = r->prefix_next) {
+        if(r->length >= longestmatch &&
+           uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+          longestmatch = r->length;
+          found_route = r;
+        }
+      }
+    }
+  }
+#else /* UIP_DS6_ROUTE_HASH */
   for(r = uip_ds6_route_head();
       r != NULL;
       r = uip_ds6_route_next(r)) {
@@ -229,6 +375,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       }
     }
   }
+#endif /* UIP_DS6_ROUTE_HASH */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -240,6 +387,13 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     PRINTF("uip-ds6-route: No route found\n");
   }
 
+#if UIP_DS6_ROUTE_HASH
+  /* Moving the route to the head of the list would cost a list walk,
+     so recency is tracked with a counter instead. */
+  if(found_route != NULL) {
+    found_route->last_used = ++lookup_counter;
+  }
+#else /* UIP_DS6_ROUTE_HASH */
   if(found_route != NULL && found_route != list_head(routelist)) {
     /* If we found a route, we put it at the start of the routeslist
        list. The list is ordered by how recently we looked them up:
@@ -249,6 +403,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     list_remove(routelist, found_route);
     list_push(routelist, found_route);
   }
+#endif /* UIP_DS6_ROUTE_HASH */
 
   return found_route;
 }
@@ -301,7 +456,11 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
          least recently used route is the first route on the list. */
       uip_ds6_route_t *oldest;
 
+#if UIP_DS6_ROUTE_HASH
+      oldest = least_recently_used();
+#else /* UIP_DS6_ROUTE_HASH */
       oldest = list_tail(routelist); /* uip_ds6_route_head(); */
+#endif /* UIP_DS6_ROUTE_HASH */
       PRINTF("uip_ds6_route_add: dropping route to ");
       PRINT6ADDR(&oldest->ipaddr);
       PRINTF("\n");
@@ -371,6 +530,9 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+#if UIP_DS6_ROUTE_HASH
+  index_route(r);
+#endif /* UIP_DS6_ROUTE_HASH */
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -409,6 +571,9 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
 
     /* Remove the route from the route list */
     list_remove(routelist, route);
+#if UIP_DS6_ROUTE_HASH
+    unindex_route(route);
+#endif /* UIP_DS6_ROUTE_HASH */
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
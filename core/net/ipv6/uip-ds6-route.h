@@ -88,6 +88,23 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB UIP_CONF_MAX_ROUTES
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/* Index host (/128) routes in a hash table so that uip_ds6_route_lookup()
+   does not scan the whole routing table. Routes with shorter prefixes
+   are kept on a separate list that is searched when no host route
+   matches. Meant for RPL roots in storing mode with large tables. */
+#ifndef UIP_CONF_DS6_ROUTE_HASH
+#define UIP_DS6_ROUTE_HASH 0
+#else
+#define UIP_DS6_ROUTE_HASH UIP_CONF_DS6_ROUTE_HASH
+#endif
+
+/* Number of slots in the host route hash table */
+#ifndef UIP_CONF_DS6_ROUTE_HASH_SIZE
+#define UIP_DS6_ROUTE_HASH_SIZE (2 * UIP_DS6_ROUTE_NB + 1)
+#else
+#define UIP_DS6_ROUTE_HASH_SIZE UIP_CONF_DS6_ROUTE_HASH_SIZE
+#endif
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -121,6 +138,13 @@ typedef struct uip_ds6_route {
   UIP_DS6_ROUTE_STATE_TYPE state;
 #endif
   uint8_t length;
+#if UIP_DS6_ROUTE_HASH
+  /* Next route on the list of routes shorter than 128 bits */
+  struct uip_ds6_route *prefix_next;
+  /* Lookup counter value when the route was last used, for LRU
+     replacement */
+  uint32_t last_used;
+#endif /* UIP_DS6_ROUTE_HASH */
 } uip_ds6_route_t;
 
 /** \brief A neighbor route list entry, used on the
@@ -159,6 +183,7 @@ void uip_ds6_route_rm(uip_ds6_route_t *route);
 void uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop);
 
 uip_ipaddr_t *uip_ds6_route_nexthop(uip_ds6_route_t *);
+struct uip_ds6_nbr *uip_ds6_route_nexthop_nbr(uip_ds6_route_t *);
 int uip_ds6_route_num_routes(void);
 uip_ds6_route_t *uip_ds6_route_head(void);
 uip_ds6_route_t *uip_ds6_route_next(uip_ds6_route_t *);
@@ -74,6 +74,12 @@
 #include "net/ipv6/uip-ds6.h"
 #include "net/ip/uip-nameserver.h"
 #include "lib/random.h"
+#if UIP_ND6_RA_6CO || SICSLOWPAN_GHC
+#include "net/ipv6/sicslowpan.h"
+#endif /* UIP_ND6_RA_6CO || SICSLOWPAN_GHC */
+#if SICSLOWPAN_GHC
+#include "net/packetbuf.h"
+#endif /* SICSLOWPAN_GHC */
 
 /*------------------------------------------------------------------*/
 #define DEBUG 0
@@ -114,6 +120,8 @@ void uip_log(char *msg);
 #define UIP_ND6_OPT_PREFIX_BUF ((uip_nd6_opt_prefix_info *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_MTU_BUF ((uip_nd6_opt_mtu *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_RDNSS_BUF ((uip_nd6_opt_dns *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
+#define UIP_ND6_OPT_6CO_BUF ((uip_nd6_opt_6co *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
+#define UIP_ND6_OPT_6CIO_BUF ((uip_nd6_opt_6cio *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 /** @} */
 
 #if UIP_ND6_SEND_NA || UIP_ND6_SEND_RA || !UIP_CONF_ROUTER
@@ -142,6 +150,41 @@ create_llao(uint8_t *llao, uint8_t type) {
          UIP_ND6_OPT_LLAO_LEN - 2 - UIP_LLADDR_LEN);
 }
 
+#if SICSLOWPAN_GHC
+/* Every LLAO we send is followed by a 6CIO announcing GHC */
+#define ND6_OPT_6CIO_LEN UIP_ND6_OPT_6CIO_LEN
+#else /* SICSLOWPAN_GHC */
+#define ND6_OPT_6CIO_LEN 0
+#endif /* SICSLOWPAN_GHC */
+
+/*------------------------------------------------------------------*/
+/* create a 6cio, if we have anything to announce */
+static void
+create_6cio(uint8_t *opt)
+{
+#if SICSLOWPAN_GHC
+  uip_nd6_opt_6cio *cio = (uip_nd6_opt_6cio *)opt;
+
+  cio->type = UIP_ND6_OPT_6CIO;
+  cio->len = UIP_ND6_OPT_6CIO_LEN >> 3;
+  cio->flags = UIP_HTONS(UIP_ND6_6CIO_FLAG_G);
+  cio->reserved = 0;
+#endif /* SICSLOWPAN_GHC */
+}
+
+#if SICSLOWPAN_GHC && (UIP_ND6_SEND_NA || UIP_ND6_SEND_RA || !UIP_CONF_ROUTER)
+/*------------------------------------------------------------------*/
+/* process a received 6cio */
+static void
+cio_input(void)
+{
+  if(uip_ntohs(UIP_ND6_OPT_6CIO_BUF->flags) & UIP_ND6_6CIO_FLAG_G) {
+    PRINTF("Processing 6CIO option, sender uncompresses GHC\n");
+    sicslowpan_ghc_add_neighbor((const linkaddr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  }
+}
+#endif /* SICSLOWPAN_GHC && (UIP_ND6_SEND_NA || UIP_ND6_SEND_RA || !UIP_CONF_ROUTER) */
+
 /*------------------------------------------------------------------*/
 
 #if UIP_ND6_SEND_NA
@@ -196,8 +239,12 @@ ns_input(void)
           uip_lladdr_t *lladdr = (uip_lladdr_t *)uip_ds6_nbr_get_ll(nbr);
           if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
 		    lladdr, UIP_LLADDR_LEN) != 0) {
-            memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-		   UIP_LLADDR_LEN);
+            if(nbr_table_update_lladdr((const linkaddr_t *)lladdr,
+                                       (const linkaddr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+                                       1) == 0) {
+              /* Failed to update the lladdr */
+              goto discard;
+            }
             nbr->state = NBR_STALE;
           } else {
             if(nbr->state == NBR_INCOMPLETE) {
@@ -209,6 +256,11 @@ ns_input(void)
       }
 #endif /*UIP_CONF_IPV6_CHECKS */
       break;
+#if SICSLOWPAN_GHC
+    case UIP_ND6_OPT_6CIO:
+      cio_input();
+      break;
+#endif /* SICSLOWPAN_GHC */
     default:
       PRINTF("ND option not supported in NS");
       break;
@@ -291,7 +343,8 @@ create_na:
   UIP_IP_BUF->tcflow = 0;
   UIP_IP_BUF->flow = 0;
   UIP_IP_BUF->len[0] = 0;       /* length will not be more than 255 */
-  UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN;
+  UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN +
+    ND6_OPT_6CIO_LEN;
   UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
   UIP_IP_BUF->ttl = UIP_ND6_HOP_LIMIT;
 
@@ -303,12 +356,15 @@ create_na:
 
   create_llao(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NA_LEN],
               UIP_ND6_OPT_TLLAO);
+  create_6cio(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NA_LEN +
+                       UIP_ND6_OPT_LLAO_LEN]);
 
   UIP_ICMP_BUF->icmpchksum = 0;
   UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
 
   uip_len =
-    UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN;
+    UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN +
+    ND6_OPT_6CIO_LEN;
 
   UIP_STAT(++uip_stat.nd6.sent);
   PRINTF("Sending NA to ");
@@ -364,13 +420,16 @@ uip_nd6_ns_output(uip_ipaddr_t * src, uip_ipaddr_t * dest, uip_ipaddr_t * tgt)
       return;
     }
     UIP_IP_BUF->len[1] =
-      UIP_ICMPH_LEN + UIP_ND6_NS_LEN + UIP_ND6_OPT_LLAO_LEN;
+      UIP_ICMPH_LEN + UIP_ND6_NS_LEN + UIP_ND6_OPT_LLAO_LEN + ND6_OPT_6CIO_LEN;
 
     create_llao(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NS_LEN],
 		UIP_ND6_OPT_SLLAO);
+    create_6cio(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NS_LEN +
+                         UIP_ND6_OPT_LLAO_LEN]);
 
     uip_len =
-      UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_NS_LEN + UIP_ND6_OPT_LLAO_LEN;
+      UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_NS_LEN + UIP_ND6_OPT_LLAO_LEN +
+      ND6_OPT_6CIO_LEN;
   } else {
     uip_create_unspecified(&UIP_IP_BUF->srcipaddr);
     UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_NS_LEN;
@@ -461,6 +520,11 @@ na_input(void)
     case UIP_ND6_OPT_TLLAO:
       nd6_opt_llao = (uint8_t *)UIP_ND6_OPT_HDR_BUF;
       break;
+#if SICSLOWPAN_GHC
+    case UIP_ND6_OPT_6CIO:
+      cio_input();
+      break;
+#endif /* SICSLOWPAN_GHC */
     default:
       PRINTF("ND option not supported in NA\n");
       break;
@@ -493,8 +557,12 @@ na_input(void)
       if(nd6_opt_llao == NULL) {
         goto discard;
       }
-      memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-	     UIP_LLADDR_LEN);
+      if(nbr_table_update_lladdr((const linkaddr_t *)lladdr,
+                                 (const linkaddr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+                                 1) == 0) {
+        /* Failed to update the lladdr */
+        goto discard;
+      }
       if(is_solicited) {
         nbr->state = NBR_REACHABLE;
         nbr->nscount = 0;
@@ -516,8 +584,12 @@ na_input(void)
         if(is_override || (!is_override && nd6_opt_llao != 0 && !is_llchange)
            || nd6_opt_llao == 0) {
           if(nd6_opt_llao != 0) {
-            memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-		   UIP_LLADDR_LEN);
+            if(nbr_table_update_lladdr((const linkaddr_t *)lladdr,
+                                       (const linkaddr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+                                       1) == 0) {
+              /* Failed to update the lladdr */
+              goto discard;
+            }
           }
           if(is_solicited) {
             nbr->state = NBR_REACHABLE;
@@ -605,6 +677,11 @@ rs_input(void)
     case UIP_ND6_OPT_SLLAO:
       nd6_opt_llao = (uint8_t *)UIP_ND6_OPT_HDR_BUF;
       break;
+#if SICSLOWPAN_GHC
+    case UIP_ND6_OPT_6CIO:
+      cio_input();
+      break;
+#endif /* SICSLOWPAN_GHC */
     default:
       PRINTF("ND option not supported in RS\n");
       break;
@@ -712,6 +789,10 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
   uip_len += UIP_ND6_OPT_LLAO_LEN;
   nd6_opt_offset += UIP_ND6_OPT_LLAO_LEN;
 
+  create_6cio((uint8_t *)UIP_ND6_OPT_HDR_BUF);
+  uip_len += ND6_OPT_6CIO_LEN;
+  nd6_opt_offset += ND6_OPT_6CIO_LEN;
+
   /* MTU */
   UIP_ND6_OPT_MTU_BUF->type = UIP_ND6_OPT_MTU;
   UIP_ND6_OPT_MTU_BUF->len = UIP_ND6_OPT_MTU_LEN >> 3;
@@ -782,12 +863,15 @@ uip_nd6_rs_output(void)
     UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_RS_LEN;
     uip_len = uip_l3_icmp_hdr_len + UIP_ND6_RS_LEN;
   } else {
-    uip_len = uip_l3_icmp_hdr_len + UIP_ND6_RS_LEN + UIP_ND6_OPT_LLAO_LEN;
+    uip_len = uip_l3_icmp_hdr_len + UIP_ND6_RS_LEN + UIP_ND6_OPT_LLAO_LEN +
+      ND6_OPT_6CIO_LEN;
     UIP_IP_BUF->len[1] =
-      UIP_ICMPH_LEN + UIP_ND6_RS_LEN + UIP_ND6_OPT_LLAO_LEN;
+      UIP_ICMPH_LEN + UIP_ND6_RS_LEN + UIP_ND6_OPT_LLAO_LEN + ND6_OPT_6CIO_LEN;
 
     create_llao(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_RS_LEN],
 		UIP_ND6_OPT_SLLAO);
+    create_6cio(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_RS_LEN +
+                         UIP_ND6_OPT_LLAO_LEN]);
   }
 
   UIP_ICMP_BUF->icmpchksum = 0;
@@ -869,8 +953,12 @@ ra_input(void)
         }
         if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
 		  lladdr, UIP_LLADDR_LEN) != 0) {
-          memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-		 UIP_LLADDR_LEN);
+          if(nbr_table_update_lladdr((const linkaddr_t *)lladdr,
+                                     (const linkaddr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+                                     1) == 0) {
+            /* Failed to update the lladdr */
+            goto discard;
+          }
           nbr->state = NBR_STALE;
         }
         nbr->isrouter = 1;
@@ -984,6 +1072,24 @@ ra_input(void)
       }
       break;
 #endif /* UIP_ND6_RA_RDNSS */
+#if UIP_ND6_RA_6CO
+    case UIP_ND6_OPT_6CO:
+      /* IPHC contexts always cover 64 bits */
+      if(UIP_ND6_OPT_6CO_BUF->context_len == 64) {
+        PRINTF("Processing 6CO option, context %u\n",
+               UIP_ND6_OPT_6CO_BUF->flags_cid & UIP_ND6_6CO_CID_MASK);
+        sicslowpan_context_set(UIP_ND6_OPT_6CO_BUF->flags_cid & UIP_ND6_6CO_CID_MASK,
+                               UIP_ND6_OPT_6CO_BUF->prefix,
+                               (UIP_ND6_OPT_6CO_BUF->flags_cid & UIP_ND6_6CO_FLAG_C) != 0,
+                               uip_ntohs(UIP_ND6_OPT_6CO_BUF->lifetime));
+      }
+      break;
+#endif /* UIP_ND6_RA_6CO */
+#if SICSLOWPAN_GHC
+    case UIP_ND6_OPT_6CIO:
+      cio_input();
+      break;
+#endif /* SICSLOWPAN_GHC */
     default:
       PRINTF("ND option not supported in RA");
       break;
@@ -155,6 +155,24 @@
 #endif
 /** @} */
 
+/** \name RFC 6775 6LoWPAN Context Option Constants  */
+/** @{ */
+/* Install the IPHC contexts advertised by routers (hosts only) */
+#ifndef UIP_CONF_ND6_RA_6CO
+#define UIP_ND6_RA_6CO                  0
+#else
+#define UIP_ND6_RA_6CO                  UIP_CONF_ND6_RA_6CO
+#endif
+#define UIP_ND6_6CO_FLAG_C              0x10
+#define UIP_ND6_6CO_CID_MASK            0x0f
+/** @} */
+
+/** \name RFC 7400 6LoWPAN Capability Indication Option Constants */
+/** @{ */
+/* G flag: the sender can uncompress 6LoWPAN-GHC */
+#define UIP_ND6_6CIO_FLAG_G             0x0001
+/** @} */
+
 
 /** \name ND6 option types */
 /** @{ */
@@ -165,6 +183,8 @@
 #define UIP_ND6_OPT_MTU                 5
 #define UIP_ND6_OPT_RDNSS               25
 #define UIP_ND6_OPT_DNSSL               31
+#define UIP_ND6_OPT_6CO                 34
+#define UIP_ND6_OPT_6CIO                36
 /** @} */
 
 /** \name ND6 option types */
@@ -189,6 +209,7 @@
 #define UIP_ND6_OPT_MTU_LEN            8
 #define UIP_ND6_OPT_RDNSS_LEN          1
 #define UIP_ND6_OPT_DNSSL_LEN          1
+#define UIP_ND6_OPT_6CIO_LEN           8
 
 
 /* Length of TLLAO and SLLAO options, it is L2 dependant */
@@ -320,6 +341,25 @@ typedef struct uip_nd6_opt_dns {
   uip_ipaddr_t ip;
 } uip_nd6_opt_dns;
 
+/** \brief ND option 6LoWPAN Context (RFC 6775) */
+typedef struct uip_nd6_opt_6co {
+  uint8_t type;
+  uint8_t len;
+  uint8_t context_len;
+  uint8_t flags_cid;
+  uint16_t reserved;
+  uint16_t lifetime;
+  uint8_t prefix[8];
+} uip_nd6_opt_6co;
+
+/** \brief ND option 6LoWPAN Capability Indication (RFC 7400) */
+typedef struct uip_nd6_opt_6cio {
+  uint8_t type;
+  uint8_t len;
+  uint16_t flags;
+  uint32_t reserved;
+} uip_nd6_opt_6cio;
+
 /** \struct Redirected header option */
 typedef struct uip_nd6_opt_redirected_hdr {
   uint8_t type;
@@ -43,6 +43,7 @@
 #include <string.h>
 
 #define CONTIKIMAC_ID 0x00
+#define CONTIKIMAC_ID_MASK 0x0f
 
 /* SHORTEST_PACKET_SIZE is the shortest packet that ContikiMAC
    allows. Packets have to be a certain size to be able to be detected
@@ -74,7 +75,8 @@ extern const struct framer DECORATED_FRAMER;
 #endif
 
 /* 2-byte header for recovering padded packets.
-   Wireshark will not understand such packets at present. */
+   Wireshark will not understand such packets at present.
+   The upper nibble of the id carries PACKETBUF_ATTR_WAKEUP_LEVEL. */
 struct hdr {
   uint8_t id;
   uint8_t len;
@@ -98,7 +100,8 @@ create(void)
     return FRAMER_FAILED;
   }
   chdr = packetbuf_hdrptr();
-  chdr->id = CONTIKIMAC_ID;
+  chdr->id = CONTIKIMAC_ID |
+    (packetbuf_attr(PACKETBUF_ATTR_WAKEUP_LEVEL) << 4);
   chdr->len = 0;
   
   hdr_len = DECORATED_FRAMER.create();
@@ -163,10 +166,11 @@ parse(void)
   }
   
   chdr = packetbuf_dataptr();
-  if(chdr->id != CONTIKIMAC_ID) {
+  if((chdr->id & CONTIKIMAC_ID_MASK) != CONTIKIMAC_ID) {
     PRINTF("contikimac-framer: CONTIKIMAC_ID is missing\n");
     return FRAMER_FAILED;
   }
+  packetbuf_set_attr(PACKETBUF_ATTR_WAKEUP_LEVEL, chdr->id >> 4);
   
   if(!packetbuf_hdrreduce(sizeof(struct hdr))) {
     PRINTF("contikimac-framer: packetbuf_hdrreduce failed\n");
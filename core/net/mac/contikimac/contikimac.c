@@ -47,6 +47,7 @@
 #include "net/mac/mac-sequence.h"
 #include "net/mac/contikimac/contikimac.h"
 #include "net/netstack.h"
+#include "net/netstats.h"
 #include "net/rime/rime.h"
 #include "sys/compower.h"
 #include "sys/pt.h"
@@ -101,12 +102,65 @@
 #define SYNC_CYCLE_STARTS                    1
 #endif
 
+/* With CONTIKIMAC_CONF_ADAPTIVE, the channel check interval follows
+   the load of the node. At level l the interval is MAX_CYCLE_TIME >> l,
+   level 1 being CYCLE_TIME. Nodes advertise their level in the header
+   of contikimac_framer, and senders strobe for the interval of the
+   receiver. Neighbors whose level is not known, and broadcasts, get a
+   strobe as long as the longest interval. */
+#ifdef CONTIKIMAC_CONF_ADAPTIVE
+#define CONTIKIMAC_ADAPTIVE CONTIKIMAC_CONF_ADAPTIVE
+#else
+#define CONTIKIMAC_ADAPTIVE 0
+#endif /* CONTIKIMAC_CONF_ADAPTIVE */
+
+#if CONTIKIMAC_ADAPTIVE
+/* The number of interval levels, 2 to 15. The level is sent in four
+   bits of the frame header. */
+#ifdef CONTIKIMAC_CONF_ADAPTIVE_LEVELS
+#define ADAPTIVE_LEVELS CONTIKIMAC_CONF_ADAPTIVE_LEVELS
+#else
+#define ADAPTIVE_LEVELS 4
+#endif /* CONTIKIMAC_CONF_ADAPTIVE_LEVELS */
+#if ADAPTIVE_LEVELS < 2 || ADAPTIVE_LEVELS > 15
+#error CONTIKIMAC_CONF_ADAPTIVE_LEVELS must be between 2 and 15
+#endif
+
+/* Seconds between two adjustments of the level */
+#ifdef CONTIKIMAC_CONF_ADAPTIVE_PERIOD
+#define ADAPTIVE_PERIOD CONTIKIMAC_CONF_ADAPTIVE_PERIOD
+#else
+#define ADAPTIVE_PERIOD 8
+#endif /* CONTIKIMAC_CONF_ADAPTIVE_PERIOD */
+
+/* Go one level faster when more than one in ADAPTIVE_BUSY_WAKEUPS
+   wake-ups receives a frame, or when half of the queue buffers are in
+   use. Go one level slower when fewer than one in ADAPTIVE_IDLE_WAKEUPS
+   does and no packets are queued. */
+#define ADAPTIVE_BUSY_WAKEUPS 4
+#define ADAPTIVE_IDLE_WAKEUPS 32
+
+#define MAX_CYCLE_TIME (CYCLE_TIME << 1)
+#define MIN_CYCLE_TIME (MAX_CYCLE_TIME >> (ADAPTIVE_LEVELS - 1))
+#if MIN_CYCLE_TIME == 0
+#error CONTIKIMAC_CONF_ADAPTIVE_LEVELS is too high for the rtimer resolution
+#endif
+#define ADAPTIVE_PERIOD_SLOTS \
+  ((unsigned long)ADAPTIVE_PERIOD * RTIMER_ARCH_SECOND / MIN_CYCLE_TIME)
+
+#undef SYNC_CYCLE_STARTS
+#endif /* CONTIKIMAC_ADAPTIVE */
+
 /* Are we currently receiving a burst? */
 static int we_are_receiving_burst = 0;
 
 /* INTER_PACKET_DEADLINE is the maximum time a receiver waits for the
    next packet of a burst when FRAME_PENDING is set. */
+#ifdef CONTIKIMAC_CONF_INTER_PACKET_DEADLINE
+#define INTER_PACKET_DEADLINE               CONTIKIMAC_CONF_INTER_PACKET_DEADLINE
+#else
 #define INTER_PACKET_DEADLINE               CLOCK_SECOND / 32
+#endif
 
 /* ContikiMAC performs periodic channel checks. Each channel check
    consists of two or more CCA checks. CCA_COUNT_MAX is the number of
@@ -241,6 +295,20 @@ static struct compower_activity current_packet;
 
 #endif /* WITH_PHASE_OPTIMIZATION */
 
+#if CONTIKIMAC_ADAPTIVE
+#if !WITH_PHASE_OPTIMIZATION
+#error CONTIKIMAC_CONF_ADAPTIVE needs phase optimization to store neighbor intervals
+#endif
+#include "net/queuebuf.h"
+
+static volatile uint8_t wakeup_level = 1;
+static volatile rtimer_clock_t cycle_time = CYCLE_TIME;
+static uint16_t adapt_slots, adapt_wakeups, adapt_rx;
+#define CURRENT_CYCLE_TIME cycle_time
+#else /* CONTIKIMAC_ADAPTIVE */
+#define CURRENT_CYCLE_TIME CYCLE_TIME
+#endif /* CONTIKIMAC_ADAPTIVE */
+
 #define DEFAULT_STREAM_TIME (4 * CYCLE_TIME)
 
 #if CONTIKIMAC_CONF_BROADCAST_RATE_LIMIT
@@ -308,6 +376,56 @@ schedule_powercycle_fixed(struct rtimer *t, rtimer_clock_t fixed_time)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if CONTIKIMAC_ADAPTIVE
+/* Called at the start of every cycle to adjust the interval. */
+static void
+adapt_cycle_time(void)
+{
+  uint8_t level;
+  int queued;
+
+  adapt_wakeups++;
+  adapt_slots += cycle_time / MIN_CYCLE_TIME;
+  if(adapt_slots < ADAPTIVE_PERIOD_SLOTS) {
+    return;
+  }
+
+  level = wakeup_level;
+  queued = QUEUEBUF_NUM - queuebuf_numfree();
+  if((uint32_t)adapt_rx * ADAPTIVE_BUSY_WAKEUPS > adapt_wakeups ||
+     queued >= QUEUEBUF_NUM / 2) {
+    if(level < ADAPTIVE_LEVELS - 1) {
+      level++;
+    }
+  } else if((uint32_t)adapt_rx * ADAPTIVE_IDLE_WAKEUPS < adapt_wakeups &&
+            queued == 0) {
+    if(level > 0) {
+      level--;
+    }
+  }
+  if(level != wakeup_level) {
+    PRINTF("contikimac: %u frames in %u wake-ups, level %u -> %u\n",
+           adapt_rx, adapt_wakeups, wakeup_level, level);
+    wakeup_level = level;
+    cycle_time = MAX_CYCLE_TIME >> level;
+  }
+  adapt_slots = adapt_wakeups = adapt_rx = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* The channel check interval of a neighbor. */
+static rtimer_clock_t
+neighbor_cycle_time(const linkaddr_t *neighbor)
+{
+  int level;
+
+  level = neighbor != NULL ? phase_get_wakeup(neighbor) : -1;
+  if(level < 0 || level >= ADAPTIVE_LEVELS) {
+    return MAX_CYCLE_TIME;
+  }
+  return MAX_CYCLE_TIME >> level;
+}
+#endif /* CONTIKIMAC_ADAPTIVE */
+/*---------------------------------------------------------------------------*/
 static void
 powercycle_turn_radio_off(void)
 {
@@ -368,8 +486,11 @@ powercycle(struct rtimer *t, void *ptr)
 #endif
     }
 #else
-    cycle_start += CYCLE_TIME;
+    cycle_start += CURRENT_CYCLE_TIME;
 #endif
+#if CONTIKIMAC_ADAPTIVE
+    adapt_cycle_time();
+#endif /* CONTIKIMAC_ADAPTIVE */
 
     packet_seen = 0;
 
@@ -451,7 +572,7 @@ powercycle(struct rtimer *t, void *ptr)
       }
     }
 
-    if(RTIMER_CLOCK_LT(RTIMER_NOW() - cycle_start, CYCLE_TIME - CHECK_TIME * 4)) {
+    if(RTIMER_CLOCK_LT(RTIMER_NOW() - cycle_start, CURRENT_CYCLE_TIME - CHECK_TIME * 4)) {
       /* Schedule the next powercycle interrupt, or sleep the mcu
 	 until then.  Sleeping will not exit from this interrupt, so
 	 ensure an occasional wake cycle or foreground processing will
@@ -459,14 +580,14 @@ powercycle(struct rtimer *t, void *ptr)
 #if RDC_CONF_MCU_SLEEP
       static uint8_t sleepcycle;
       if((sleepcycle++ < 16) && !we_are_sending && !radio_is_on) {
-        rtimer_arch_sleep(CYCLE_TIME - (RTIMER_NOW() - cycle_start));
+        rtimer_arch_sleep(CURRENT_CYCLE_TIME - (RTIMER_NOW() - cycle_start));
       } else {
         sleepcycle = 0;
-        schedule_powercycle_fixed(t, CYCLE_TIME + cycle_start);
+        schedule_powercycle_fixed(t, CURRENT_CYCLE_TIME + cycle_start);
         PT_YIELD(&pt);
       }
 #else
-      schedule_powercycle_fixed(t, CYCLE_TIME + cycle_start);
+      schedule_powercycle_fixed(t, CURRENT_CYCLE_TIME + cycle_start);
       PT_YIELD(&pt);
 #endif
     }
@@ -515,6 +636,8 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   int ret;
   uint8_t contikimac_was_on;
   uint8_t seqno;
+  rtimer_clock_t strobe_time;
+  rtimer_clock_t receiver_cycle_time;
   
   /* Exit if RDC and radio were explicitly turned off */
    if(!contikimac_is_on && !contikimac_keep_radio_on) {
@@ -558,6 +681,9 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
 
   if(!packetbuf_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED)) {
     packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+#if CONTIKIMAC_ADAPTIVE
+    packetbuf_set_attr(PACKETBUF_ATTR_WAKEUP_LEVEL, wakeup_level + 1);
+#endif /* CONTIKIMAC_ADAPTIVE */
     if(NETSTACK_FRAMER.create_and_secure() < 0) {
       PRINTF("contikimac: framer failed\n");
       return MAC_TX_ERR_FATAL;
@@ -566,11 +692,19 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   
   transmit_len = packetbuf_totlen();
   NETSTACK_RADIO.prepare(packetbuf_hdrptr(), transmit_len);
+
+#if CONTIKIMAC_ADAPTIVE
+  receiver_cycle_time = neighbor_cycle_time(is_broadcast ? NULL :
+                                            packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+#else /* CONTIKIMAC_ADAPTIVE */
+  receiver_cycle_time = CYCLE_TIME;
+#endif /* CONTIKIMAC_ADAPTIVE */
+  strobe_time = receiver_cycle_time + 2 * CHECK_TIME;
   
   if(!is_broadcast && !is_receiver_awake) {
 #if WITH_PHASE_OPTIMIZATION
     ret = phase_wait(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
-                     CYCLE_TIME, GUARD_TIME,
+                     receiver_cycle_time, GUARD_TIME,
                      mac_callback, mac_callback_ptr, buf_list);
     if(ret == PHASE_DEFERRED) {
       return MAC_TX_DEFERRED;
@@ -662,7 +796,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   seqno = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
   for(strobes = 0, collisions = 0;
       got_strobe_ack == 0 && collisions == 0 &&
-      RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + STROBE_TIME); strobes++) {
+      RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + strobe_time); strobes++) {
 
     watchdog_periodic();
 
@@ -790,6 +924,7 @@ qsend_packet(mac_callback_t sent, void *ptr)
 {
   int ret = send_packet(sent, ptr, NULL, 0);
   if(ret != MAC_TX_DEFERRED) {
+    NETSTATS_RDC_TX(ret);
 	  PRINTF("qsend_packet");
     mac_call_sent_callback(sent, ptr, ret, 1);
   }
@@ -827,6 +962,9 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
         packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 1);
       }
       packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+#if CONTIKIMAC_ADAPTIVE
+      packetbuf_set_attr(PACKETBUF_ATTR_WAKEUP_LEVEL, wakeup_level + 1);
+#endif /* CONTIKIMAC_ADAPTIVE */
       if(NETSTACK_FRAMER.create_and_secure() < 0) {
         PRINTF("contikimac: framer failed\n");
         mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
@@ -851,6 +989,10 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
     /* Send the current packet */
     ret = send_packet(sent, ptr, curr, is_receiver_awake);
     if(ret != MAC_TX_DEFERRED) {
+      NETSTATS_RDC_TX(ret);
+      if(is_receiver_awake && ret == MAC_TX_OK) {
+        NETSTATS_ADD(rdc_tx_burst);
+      }
       mac_call_sent_callback(sent, ptr, ret, 1);
     }
 
@@ -904,6 +1046,13 @@ input_packet(void)
   /*  printf("cycle_start 0x%02x 0x%02x\n", cycle_start, cycle_start % CYCLE_TIME);*/
 
   if(packetbuf_totlen() > 0 && NETSTACK_FRAMER.parse() >= 0) {
+#if CONTIKIMAC_ADAPTIVE
+    /* Learn the interval of every neighbor we hear. */
+    if(packetbuf_attr(PACKETBUF_ATTR_WAKEUP_LEVEL) != 0) {
+      phase_set_wakeup(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                       packetbuf_attr(PACKETBUF_ATTR_WAKEUP_LEVEL) - 1);
+    }
+#endif /* CONTIKIMAC_ADAPTIVE */
     if(packetbuf_datalen() > 0 &&
        packetbuf_totlen() > 0 &&
        (linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
@@ -974,6 +1123,10 @@ input_packet(void)
 #endif /* CONTIKIMAC_SEND_SW_ACK */
 
       if(!duplicate) {
+#if CONTIKIMAC_ADAPTIVE
+        adapt_rx++;
+#endif /* CONTIKIMAC_ADAPTIVE */
+        NETSTATS_ADD(rdc_rx);
         NETSTACK_MAC.input();
       }
       return;
@@ -1031,7 +1184,7 @@ turn_off(int keep_radio_on)
 static unsigned short
 duty_cycle(void)
 {
-  return (1ul * CLOCK_SECOND * CYCLE_TIME) / RTIMER_ARCH_SECOND;
+  return (1ul * CLOCK_SECOND * CURRENT_CYCLE_TIME) / RTIMER_ARCH_SECOND;
 }
 /*---------------------------------------------------------------------------*/
 const struct rdc_driver contikimac_driver = {
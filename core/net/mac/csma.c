@@ -47,6 +47,8 @@
 #include "lib/random.h"
 
 #include "net/netstack.h"
+#include "net/netstats.h"
+#include "sys/rtimer.h"
 
 #include "lib/list.h"
 #include "lib/memb.h"
@@ -84,11 +86,66 @@
 #error Change CSMA_CONF_MAX_MAC_TRANSMISSIONS in contiki-conf.h or in your Makefile.
 #endif /* CSMA_CONF_MAX_MAC_TRANSMISSIONS < 1 */
 
+/*
+ * With CSMA_CONF_FAIR_QUEUEING, only one neighbor queue transmits at
+ * a time. Control traffic (PACKETBUF_ATTR_TRAFFIC_CLASS) goes first,
+ * data is served with deficit round-robin across the neighbor queues.
+ * Data packets may not use the last CSMA_CONTROL_RESERVE queue
+ * slots and are limited to CSMA_MAX_DATA_PER_NEIGHBOR per neighbor.
+ * The fragments of a datagram (PACKETBUF_ATTR_FRAGMENTS) are admitted
+ * together: the first one only if there is room for all of them.
+ */
+#ifdef CSMA_CONF_FAIR_QUEUEING
+#define CSMA_FAIR_QUEUEING CSMA_CONF_FAIR_QUEUEING
+#else
+#define CSMA_FAIR_QUEUEING 0
+#endif /* CSMA_CONF_FAIR_QUEUEING */
+
+/* Bytes added to a neighbor's deficit counter on each round */
+#ifdef CSMA_CONF_DRR_QUANTUM
+#define CSMA_DRR_QUANTUM CSMA_CONF_DRR_QUANTUM
+#else
+#define CSMA_DRR_QUANTUM PACKETBUF_SIZE
+#endif /* CSMA_CONF_DRR_QUANTUM */
+
+/* Queue slots only control packets may use */
+#ifdef CSMA_CONF_CONTROL_RESERVE
+#define CSMA_CONTROL_RESERVE CSMA_CONF_CONTROL_RESERVE
+#else
+#define CSMA_CONTROL_RESERVE 2
+#endif /* CSMA_CONF_CONTROL_RESERVE */
+
+/*
+ * With CSMA_CONF_BURST, packets queued for one neighbor are sent back
+ * to back. After a successful transmission the rest of the queue goes
+ * to the RDC layer at once instead of after a channel check interval,
+ * so that ContikiMAC can send it while the receiver is still awake.
+ * With fair queueing, up to CSMA_BURST_MAX packets of a queue are
+ * handed to the RDC layer together, which keeps the fragments of a
+ * datagram in one burst. Packets after the first are charged to the
+ * deficit of the queue when they are sent.
+ */
+#ifdef CSMA_CONF_BURST
+#define CSMA_BURST CSMA_CONF_BURST
+#else
+#define CSMA_BURST 0
+#endif /* CSMA_CONF_BURST */
+
+#ifdef CSMA_CONF_BURST_MAX
+#define CSMA_BURST_MAX CSMA_CONF_BURST_MAX
+#else
+#define CSMA_BURST_MAX MAX_QUEUED_PACKETS
+#endif /* CSMA_CONF_BURST_MAX */
+
 /* Packet metadata */
 struct qbuf_metadata {
   mac_callback_t sent;
   void *cptr;
   uint8_t max_transmissions;
+  uint8_t traffic_class;
+#if NETSTATS_ENABLED
+  rtimer_clock_t enqueued;
+#endif /* NETSTATS_ENABLED */
 };
 
 /* Every neighbor has its own packet queue */
@@ -98,6 +155,11 @@ struct neighbor_queue {
   struct ctimer transmit_timer;
   uint8_t transmissions;
   uint8_t collisions, deferrals;
+#if CSMA_FAIR_QUEUEING
+  int16_t deficit;
+  uint8_t data_packets;
+  uint8_t ready;
+#endif /* CSMA_FAIR_QUEUEING */
   LIST_STRUCT(queued_packet_list);
 };
 
@@ -116,13 +178,36 @@ struct neighbor_queue {
 #endif /* CSMA_CONF_MAX_PACKET_PER_NEIGHBOR */
 
 #define MAX_QUEUED_PACKETS QUEUEBUF_NUM
+
+#if CSMA_FAIR_QUEUEING
+/* The maximum number of data packets queued for one neighbor. By
+   default a neighbor may use every slot that is not reserved, so that
+   a datagram can be sent in as many fragments as fit in the queue. */
+#ifdef CSMA_CONF_MAX_DATA_PER_NEIGHBOR
+#define CSMA_MAX_DATA_PER_NEIGHBOR CSMA_CONF_MAX_DATA_PER_NEIGHBOR
+#elif CSMA_MAX_PACKET_PER_NEIGHBOR - CSMA_CONTROL_RESERVE >= 1
+#define CSMA_MAX_DATA_PER_NEIGHBOR (CSMA_MAX_PACKET_PER_NEIGHBOR - CSMA_CONTROL_RESERVE)
+#else
+#define CSMA_MAX_DATA_PER_NEIGHBOR 1
+#endif /* CSMA_CONF_MAX_DATA_PER_NEIGHBOR */
+#endif /* CSMA_FAIR_QUEUEING */
+
 MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
 MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
 MEMB(metadata_memb, struct qbuf_metadata, MAX_QUEUED_PACKETS);
 LIST(neighbor_list);
 
+uint16_t csma_dropped[PACKETBUF_NUM_TRAFFIC_CLASSES];
+
 static void packet_sent(void *ptr, int status, int num_transmissions);
+#if CSMA_FAIR_QUEUEING
+static void neighbor_ready(void *ptr);
+static void request_schedule(void);
+#define TRANSMIT_CALLBACK neighbor_ready
+#else /* CSMA_FAIR_QUEUEING */
 static void transmit_packet_list(void *ptr);
+#define TRANSMIT_CALLBACK transmit_packet_list
+#endif /* CSMA_FAIR_QUEUEING */
 
 /*---------------------------------------------------------------------------*/
 /*static struct csma_statistics *
@@ -161,6 +246,7 @@ default_timebase(void)
   return time;
 }
 /*---------------------------------------------------------------------------*/
+#if !CSMA_FAIR_QUEUEING
 static void
 transmit_packet_list(void *ptr)
 {
@@ -175,14 +261,199 @@ transmit_packet_list(void *ptr)
     }
   }
 }
+#endif /* !CSMA_FAIR_QUEUEING */
+/*---------------------------------------------------------------------------*/
+#if CSMA_FAIR_QUEUEING
+/* The neighbor queue whose packet is with the RDC layer */
+static struct neighbor_queue *in_flight;
+/* The neighbor queue whose deficit round-robin turn it is */
+static struct neighbor_queue *drr_current;
+static uint8_t drr_turn_started;
+static struct ctimer schedule_timer;
+#if CSMA_BURST
+#define IN_FLIGHT_MAX CSMA_BURST_MAX
+/* The neighbor queue of the last burst, and the number of its
+   packets reported by the RDC layer so far */
+static struct neighbor_queue *burst_queue;
+static uint8_t burst_sent;
+#else /* CSMA_BURST */
+#define IN_FLIGHT_MAX 1
+#endif /* CSMA_BURST */
+/* Copies of the packets handed to the RDC layer */
+static struct rdc_buf_list in_flight_packets[IN_FLIGHT_MAX];
+/*---------------------------------------------------------------------------*/
+static int
+is_control(struct rdc_buf_list *q)
+{
+  return ((struct qbuf_metadata *)q->ptr)->traffic_class ==
+    PACKETBUF_ATTR_TRAFFIC_CLASS_CONTROL;
+}
+/*---------------------------------------------------------------------------*/
+static struct neighbor_queue *
+next_queue(struct neighbor_queue *n)
+{
+  struct neighbor_queue *next = list_item_next(n);
+  return next != NULL ? next : list_head(neighbor_list);
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_transmission(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *q;
+  int i;
+
+  in_flight = n;
+  n->ready = 0;
+  /* Pass copies of at most IN_FLIGHT_MAX packets, so that the RDC
+     layer does not send the rest of the queue as a burst outside the
+     neighbor's turn. */
+  q = list_head(n->queued_packet_list);
+  for(i = 0; q != NULL && i < IN_FLIGHT_MAX; i++) {
+    in_flight_packets[i] = *q;
+    in_flight_packets[i].next = NULL;
+    if(i > 0) {
+      in_flight_packets[i - 1].next = &in_flight_packets[i];
+    }
+    q = list_item_next(q);
+  }
+#if CSMA_BURST
+  burst_queue = n;
+  burst_sent = 0;
+#endif /* CSMA_BURST */
+  NETSTACK_RDC.send_list(packet_sent, n, in_flight_packets);
+}
+#if CSMA_BURST
+/*---------------------------------------------------------------------------*/
+/* Charge the deficit for the packets of a burst that follow its
+   first packet, which schedule() has already paid for. */
+static void
+charge_burst(struct neighbor_queue *n, struct rdc_buf_list *q, int status)
+{
+  if(n != burst_queue) {
+    return;
+  }
+  if(burst_sent++ > 0 && status == MAC_TX_OK && !is_control(q)) {
+    n->deficit -= queuebuf_datalen(q->buf);
+  }
+}
+#endif /* CSMA_BURST */
 /*---------------------------------------------------------------------------*/
 static void
-free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
+schedule(void *ptr)
+{
+  struct neighbor_queue *n;
+  struct rdc_buf_list *q;
+  int len, skipped;
+
+  if(in_flight != NULL) {
+    return;
+  }
+
+  /* Control packets at the head of a queue go first */
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    q = list_head(n->queued_packet_list);
+    if(n->ready && q != NULL && is_control(q)) {
+      start_transmission(n);
+      return;
+    }
+  }
+
+  /* Deficit round-robin over the neighbor queues. A queue that is
+     backing off gives up its turn but keeps its deficit. */
+  n = drr_current != NULL ? drr_current : list_head(neighbor_list);
+  skipped = 0;
+  while(n != NULL && skipped <= list_length(neighbor_list)) {
+    q = list_head(n->queued_packet_list);
+    if(!n->ready || q == NULL) {
+      n = next_queue(n);
+      drr_turn_started = 0;
+      skipped++;
+      continue;
+    }
+    skipped = 0;
+    if(!drr_turn_started) {
+      n->deficit += CSMA_DRR_QUANTUM;
+      drr_turn_started = 1;
+    }
+    len = queuebuf_datalen(q->buf);
+    if(len <= n->deficit) {
+      n->deficit -= len;
+      drr_current = n;
+      start_transmission(n);
+      return;
+    }
+    n = next_queue(n);
+    drr_turn_started = 0;
+  }
+  drr_current = n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+request_schedule(void)
+{
+  /* Never start a transmission from within an RDC callback */
+  ctimer_set(&schedule_timer, 0, schedule, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+neighbor_ready(void *ptr)
+{
+  struct neighbor_queue *n = ptr;
+  n->ready = 1;
+  request_schedule();
+}
+/*---------------------------------------------------------------------------*/
+static int
+admit(struct neighbor_queue *n, uint8_t traffic_class)
+{
+  int frames;
+
+  if(traffic_class == PACKETBUF_ATTR_TRAFFIC_CLASS_CONTROL) {
+    return 1;
+  }
+  /* Make room for the rest of the datagram too. Its fragments follow
+     right away, so they find the room left for them. */
+  frames = packetbuf_attr(PACKETBUF_ATTR_FRAGMENTS);
+  if(frames < 1) {
+    frames = 1;
+  }
+  return n->data_packets + frames <= CSMA_MAX_DATA_PER_NEIGHBOR &&
+    list_length(n->queued_packet_list) + frames <= CSMA_MAX_PACKET_PER_NEIGHBOR &&
+    memb_numfree(&packet_memb) >= CSMA_CONTROL_RESERVE + frames &&
+    queuebuf_numfree() >= CSMA_CONTROL_RESERVE + frames;
+}
+/*---------------------------------------------------------------------------*/
+static void
+enqueue(struct neighbor_queue *n, struct rdc_buf_list *q)
+{
+  struct rdc_buf_list *prev;
+
+  /* Control packets overtake queued data, but never the head packet,
+     which may already be in the hands of the RDC layer. */
+  prev = list_head(n->queued_packet_list);
+  if(prev == NULL || !is_control(q)) {
+    list_add(n->queued_packet_list, q);
+    return;
+  }
+  while(list_item_next(prev) != NULL && is_control(list_item_next(prev))) {
+    prev = list_item_next(prev);
+  }
+  list_insert(n->queued_packet_list, prev, q);
+}
+#endif /* CSMA_FAIR_QUEUEING */
+/*---------------------------------------------------------------------------*/
+static void
+free_packet(struct neighbor_queue *n, struct rdc_buf_list *p, int status)
 {
   if(p != NULL) {
     /* Remove packet from list and deallocate */
     list_remove(n->queued_packet_list, p);
 
+#if CSMA_FAIR_QUEUEING
+    if(!is_control(p)) {
+      n->data_packets--;
+    }
+#endif /* CSMA_FAIR_QUEUEING */
     queuebuf_free(p->buf);
     memb_free(&metadata_memb, p->ptr);
     memb_free(&packet_memb, p);
@@ -193,12 +464,40 @@ free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
+#if CSMA_FAIR_QUEUEING
+      if(status == MAC_TX_OK) {
+        /* Keep the queue eligible, packet_sent() reschedules */
+        ctimer_stop(&n->transmit_timer);
+        n->ready = 1;
+        return;
+      }
+#elif CSMA_BURST
+      if(status == MAC_TX_OK) {
+        /* Continue with the next packet while the receiver is awake */
+        ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
+        return;
+      }
+#endif /* CSMA_FAIR_QUEUEING */
       /* Set a timer for next transmissions */
       ctimer_set(&n->transmit_timer, default_timebase(),
-                 transmit_packet_list, n);
+                 TRANSMIT_CALLBACK, n);
     } else {
       /* This was the last packet in the queue, we free the neighbor */
       ctimer_stop(&n->transmit_timer);
+#if CSMA_FAIR_QUEUEING
+      if(drr_current == n) {
+        drr_current = list_item_next(n);
+        drr_turn_started = 0;
+      }
+      if(in_flight == n) {
+        in_flight = NULL;
+      }
+#if CSMA_BURST
+      if(burst_queue == n) {
+        burst_queue = NULL;
+      }
+#endif /* CSMA_BURST */
+#endif /* CSMA_FAIR_QUEUEING */
       list_remove(neighbor_list, n);
       memb_free(&neighbor_memb, n);
     }
@@ -222,6 +521,12 @@ packet_sent(void *ptr, int status, int num_transmissions)
   if(n == NULL) {
     return;
   }
+#if CSMA_FAIR_QUEUEING
+  if(in_flight == n) {
+    in_flight = NULL;
+  }
+  request_schedule();
+#endif /* CSMA_FAIR_QUEUEING */
   switch(status) {
   case MAC_TX_OK:
   case MAC_TX_NOACK:
@@ -246,6 +551,9 @@ packet_sent(void *ptr, int status, int num_transmissions)
 
   if(q != NULL) {
     metadata = (struct qbuf_metadata *)q->ptr;
+#if CSMA_FAIR_QUEUEING && CSMA_BURST
+    charge_burst(n, q, status);
+#endif /* CSMA_FAIR_QUEUEING && CSMA_BURST */
 
     if(metadata != NULL) {
       sent = metadata->sent;
@@ -291,24 +599,37 @@ packet_sent(void *ptr, int status, int num_transmissions)
 
         if(n->transmissions < metadata->max_transmissions) {
           PRINTF("csma: retransmitting with time %lu %p\n", time, q);
+          NETSTATS_ADD(mac_retx);
+#if CSMA_FAIR_QUEUEING
+          /* An earlier packet of a burst may have made the queue
+             eligible again, back off anyway */
+          n->ready = 0;
+#endif /* CSMA_FAIR_QUEUEING */
           ctimer_set(&n->transmit_timer, time,
-                     transmit_packet_list, n);
+                     TRANSMIT_CALLBACK, n);
           /* This is needed to correctly attribute energy that we spent
              transmitting this packet. */
           queuebuf_update_attr_from_packetbuf(q->buf);
         } else {
           PRINTF("csma: drop with status %d after %d transmissions, %d collisions\n",
                  status, n->transmissions, n->collisions);
-          free_packet(n, q);
+          NETSTATS_ADD(mac_tx_fail);
+          csma_dropped[metadata->traffic_class]++;
+          free_packet(n, q, status);
           mac_call_sent_callback(sent, cptr, status, num_tx);
         }
       } else {
         if(status == MAC_TX_OK) {
           PRINTF("csma: rexmit ok %d\n", n->transmissions);
+          NETSTATS_ADD(mac_tx_ok);
+          NETSTATS_HIST(mac_latency,
+                        (rtimer_clock_t)(RTIMER_NOW() - metadata->enqueued));
         } else {
           PRINTF("csma: rexmit failed %d: %d\n", n->transmissions, status);
+          NETSTATS_ADD(mac_tx_fail);
+          csma_dropped[metadata->traffic_class]++;
         }
-        free_packet(n, q);
+        free_packet(n, q, status);
         mac_call_sent_callback(sent, cptr, status, num_tx);
       }
     } else {
@@ -327,6 +648,14 @@ send_packet(mac_callback_t sent, void *ptr)
   static uint8_t initialized = 0;
   static uint16_t seqno;
   const linkaddr_t *addr = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  uint8_t traffic_class = packetbuf_attr(PACKETBUF_ATTR_TRAFFIC_CLASS);
+
+#if PACKETBUF_WITH_PACKET_TYPE
+  if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
+     PACKETBUF_ATTR_PACKET_TYPE_ACK) {
+    traffic_class = PACKETBUF_ATTR_TRAFFIC_CLASS_CONTROL;
+  }
+#endif
 
   if(!initialized) {
     initialized = 1;
@@ -352,6 +681,11 @@ send_packet(mac_callback_t sent, void *ptr)
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
+#if CSMA_FAIR_QUEUEING
+      n->deficit = 0;
+      n->data_packets = 0;
+      n->ready = 1;
+#endif /* CSMA_FAIR_QUEUEING */
       /* Init packet list for this neighbor */
       LIST_STRUCT_INIT(n, queued_packet_list);
       /* Add neighbor to the list */
@@ -361,7 +695,11 @@ send_packet(mac_callback_t sent, void *ptr)
 
   if(n != NULL) {
     /* Add packet to the neighbor's queue */
-    if(list_length(n->queued_packet_list) < CSMA_MAX_PACKET_PER_NEIGHBOR) {
+    if(list_length(n->queued_packet_list) < CSMA_MAX_PACKET_PER_NEIGHBOR
+#if CSMA_FAIR_QUEUEING
+       && admit(n, traffic_class)
+#endif /* CSMA_FAIR_QUEUEING */
+       ) {
       q = memb_alloc(&packet_memb);
       if(q != NULL) {
         q->ptr = memb_alloc(&metadata_memb);
@@ -379,6 +717,16 @@ send_packet(mac_callback_t sent, void *ptr)
             }
             metadata->sent = sent;
             metadata->cptr = ptr;
+            metadata->traffic_class = traffic_class;
+#if NETSTATS_ENABLED
+            metadata->enqueued = RTIMER_NOW();
+#endif /* NETSTATS_ENABLED */
+#if CSMA_FAIR_QUEUEING
+            if(traffic_class != PACKETBUF_ATTR_TRAFFIC_CLASS_CONTROL) {
+              n->data_packets++;
+            }
+            enqueue(n, q);
+#else /* CSMA_FAIR_QUEUEING */
 #if PACKETBUF_WITH_PACKET_TYPE
             if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
                PACKETBUF_ATTR_PACKET_TYPE_ACK) {
@@ -388,13 +736,20 @@ send_packet(mac_callback_t sent, void *ptr)
             {
               list_add(n->queued_packet_list, q);
             }
+#endif /* CSMA_FAIR_QUEUEING */
 
             PRINTF("csma: send_packet, queue length %d, free packets %d\n",
                    list_length(n->queued_packet_list), memb_numfree(&packet_memb));
+            NETSTATS_ADD(mac_enqueue);
+            NETSTATS_HIST(mac_queue, list_length(n->queued_packet_list));
+#if CSMA_FAIR_QUEUEING
+            request_schedule();
+#else /* CSMA_FAIR_QUEUEING */
             /* If q is the first packet in the neighbor's queue, send asap */
             if(list_head(n->queued_packet_list) == q) {
               ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
             }
+#endif /* CSMA_FAIR_QUEUEING */
             return;
           }
           memb_free(&metadata_memb, q->ptr);
@@ -415,6 +770,8 @@ send_packet(mac_callback_t sent, void *ptr)
   } else {
     PRINTF("csma: could not allocate neighbor, dropping packet\n");
   }
+  NETSTATS_ADD(mac_queue_full);
+  csma_dropped[traffic_class]++;
   mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
 }
 /*---------------------------------------------------------------------------*/
@@ -445,9 +802,17 @@ channel_check_interval(void)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+int
+csma_queue_length(const linkaddr_t *addr)
+{
+  struct neighbor_queue *n = neighbor_queue_from_addr(addr);
+  return n != NULL ? list_length(n->queued_packet_list) : 0;
+}
+/*---------------------------------------------------------------------------*/
 static void
 init(void)
 {
+  memset(csma_dropped, 0, sizeof(csma_dropped));
   memb_init(&packet_memb);
   memb_init(&metadata_memb);
   memb_init(&neighbor_memb);
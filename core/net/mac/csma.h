@@ -41,11 +41,18 @@
 #ifndef CSMA_H_
 #define CSMA_H_
 
+#include "net/linkaddr.h"
 #include "net/mac/mac.h"
 #include "dev/radio.h"
 
 extern const struct mac_driver csma_driver;
 
+/* Packets dropped by CSMA, indexed by PACKETBUF_ATTR_TRAFFIC_CLASS */
+extern uint16_t csma_dropped[];
+
+/* Number of packets queued for a neighbor */
+int csma_queue_length(const linkaddr_t *addr);
+
 const struct mac_driver *csma_init(const struct mac_driver *r);
 
 #endif /* CSMA_H_ */
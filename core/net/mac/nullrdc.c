@@ -43,6 +43,7 @@
 #include "net/packetbuf.h"
 #include "net/queuebuf.h"
 #include "net/netstack.h"
+#include "net/netstats.h"
 #include "net/rime/rimestats.h"
 #include <string.h>
 
@@ -231,6 +232,7 @@ send_one_packet(mac_callback_t sent, void *ptr)
   if(ret == MAC_TX_OK) {
     last_sent_ok = 1;
   }
+  NETSTATS_RDC_TX(ret);
   mac_call_sent_callback(sent, ptr, ret, 1);
   return last_sent_ok;
 }
@@ -324,6 +326,7 @@ packet_input(void)
     }
 #endif /* NULLRDC_SEND_ACK */
     if(!duplicate) {
+      NETSTATS_ADD(rdc_rx);
       NETSTACK_MAC.input();
     }
   }
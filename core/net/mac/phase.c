@@ -43,19 +43,55 @@
 #include "sys/ctimer.h"
 #include "net/queuebuf.h"
 #include "net/nbr-table.h"
+#include "net/netstats.h"
 
-#if PHASE_CONF_DRIFT_CORRECT
+/*
+ * With PHASE_CONF_DRIFT_CORRECT, the drift of each neighbor's clock
+ * is estimated with a least-squares line through the last
+ * PHASE_DRIFT_SAMPLES observed wake-ups, and phase_wait() shifts the
+ * last wake-up by the drift accumulated since. Observations further
+ * apart than PHASE_DRIFT_MAX_AGE restart the estimate.
+ */
+#ifdef PHASE_CONF_DRIFT_CORRECT
 #define PHASE_DRIFT_CORRECT PHASE_CONF_DRIFT_CORRECT
 #else
 #define PHASE_DRIFT_CORRECT 0
 #endif
 
+#if PHASE_DRIFT_CORRECT
+#ifdef PHASE_CONF_DRIFT_SAMPLES
+#define PHASE_DRIFT_SAMPLES PHASE_CONF_DRIFT_SAMPLES
+#else
+#define PHASE_DRIFT_SAMPLES 4
+#endif /* PHASE_CONF_DRIFT_SAMPLES */
+
+#ifdef PHASE_CONF_DRIFT_MAX_AGE
+#define PHASE_DRIFT_MAX_AGE PHASE_CONF_DRIFT_MAX_AGE
+#else
+#define PHASE_DRIFT_MAX_AGE (CLOCK_SECOND * 300)
+#endif /* PHASE_CONF_DRIFT_MAX_AGE */
+
+/* Fractional bits of the drift estimate */
+#define DRIFT_SHIFT 12
+
+struct phase_sample {
+  clock_time_t ctime;   /* clock_time() when observed, to count cycles */
+  rtimer_clock_t time;
+};
+#endif /* PHASE_DRIFT_CORRECT */
+
 struct phase {
   rtimer_clock_t time;
 #if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
+  struct phase_sample samples[PHASE_DRIFT_SAMPLES];
+  int32_t drift;               /* Ticks per cycle << DRIFT_SHIFT */
+  rtimer_clock_t drift_cycle;  /* Cycle time last waited for, or 0 */
+  uint8_t drift_fitted;        /* drift is up to date */
+  uint8_t nsamples, next_sample;
 #endif
   uint8_t noacks;
+  uint8_t locked;  /* time holds an observed wake-up */
+  uint8_t wakeup;  /* Advertised wake-up level + 1, or 0 if unknown */
   struct timer noacks_timer;
 };
 
@@ -87,6 +123,138 @@ NBR_TABLE(struct phase, nbr_phase);
 #define PRINTDEBUG(...)
 #endif
 /*---------------------------------------------------------------------------*/
+#if PHASE_DRIFT_CORRECT
+/* a - b for rtimer times less than half the rtimer range apart */
+static long
+rtimer_diff(rtimer_clock_t a, rtimer_clock_t b)
+{
+  if(RTIMER_CLOCK_LT(a, b)) {
+    return -(long)(rtimer_clock_t)(b - a);
+  }
+  return (rtimer_clock_t)(a - b);
+}
+/*---------------------------------------------------------------------------*/
+/* Ticks from sample s to time t, observed at clock time ct. The clock
+   time counts the rtimer wrap-arounds. */
+static unsigned long
+elapsed(const struct phase_sample *s, clock_time_t ct, rtimer_clock_t t)
+{
+  unsigned long coarse;
+
+  coarse = (unsigned long)(ct - s->ctime) * RTIMER_ARCH_SECOND / CLOCK_SECOND;
+  return coarse + rtimer_diff(t, s->time + (rtimer_clock_t)coarse);
+}
+/*---------------------------------------------------------------------------*/
+static struct phase_sample *
+sample(struct phase *e, int i)
+{
+  /* Sample 0 is the oldest */
+  if(e->nsamples == PHASE_DRIFT_SAMPLES) {
+    i += e->next_sample;
+  }
+  return &e->samples[i % PHASE_DRIFT_SAMPLES];
+}
+/*---------------------------------------------------------------------------*/
+/* Fit the wake-up offsets from a grid of cycle_time, in ticks, against
+   the number of cycles. The slope is the drift per cycle. */
+static void
+fit_drift(struct phase *e, rtimer_clock_t cycle_time)
+{
+  int64_t sx, sy, sxx, sxy, den;
+  unsigned long ticks;
+  long x, y;
+  int i, n;
+
+  e->drift = 0;
+  e->drift_cycle = cycle_time;
+  e->drift_fitted = 1;
+  n = e->nsamples;
+  if(n < 2) {
+    return;
+  }
+
+  sx = sy = sxx = sxy = 0;
+  ticks = 0;
+  for(i = 0; i < n; i++) {
+    if(i > 0) {
+      ticks += elapsed(sample(e, i - 1), sample(e, i)->ctime,
+                       sample(e, i)->time);
+    }
+    x = (ticks + cycle_time / 2) / cycle_time;
+    y = (long)(ticks - (unsigned long)x * cycle_time);
+    sx += x;
+    sy += y;
+    sxx += (int64_t)x * x;
+    sxy += (int64_t)x * y;
+  }
+  den = n * sxx - sx * sx;
+  if(den != 0) {
+    e->drift = (int32_t)((n * sxy - sx * sy) * (1 << DRIFT_SHIFT) / den);
+  }
+  PRINTF("phase: drift %ld/%u ticks per cycle from %d wake-ups\n",
+         (long)e->drift, 1 << DRIFT_SHIFT, n);
+}
+/*---------------------------------------------------------------------------*/
+/* The drift accumulated between the last wake-up and t, at clock
+   time ct */
+static long
+predicted_drift(struct phase *e, rtimer_clock_t cycle_time,
+                clock_time_t ct, rtimer_clock_t t)
+{
+  struct phase_sample *last;
+  unsigned long cycles;
+
+  if(!e->drift_fitted || e->drift_cycle != cycle_time) {
+    fit_drift(e, cycle_time);
+  }
+  if(e->drift == 0) {
+    return 0;
+  }
+  last = sample(e, e->nsamples - 1);
+  if(ct - last->ctime > PHASE_DRIFT_MAX_AGE) {
+    return 0;
+  }
+  cycles = (elapsed(last, ct, t) + cycle_time / 2) / cycle_time;
+  return (long)((int64_t)e->drift * (long)cycles / (1 << DRIFT_SHIFT));
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_sample(struct phase *e, rtimer_clock_t time)
+{
+  struct phase_sample *last;
+  clock_time_t ct;
+  rtimer_clock_t cycle_time;
+  unsigned long ticks;
+  long error;
+
+  ct = clock_time();
+  if(e->nsamples > 0) {
+    last = sample(e, e->nsamples - 1);
+    if(ct - last->ctime > PHASE_DRIFT_MAX_AGE) {
+      e->nsamples = 0;
+      e->next_sample = 0;
+    } else if(e->drift_cycle != 0 && e->nsamples > 1) {
+      /* Record how far the wake-up was from the prediction */
+      cycle_time = e->drift_cycle;
+      ticks = elapsed(last, ct, time) - predicted_drift(e, cycle_time, ct, time);
+      error = (long)(ticks % cycle_time);
+      if(error > cycle_time / 2) {
+        error = cycle_time - error;
+      }
+      NETSTATS_ADD(phase_predict);
+      NETSTATS_HIST(phase_error, error);
+    }
+  }
+  e->samples[e->next_sample].ctime = ct;
+  e->samples[e->next_sample].time = time;
+  e->next_sample = (e->next_sample + 1) % PHASE_DRIFT_SAMPLES;
+  if(e->nsamples < PHASE_DRIFT_SAMPLES) {
+    e->nsamples++;
+  }
+  e->drift_fitted = 0;
+}
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
 void
 phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
              int mac_status)
@@ -98,9 +266,14 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
 #if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
+      if(!e->locked) {
+        e->nsamples = 0;
+        e->next_sample = 0;
+      }
+      add_sample(e, time);
 #endif
       e->time = time;
+      e->locked = 1;
     }
     /* If the neighbor didn't reply to us, it may have switched
        phase (rebooted). We try a number of transmissions to it
@@ -126,9 +299,12 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
       if(e) {
         e->time = time;
 #if PHASE_DRIFT_CORRECT
-      e->drift = 0;
+        e->nsamples = 0;
+        e->next_sample = 0;
+        add_sample(e, time);
 #endif
-      e->noacks = 0;
+        e->noacks = 0;
+        e->locked = 1;
       }
     }
   }
@@ -163,7 +339,7 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
      time for the next expected phase and setup a ctimer to switch on
      the radio just before the phase. */
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
-  if(e != NULL) {
+  if(e != NULL && e->locked) {
     rtimer_clock_t wait, now, expected, sync;
     clock_time_t ctimewait;
     
@@ -186,14 +362,7 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
     sync = (e == NULL) ? now : e->time;
 
 #if PHASE_DRIFT_CORRECT
-    {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
-      }
-    }
+    sync += (rtimer_clock_t)predicted_drift(e, cycle_time, clock_time(), now);
 #endif
 
     /* Check if cycle_time is a power of two */
@@ -239,6 +408,36 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
 }
 /*---------------------------------------------------------------------------*/
 void
+phase_set_wakeup(const linkaddr_t *neighbor, uint8_t level)
+{
+  struct phase *e;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  if(e == NULL) {
+    e = nbr_table_add_lladdr(nbr_phase, neighbor);
+    if(e == NULL) {
+      return;
+    }
+    e->locked = 0;
+    e->noacks = 0;
+  } else if(e->wakeup != 0 && level < e->wakeup - 1) {
+    /* A longer interval does not keep the old wake-up times, so the
+       phase has to be learned again. */
+    e->locked = 0;
+  }
+  e->wakeup = level + 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+phase_get_wakeup(const linkaddr_t *neighbor)
+{
+  struct phase *e;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  return e != NULL ? (int)e->wakeup - 1 : -1;
+}
+/*---------------------------------------------------------------------------*/
+void
 phase_init(void)
 {
   memb_init(&queued_packets_memb);
@@ -63,4 +63,8 @@ void phase_update(const linkaddr_t *neighbor,
                   rtimer_clock_t time, int mac_status);
 void phase_remove(const linkaddr_t *neighbor);
 
+/* Wake-up interval level advertised by a neighbor, -1 if unknown */
+void phase_set_wakeup(const linkaddr_t *neighbor, uint8_t level);
+int phase_get_wakeup(const linkaddr_t *neighbor);
+
 #endif /* PHASE_H */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Declarations shared by the TSCH-MAC slot engine and schedule
+ */
+
+#ifndef TSCHMAC_PRIVATE_H_
+#define TSCHMAC_PRIVATE_H_
+
+#include "net/mac/tschmac/tschmac.h"
+
+/* Set while the process side changes queues or the schedule. The
+   slot engine does not transmit in a slot that starts while it is
+   set. */
+extern volatile uint8_t tschmac_lock;
+
+extern const uint8_t tschmac_hopping_sequence[];
+extern const uint8_t tschmac_hopping_sequence_len;
+
+void tschmac_schedule_init(void);
+/* The slotframes, in the order of their handles */
+struct tschmac_slotframe *tschmac_schedule_slotframes(void);
+/* Non-zero if a transmit cell is reserved for addr */
+int tschmac_schedule_has_tx_cell(const linkaddr_t *addr);
+/* Non-zero if any slotframe has a cell in the slot asn */
+int tschmac_schedule_is_active(uint32_t asn);
+
+/* The default schedule: a shared slotframe for EBs and broadcast, and
+   a slotframe where each node listens in a slot derived from its
+   address and its neighbors send to it there. */
+void tschmac_schedule_default(void);
+struct tschmac_cell *tschmac_schedule_add_neighbor(const linkaddr_t *addr);
+void tschmac_schedule_remove_neighbor(struct tschmac_cell *cell);
+
+#endif /* TSCHMAC_PRIVATE_H_ */
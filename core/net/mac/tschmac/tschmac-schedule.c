@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Slotframes and cells of TSCH-MAC
+ */
+
+#include "net/mac/tschmac/tschmac-private.h"
+#include "lib/memb.h"
+
+#include <string.h>
+
+MEMB(slotframe_memb, struct tschmac_slotframe, TSCHMAC_MAX_SLOTFRAMES);
+MEMB(cell_memb, struct tschmac_cell, TSCHMAC_MAX_CELLS);
+LIST(slotframe_list);
+
+#if TSCHMAC_DEFAULT_SCHEDULE
+#define SHARED_HANDLE  0
+#define UNICAST_HANDLE 1
+#endif /* TSCHMAC_DEFAULT_SCHEDULE */
+
+/*---------------------------------------------------------------------------*/
+struct tschmac_slotframe *
+tschmac_slotframe_get(uint16_t handle)
+{
+  struct tschmac_slotframe *sf;
+
+  for(sf = list_head(slotframe_list); sf != NULL; sf = list_item_next(sf)) {
+    if(sf->handle == handle) {
+      return sf;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+struct tschmac_slotframe *
+tschmac_slotframe_add(uint16_t handle, uint16_t size)
+{
+  struct tschmac_slotframe *sf, *prev, *s;
+
+  if(size == 0 || tschmac_slotframe_get(handle) != NULL) {
+    return NULL;
+  }
+  sf = memb_alloc(&slotframe_memb);
+  if(sf == NULL) {
+    return NULL;
+  }
+  sf->handle = handle;
+  sf->size = size;
+  LIST_STRUCT_INIT(sf, cells);
+
+  /* Keep the list sorted by handle */
+  prev = NULL;
+  for(s = list_head(slotframe_list); s != NULL && s->handle < handle;
+      s = list_item_next(s)) {
+    prev = s;
+  }
+  tschmac_lock = 1;
+  list_insert(slotframe_list, prev, sf);
+  tschmac_lock = 0;
+  return sf;
+}
+/*---------------------------------------------------------------------------*/
+struct tschmac_cell *
+tschmac_cell_add(struct tschmac_slotframe *sf, uint16_t timeslot,
+                 uint8_t channel_offset, uint8_t options,
+                 const linkaddr_t *addr)
+{
+  struct tschmac_cell *c;
+
+  if(sf == NULL || timeslot >= sf->size) {
+    return NULL;
+  }
+  c = memb_alloc(&cell_memb);
+  if(c == NULL) {
+    return NULL;
+  }
+  c->timeslot = timeslot;
+  c->channel_offset = channel_offset;
+  c->options = options;
+  linkaddr_copy(&c->addr, addr != NULL ? addr : &linkaddr_null);
+  tschmac_lock = 1;
+  list_add(sf->cells, c);
+  tschmac_lock = 0;
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+void
+tschmac_cell_remove(struct tschmac_slotframe *sf, struct tschmac_cell *cell)
+{
+  if(sf != NULL && cell != NULL) {
+    tschmac_lock = 1;
+    list_remove(sf->cells, cell);
+    tschmac_lock = 0;
+    memb_free(&cell_memb, cell);
+  }
+}
+/*---------------------------------------------------------------------------*/
+struct tschmac_slotframe *
+tschmac_schedule_slotframes(void)
+{
+  return list_head(slotframe_list);
+}
+/*---------------------------------------------------------------------------*/
+int
+tschmac_schedule_has_tx_cell(const linkaddr_t *addr)
+{
+  struct tschmac_slotframe *sf;
+  struct tschmac_cell *c;
+
+  for(sf = list_head(slotframe_list); sf != NULL; sf = list_item_next(sf)) {
+    for(c = list_head(sf->cells); c != NULL; c = list_item_next(c)) {
+      if((c->options & TSCHMAC_CELL_TX) && linkaddr_cmp(&c->addr, addr)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tschmac_schedule_is_active(uint32_t asn)
+{
+  struct tschmac_slotframe *sf;
+  struct tschmac_cell *c;
+  uint16_t timeslot;
+
+  for(sf = list_head(slotframe_list); sf != NULL; sf = list_item_next(sf)) {
+    timeslot = asn % sf->size;
+    for(c = list_head(sf->cells); c != NULL; c = list_item_next(c)) {
+      if(c->timeslot == timeslot) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+#if TSCHMAC_DEFAULT_SCHEDULE
+static uint16_t
+addr_hash(const linkaddr_t *addr)
+{
+  return addr->u8[LINKADDR_SIZE - 1];
+}
+/*---------------------------------------------------------------------------*/
+void
+tschmac_schedule_default(void)
+{
+  struct tschmac_slotframe *sf;
+  uint16_t h;
+
+  sf = tschmac_slotframe_add(SHARED_HANDLE, TSCHMAC_SHARED_SLOTFRAME_LENGTH);
+  tschmac_cell_add(sf, 0, 0,
+                   TSCHMAC_CELL_TX | TSCHMAC_CELL_RX | TSCHMAC_CELL_SHARED,
+                   &linkaddr_null);
+
+  sf = tschmac_slotframe_add(UNICAST_HANDLE, TSCHMAC_UNICAST_SLOTFRAME_LENGTH);
+  h = addr_hash(&linkaddr_node_addr);
+  tschmac_cell_add(sf, h % TSCHMAC_UNICAST_SLOTFRAME_LENGTH,
+                   h % tschmac_hopping_sequence_len, TSCHMAC_CELL_RX,
+                   &linkaddr_null);
+}
+/*---------------------------------------------------------------------------*/
+struct tschmac_cell *
+tschmac_schedule_add_neighbor(const linkaddr_t *addr)
+{
+  uint16_t h;
+
+  h = addr_hash(addr);
+  return tschmac_cell_add(tschmac_slotframe_get(UNICAST_HANDLE),
+                          h % TSCHMAC_UNICAST_SLOTFRAME_LENGTH,
+                          h % tschmac_hopping_sequence_len,
+                          TSCHMAC_CELL_TX | TSCHMAC_CELL_SHARED, addr);
+}
+/*---------------------------------------------------------------------------*/
+void
+tschmac_schedule_remove_neighbor(struct tschmac_cell *cell)
+{
+  tschmac_cell_remove(tschmac_slotframe_get(UNICAST_HANDLE), cell);
+}
+#endif /* TSCHMAC_DEFAULT_SCHEDULE */
+/*---------------------------------------------------------------------------*/
+void
+tschmac_schedule_init(void)
+{
+  memb_init(&slotframe_memb);
+  memb_init(&cell_memb);
+  list_init(slotframe_list);
+#if TSCHMAC_DEFAULT_SCHEDULE
+  tschmac_schedule_default();
+#endif /* TSCHMAC_DEFAULT_SCHEDULE */
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,986 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         TSCH-MAC, a time-slotted channel hopping MAC layer. The MAC
+ *         driver queues frames per neighbor, the RDC driver runs the
+ *         slots from an rtimer and sends and receives them.
+ */
+
+#include "contiki-conf.h"
+#include "dev/radio.h"
+#include "lib/memb.h"
+#include "lib/random.h"
+#include "net/mac/frame802154.h"
+#include "net/mac/mac-sequence.h"
+#include "net/mac/tschmac/tschmac-private.h"
+#include "net/netstack.h"
+#include "net/netstats.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "sys/pt.h"
+#include "sys/rtimer.h"
+
+#if NETSTACK_CONF_WITH_IPV6 && UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl-private.h"
+#endif /* NETSTACK_CONF_WITH_IPV6 && UIP_CONF_IPV6_RPL */
+
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* Slot timing. The defaults leave room for the 1 ms rtimer and the
+   radio turnaround of Cooja motes; a real 802.15.4 radio would use
+   the 10 ms slots of the standard. */
+#ifdef TSCHMAC_CONF_SLOT_DURATION
+#define SLOT_DURATION TSCHMAC_CONF_SLOT_DURATION
+#else
+#define SLOT_DURATION (RTIMER_SECOND / 50)
+#endif /* TSCHMAC_CONF_SLOT_DURATION */
+
+/* From the slot start to the start of a transmission */
+#ifdef TSCHMAC_CONF_TX_OFFSET
+#define TX_OFFSET TSCHMAC_CONF_TX_OFFSET
+#else
+#define TX_OFFSET (RTIMER_SECOND / 250)
+#endif /* TSCHMAC_CONF_TX_OFFSET */
+
+/* From NETSTACK_RADIO.transmit() to the first bit on air */
+#ifdef TSCHMAC_CONF_TX_DELAY
+#define TX_DELAY TSCHMAC_CONF_TX_DELAY
+#else
+#define TX_DELAY (RTIMER_SECOND / 500)
+#endif /* TSCHMAC_CONF_TX_DELAY */
+
+/* From the end of a frame to the call of the RDC input function */
+#ifdef TSCHMAC_CONF_RX_DELAY
+#define RX_DELAY TSCHMAC_CONF_RX_DELAY
+#else
+#define RX_DELAY (RTIMER_SECOND / 1000)
+#endif /* TSCHMAC_CONF_RX_DELAY */
+
+/* Receivers listen this long before and after the expected start of
+   a frame. It bounds the clock error between neighbors. */
+#ifdef TSCHMAC_CONF_RX_GUARD
+#define RX_GUARD TSCHMAC_CONF_RX_GUARD
+#else
+#define RX_GUARD (RTIMER_SECOND / 333)
+#endif /* TSCHMAC_CONF_RX_GUARD */
+
+#ifdef TSCHMAC_CONF_ACK_WAIT
+#define ACK_WAIT TSCHMAC_CONF_ACK_WAIT
+#else
+#define ACK_WAIT (RTIMER_SECOND / 166)
+#endif /* TSCHMAC_CONF_ACK_WAIT */
+
+/* Associated nodes send an EB every EB_PERIOD on average */
+#ifdef TSCHMAC_CONF_EB_PERIOD
+#define EB_PERIOD TSCHMAC_CONF_EB_PERIOD
+#else
+#define EB_PERIOD (4 * CLOCK_SECOND)
+#endif /* TSCHMAC_CONF_EB_PERIOD */
+
+/* Leave the network after this long without a frame from the time
+   source */
+#ifdef TSCHMAC_CONF_DESYNC_TIME
+#define DESYNC_TIME TSCHMAC_CONF_DESYNC_TIME
+#else
+#define DESYNC_TIME (60 * CLOCK_SECOND)
+#endif /* TSCHMAC_CONF_DESYNC_TIME */
+
+/* Time on each channel when scanning for EBs */
+#ifdef TSCHMAC_CONF_SCAN_PERIOD
+#define SCAN_PERIOD TSCHMAC_CONF_SCAN_PERIOD
+#else
+#define SCAN_PERIOD CLOCK_SECOND
+#endif /* TSCHMAC_CONF_SCAN_PERIOD */
+
+#ifdef TSCHMAC_CONF_MAX_NEIGHBORS
+#define MAX_NEIGHBORS TSCHMAC_CONF_MAX_NEIGHBORS
+#else
+#define MAX_NEIGHBORS 8
+#endif /* TSCHMAC_CONF_MAX_NEIGHBORS */
+
+#ifdef TSCHMAC_CONF_MAX_PACKETS
+#define MAX_PACKETS TSCHMAC_CONF_MAX_PACKETS
+#else
+#define MAX_PACKETS 8
+#endif /* TSCHMAC_CONF_MAX_PACKETS */
+
+#ifdef TSCHMAC_CONF_MAX_TRANSMISSIONS
+#define MAX_TRANSMISSIONS TSCHMAC_CONF_MAX_TRANSMISSIONS
+#else
+#define MAX_TRANSMISSIONS 4
+#endif /* TSCHMAC_CONF_MAX_TRANSMISSIONS */
+
+/* Backoff exponents in shared cells */
+#define MIN_BE 1
+#define MAX_BE 5
+
+#define ACK_LEN 3
+/* Time on air of a frame of len bytes at 250 kbit/s, with preamble,
+   SFD, length and FCS */
+#define AIRTIME(len) ((rtimer_clock_t)(((uint32_t)(len) + 6) * RTIMER_SECOND / 31250))
+/* EB payload: ASN, little endian, and join priority */
+#define EB_PAYLOAD_LEN 5
+
+struct tschmac_packet {
+  struct tschmac_packet *next;
+  struct queuebuf *qb;
+  mac_callback_t sent;
+  void *ptr;
+  uint8_t transmissions;
+  uint8_t max_transmissions;
+  uint8_t status;
+  /* Set by the slot engine when the packet is sent or dropped */
+  volatile uint8_t done;
+};
+
+struct tschmac_neighbor {
+  struct tschmac_neighbor *next;
+  /* linkaddr_null for broadcast */
+  linkaddr_t addr;
+  LIST_STRUCT(queue);
+  /* Transmit cell added by the default schedule */
+  struct tschmac_cell *tx_cell;
+  uint8_t backoff_exponent;
+  uint8_t backoff_window;
+};
+
+MEMB(neighbor_memb, struct tschmac_neighbor, MAX_NEIGHBORS);
+MEMB(packet_memb, struct tschmac_packet, MAX_PACKETS);
+LIST(neighbor_list);
+
+volatile uint8_t tschmac_lock;
+const uint8_t tschmac_hopping_sequence[] = TSCHMAC_HOPPING_SEQUENCE;
+const uint8_t tschmac_hopping_sequence_len = sizeof(tschmac_hopping_sequence);
+
+static volatile uint32_t asn;
+static volatile rtimer_clock_t slot_start;
+static struct rtimer slot_timer;
+static struct pt slot_pt;
+static volatile uint8_t engine_running;
+
+static uint8_t is_on;
+static uint8_t coordinator;
+static volatile uint8_t associated;
+static uint8_t join_priority;
+static linkaddr_t time_source;
+static clock_time_t last_sync;
+/* Correction of the next slot start, from the time source */
+static volatile long sync_correction;
+
+/* Set while a receive window is open or while scanning */
+static volatile uint8_t listening;
+static volatile uint8_t input_busy;
+
+static uint8_t eb_buf[PACKETBUF_SIZE];
+static uint8_t eb_len;
+static uint8_t eb_asn_offset;
+static volatile uint8_t eb_pending;
+
+PROCESS(tschmac_process, "TSCH-MAC");
+/*---------------------------------------------------------------------------*/
+static long
+rtimer_diff(rtimer_clock_t a, rtimer_clock_t b)
+{
+  if(RTIMER_CLOCK_LT(a, b)) {
+    return -(long)(rtimer_clock_t)(b - a);
+  }
+  return (rtimer_clock_t)(a - b);
+}
+/*---------------------------------------------------------------------------*/
+static struct tschmac_neighbor *
+neighbor_get(const linkaddr_t *addr)
+{
+  struct tschmac_neighbor *n;
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    if(linkaddr_cmp(&n->addr, addr)) {
+      return n;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct tschmac_neighbor *
+neighbor_add(const linkaddr_t *addr)
+{
+  struct tschmac_neighbor *n;
+
+  n = memb_alloc(&neighbor_memb);
+  if(n == NULL) {
+    return NULL;
+  }
+  linkaddr_copy(&n->addr, addr);
+  LIST_STRUCT_INIT(n, queue);
+  n->tx_cell = NULL;
+#if TSCHMAC_DEFAULT_SCHEDULE
+  if(!linkaddr_cmp(addr, &linkaddr_null)) {
+    n->tx_cell = tschmac_schedule_add_neighbor(addr);
+  }
+#endif /* TSCHMAC_DEFAULT_SCHEDULE */
+  n->backoff_exponent = MIN_BE;
+  n->backoff_window = 0;
+  tschmac_lock = 1;
+  list_add(neighbor_list, n);
+  tschmac_lock = 0;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+neighbor_remove(struct tschmac_neighbor *n)
+{
+  tschmac_lock = 1;
+  list_remove(neighbor_list, n);
+  tschmac_lock = 0;
+#if TSCHMAC_DEFAULT_SCHEDULE
+  if(n->tx_cell != NULL) {
+    tschmac_schedule_remove_neighbor(n->tx_cell);
+  }
+#endif /* TSCHMAC_DEFAULT_SCHEDULE */
+  memb_free(&neighbor_memb, n);
+}
+/*---------------------------------------------------------------------------*/
+/* The packet to send to n in cell c, if any */
+static struct tschmac_packet *
+packet_for_cell(struct tschmac_neighbor *n, struct tschmac_cell *c)
+{
+  struct tschmac_packet *p;
+
+  p = list_head(n->queue);
+  if(p == NULL || p->done) {
+    return NULL;
+  }
+  if((c->options & TSCHMAC_CELL_SHARED) && n->backoff_window > 0) {
+    n->backoff_window--;
+    return NULL;
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the cell to use in the current slot. Sets *np to the neighbor
+   to send to, or *eb if the EB is to be sent; both stay unset for a
+   receive cell. */
+static struct tschmac_cell *
+select_cell(struct tschmac_neighbor **np, uint8_t *eb)
+{
+  struct tschmac_slotframe *sf;
+  struct tschmac_cell *c, *rx_cell;
+  struct tschmac_neighbor *n;
+  uint16_t timeslot;
+
+  rx_cell = NULL;
+  for(sf = tschmac_schedule_slotframes(); sf != NULL;
+      sf = list_item_next(sf)) {
+    timeslot = asn % sf->size;
+    for(c = list_head(sf->cells); c != NULL; c = list_item_next(c)) {
+      if(c->timeslot != timeslot) {
+        continue;
+      }
+      if(c->options & TSCHMAC_CELL_TX) {
+        if(linkaddr_cmp(&c->addr, &linkaddr_null)) {
+          /* EBs, broadcast and neighbors without a cell of their own */
+          if(eb_pending) {
+            *eb = 1;
+            return c;
+          }
+          for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+            if(n->tx_cell == NULL &&
+               (linkaddr_cmp(&n->addr, &linkaddr_null) ||
+                !tschmac_schedule_has_tx_cell(&n->addr)) &&
+               packet_for_cell(n, c) != NULL) {
+              *np = n;
+              return c;
+            }
+          }
+        } else {
+          n = neighbor_get(&c->addr);
+          if(n != NULL && packet_for_cell(n, c) != NULL) {
+            *np = n;
+            return c;
+          }
+        }
+      }
+      if(rx_cell == NULL && (c->options & TSCHMAC_CELL_RX)) {
+        rx_cell = c;
+      }
+    }
+  }
+  return rx_cell;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_channel(uint8_t channel_offset)
+{
+  NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL,
+                           tschmac_hopping_sequence[(asn + channel_offset) %
+                                                    tschmac_hopping_sequence_len]);
+}
+/*---------------------------------------------------------------------------*/
+/* Send the EB or the first packet of n. Runs in the slot engine. */
+static void
+transmit(struct tschmac_neighbor *n, struct tschmac_cell *c)
+{
+  struct tschmac_packet *p;
+  uint8_t ackbuf[ACK_LEN];
+  const uint8_t *buf;
+  rtimer_clock_t wt;
+  uint8_t len, unicast;
+  int ret;
+
+  p = NULL;
+  if(n == NULL) {
+    eb_buf[eb_asn_offset] = asn & 0xff;
+    eb_buf[eb_asn_offset + 1] = (asn >> 8) & 0xff;
+    eb_buf[eb_asn_offset + 2] = (asn >> 16) & 0xff;
+    eb_buf[eb_asn_offset + 3] = (asn >> 24) & 0xff;
+    buf = eb_buf;
+    len = eb_len;
+    unicast = 0;
+  } else {
+    p = list_head(n->queue);
+    buf = queuebuf_dataptr(p->qb);
+    len = queuebuf_datalen(p->qb);
+    unicast = !linkaddr_cmp(&n->addr, &linkaddr_null);
+  }
+
+  NETSTACK_RADIO.on();
+  NETSTACK_RADIO.prepare(buf, len);
+  ret = NETSTACK_RADIO.transmit(len);
+  if(ret == RADIO_TX_OK) {
+    if(unicast) {
+      wt = RTIMER_NOW();
+      while(RTIMER_CLOCK_LT(RTIMER_NOW(), wt + ACK_WAIT) &&
+            !NETSTACK_RADIO.pending_packet()) { }
+      ret = MAC_TX_NOACK;
+      if(NETSTACK_RADIO.pending_packet() &&
+         NETSTACK_RADIO.read(ackbuf, ACK_LEN) == ACK_LEN &&
+         ackbuf[2] == buf[2]) {
+        ret = MAC_TX_OK;
+      }
+    } else {
+      ret = MAC_TX_OK;
+    }
+  } else if(ret == RADIO_TX_COLLISION) {
+    ret = MAC_TX_COLLISION;
+  } else {
+    ret = MAC_TX_ERR;
+  }
+  NETSTACK_RADIO.off();
+  NETSTATS_RDC_TX(ret);
+
+  if(p == NULL) {
+    eb_pending = 0;
+    return;
+  }
+
+  p->transmissions++;
+  p->status = ret;
+  if(ret == MAC_TX_OK) {
+    n->backoff_exponent = MIN_BE;
+    n->backoff_window = 0;
+  } else if(c->options & TSCHMAC_CELL_SHARED) {
+    n->backoff_window = random_rand() % (1 << n->backoff_exponent);
+    if(n->backoff_exponent < MAX_BE) {
+      n->backoff_exponent++;
+    }
+  }
+  if(ret == MAC_TX_OK || p->transmissions >= p->max_transmissions) {
+    p->done = 1;
+    process_poll(&tschmac_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Move to the next slot with a cell that has not started yet */
+static void
+next_slot(void)
+{
+  rtimer_clock_t now;
+  uint16_t skip;
+
+  now = RTIMER_NOW();
+  slot_start += sync_correction;
+  sync_correction = 0;
+  do {
+    skip = 1;
+    while(skip < 0xffff && !tschmac_lock &&
+          !tschmac_schedule_is_active(asn + skip)) {
+      skip++;
+    }
+    asn += skip;
+    slot_start += (rtimer_clock_t)skip * SLOT_DURATION;
+  } while(RTIMER_CLOCK_LT(slot_start, now + 2));
+}
+/*---------------------------------------------------------------------------*/
+static char slot_operation(struct rtimer *t, void *ptr);
+static void
+schedule_fixed(struct rtimer *t, rtimer_clock_t fixed_time)
+{
+  int r;
+
+  if(RTIMER_CLOCK_LT(fixed_time, RTIMER_NOW() + 1)) {
+    fixed_time = RTIMER_NOW() + 1;
+  }
+  r = rtimer_set(t, fixed_time, 1,
+                 (void (*)(struct rtimer *, void *))slot_operation, NULL);
+  if(r != RTIMER_OK) {
+    PRINTF("tschmac: could not set rtimer\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static char
+slot_operation(struct rtimer *t, void *ptr)
+{
+  static struct tschmac_cell *cell;
+  static struct tschmac_neighbor *n;
+  static uint8_t eb;
+
+  PT_BEGIN(&slot_pt);
+
+  while(engine_running) {
+    /* A timer set before the engine was restarted may fire early */
+    while(RTIMER_CLOCK_LT(RTIMER_NOW() + 1, slot_start)) {
+      schedule_fixed(t, slot_start);
+      PT_YIELD(&slot_pt);
+    }
+
+    cell = NULL;
+    n = NULL;
+    eb = 0;
+    if(!tschmac_lock && !input_busy) {
+      cell = select_cell(&n, &eb);
+    }
+
+    if(cell != NULL && (n != NULL || eb)) {
+      set_channel(cell->channel_offset);
+      schedule_fixed(t, slot_start + TX_OFFSET);
+      PT_YIELD(&slot_pt);
+      /* Queued packets are dropped when the node leaves the network */
+      if(engine_running) {
+        transmit(n, cell);
+      }
+
+    } else if(cell != NULL) {
+      set_channel(cell->channel_offset);
+      schedule_fixed(t, slot_start + TX_OFFSET + TX_DELAY - RX_GUARD);
+      PT_YIELD(&slot_pt);
+      if(engine_running) {
+        listening = 1;
+        NETSTACK_RADIO.on();
+        schedule_fixed(t, slot_start + TX_OFFSET + TX_DELAY + RX_GUARD);
+        PT_YIELD(&slot_pt);
+      }
+      if(engine_running && (NETSTACK_RADIO.receiving_packet() ||
+                            NETSTACK_RADIO.pending_packet() || input_busy)) {
+        /* Stay on for the frame and the acknowledgment */
+        schedule_fixed(t, slot_start + SLOT_DURATION - RX_GUARD);
+        PT_YIELD(&slot_pt);
+      }
+      if(engine_running) {
+        listening = 0;
+        if(!input_busy) {
+          NETSTACK_RADIO.off();
+        }
+      }
+    }
+
+    next_slot();
+    schedule_fixed(t, slot_start);
+    PT_YIELD(&slot_pt);
+  }
+
+  PT_END(&slot_pt);
+}
+/*---------------------------------------------------------------------------*/
+/* Start the slot engine with the slot asn starting at start */
+static void
+start_engine(uint32_t first_asn, rtimer_clock_t start)
+{
+  asn = first_asn;
+  slot_start = start;
+  sync_correction = 0;
+  if(!tschmac_schedule_is_active(asn) ||
+     RTIMER_CLOCK_LT(slot_start, RTIMER_NOW() + 2)) {
+    next_slot();
+  }
+  listening = 0;
+  NETSTACK_RADIO.off();
+  engine_running = 1;
+  PT_INIT(&slot_pt);
+  schedule_fixed(&slot_timer, slot_start);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  struct tschmac_neighbor *n;
+  struct tschmac_packet *p;
+  const linkaddr_t *addr;
+  int max_transmissions;
+
+  if(!associated) {
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+    return;
+  }
+
+  packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, FRAME802154_DATAFRAME);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+  if(packetbuf_holds_broadcast()) {
+    addr = &linkaddr_null;
+    max_transmissions = 1;
+  } else {
+    addr = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+    packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+    max_transmissions = packetbuf_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS);
+    if(max_transmissions == 0) {
+      max_transmissions = MAX_TRANSMISSIONS;
+    }
+  }
+
+  if(NETSTACK_FRAMER.create_and_secure() < 0) {
+    PRINTF("tschmac: failed to create packet\n");
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
+    return;
+  }
+
+  n = neighbor_get(addr);
+  if(n == NULL) {
+    n = neighbor_add(addr);
+  }
+  p = memb_alloc(&packet_memb);
+  if(n == NULL || p == NULL) {
+    PRINTF("tschmac: queue full\n");
+    if(p != NULL) {
+      memb_free(&packet_memb, p);
+    }
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+    return;
+  }
+  p->qb = queuebuf_new_from_packetbuf();
+  if(p->qb == NULL) {
+    memb_free(&packet_memb, p);
+    if(list_head(n->queue) == NULL) {
+      neighbor_remove(n);
+    }
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+    return;
+  }
+  p->sent = sent;
+  p->ptr = ptr;
+  p->transmissions = 0;
+  p->max_transmissions = max_transmissions;
+  p->status = MAC_TX_ERR;
+  p->done = 0;
+  tschmac_lock = 1;
+  list_add(n->queue, p);
+  tschmac_lock = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Report the packets the slot engine is done with */
+static void
+handle_done_packets(void)
+{
+  struct tschmac_neighbor *n, *next;
+  struct tschmac_packet *p;
+
+  for(n = list_head(neighbor_list); n != NULL; n = next) {
+    next = list_item_next(n);
+    while((p = list_head(n->queue)) != NULL && p->done) {
+      tschmac_lock = 1;
+      list_remove(n->queue, p);
+      tschmac_lock = 0;
+      queuebuf_to_packetbuf(p->qb);
+      queuebuf_free(p->qb);
+      if(p->status == MAC_TX_OK) {
+        NETSTATS_ADD(mac_tx_ok);
+      } else {
+        NETSTATS_ADD(mac_tx_fail);
+      }
+      if(p->transmissions > 1) {
+        NETSTATS_SUM(mac_retx, p->transmissions - 1);
+      }
+      mac_call_sent_callback(p->sent, p->ptr, p->status,
+                             p->transmissions > 0 ? p->transmissions : 1);
+      memb_free(&packet_memb, p);
+    }
+    if(list_head(n->queue) == NULL) {
+      neighbor_remove(n);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Build the EB for the slot engine, which fills in the ASN */
+static void
+prepare_eb(void)
+{
+  uint8_t *payload;
+  int hdr_len;
+
+  packetbuf_clear();
+  payload = packetbuf_dataptr();
+  memset(payload, 0, EB_PAYLOAD_LEN);
+  payload[EB_PAYLOAD_LEN - 1] = join_priority;
+  packetbuf_set_datalen(EB_PAYLOAD_LEN);
+  packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, FRAME802154_BEACONFRAME);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &linkaddr_null);
+  hdr_len = NETSTACK_FRAMER.create();
+  if(hdr_len < 0 || packetbuf_totlen() > sizeof(eb_buf)) {
+    return;
+  }
+  tschmac_lock = 1;
+  memcpy(eb_buf, packetbuf_hdrptr(), packetbuf_totlen());
+  eb_len = packetbuf_totlen();
+  eb_asn_offset = hdr_len;
+  eb_pending = 1;
+  tschmac_lock = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_scan(void)
+{
+  listening = 1;
+  NETSTACK_RADIO.on();
+}
+/*---------------------------------------------------------------------------*/
+static void
+disassociate(void)
+{
+  struct tschmac_neighbor *n;
+  struct tschmac_packet *p;
+
+  PRINTF("tschmac: leaving the network\n");
+  engine_running = 0;
+  associated = 0;
+  eb_pending = 0;
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    for(p = list_head(n->queue); p != NULL; p = list_item_next(p)) {
+      p->status = MAC_TX_ERR;
+      p->done = 1;
+    }
+  }
+  handle_done_packets();
+  if(is_on) {
+    start_scan();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+associate(const linkaddr_t *src, const uint8_t *payload,
+          rtimer_clock_t rx_end, int frame_len)
+{
+  uint32_t eb_asn;
+
+  eb_asn = (uint32_t)payload[0] | ((uint32_t)payload[1] << 8) |
+    ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+  join_priority = payload[4] + 1;
+  tschmac_set_time_source(src);
+  last_sync = clock_time();
+  associated = 1;
+  PRINTF("tschmac: joined at asn %lu, join priority %u\n",
+         (unsigned long)eb_asn, join_priority);
+  start_engine(eb_asn, rx_end - RX_DELAY - AIRTIME(frame_len) -
+               TX_DELAY - TX_OFFSET);
+  process_poll(&tschmac_process);
+}
+/*---------------------------------------------------------------------------*/
+/* Align the slots to a frame from the time source received in the
+   current slot */
+static void
+synchronize(rtimer_clock_t rx_end, int frame_len)
+{
+  rtimer_clock_t expected;
+  long error;
+
+  expected = slot_start + TX_OFFSET + TX_DELAY + AIRTIME(frame_len) + RX_DELAY;
+  if(!RTIMER_CLOCK_LT(rx_end, slot_start + SLOT_DURATION) ||
+     RTIMER_CLOCK_LT(rx_end, slot_start)) {
+    return;
+  }
+  error = rtimer_diff(rx_end, expected);
+  if(error > RX_GUARD) {
+    error = RX_GUARD;
+  } else if(error < -RX_GUARD) {
+    error = -RX_GUARD;
+  }
+  sync_correction = error;
+  last_sync = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_input(void)
+{
+  rtimer_clock_t rx_end;
+  frame802154_t info154;
+  uint8_t *original_dataptr;
+  int original_datalen;
+  int duplicate;
+
+  rx_end = RTIMER_NOW();
+  input_busy = 1;
+  original_dataptr = packetbuf_dataptr();
+  original_datalen = packetbuf_datalen();
+
+  if(original_datalen == ACK_LEN) {
+    /* Acknowledgments are read by the slot engine */
+  } else if(NETSTACK_FRAMER.parse() < 0) {
+    PRINTF("tschmac: failed to parse %u\n", original_datalen);
+  } else if(packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE) == FRAME802154_BEACONFRAME) {
+    if(!associated && !coordinator &&
+       packetbuf_datalen() >= EB_PAYLOAD_LEN) {
+      associate(packetbuf_addr(PACKETBUF_ADDR_SENDER), packetbuf_dataptr(),
+                rx_end, original_datalen);
+    } else if(associated && linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                                         &time_source)) {
+      synchronize(rx_end, original_datalen);
+    }
+  } else if(!associated) {
+    PRINTF("tschmac: not associated, dropping frame\n");
+  } else if(!linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                          &linkaddr_node_addr) &&
+            !packetbuf_holds_broadcast()) {
+    PRINTF("tschmac: not for us\n");
+  } else {
+    if(!coordinator && linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                                    &time_source)) {
+      synchronize(rx_end, original_datalen);
+    }
+
+    frame802154_parse(original_dataptr, original_datalen, &info154);
+    if(info154.fcf.frame_type == FRAME802154_DATAFRAME &&
+       info154.fcf.ack_required != 0 &&
+       linkaddr_cmp((linkaddr_t *)&info154.dest_addr, &linkaddr_node_addr)) {
+      uint8_t ackdata[ACK_LEN];
+
+      ackdata[0] = FRAME802154_ACKFRAME;
+      ackdata[1] = 0;
+      ackdata[2] = info154.seq;
+      NETSTACK_RADIO.send(ackdata, ACK_LEN);
+    }
+
+    duplicate = 0;
+#if RDC_WITH_DUPLICATE_DETECTION
+    duplicate = mac_sequence_is_duplicate();
+    if(duplicate) {
+      PRINTF("tschmac: drop duplicate link layer packet %u\n",
+             packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO));
+    } else {
+      mac_sequence_register_seqno();
+    }
+#endif /* RDC_WITH_DUPLICATE_DETECTION */
+    if(!duplicate) {
+      NETSTATS_ADD(rdc_rx);
+      NETSTACK_MAC.input();
+    }
+  }
+
+  input_busy = 0;
+  if(!listening) {
+    NETSTACK_RADIO.off();
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tschmac_process, ev, data)
+{
+  static struct etimer eb_timer, scan_timer;
+  static uint8_t scan_channel;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&eb_timer, random_rand() % EB_PERIOD + 1);
+  etimer_set(&scan_timer, SCAN_PERIOD);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+
+    if(ev == PROCESS_EVENT_POLL) {
+      handle_done_packets();
+
+    } else if(ev == PROCESS_EVENT_TIMER && data == &scan_timer) {
+      if(is_on && !associated) {
+        scan_channel = (scan_channel + 1) % tschmac_hopping_sequence_len;
+        NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL,
+                                 tschmac_hopping_sequence[scan_channel]);
+      }
+      etimer_reset(&scan_timer);
+
+    } else if(ev == PROCESS_EVENT_TIMER && data == &eb_timer) {
+      if(associated && !coordinator &&
+         clock_time() - last_sync > DESYNC_TIME) {
+        disassociate();
+      }
+      if(is_on && associated && !eb_pending) {
+        prepare_eb();
+      }
+      etimer_set(&eb_timer, EB_PERIOD / 2 + random_rand() % EB_PERIOD);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+tschmac_set_coordinator(int enable)
+{
+  if(enable) {
+    coordinator = 1;
+    join_priority = 0;
+    associated = 1;
+    linkaddr_copy(&time_source, &linkaddr_null);
+    start_engine(0, RTIMER_NOW() + SLOT_DURATION);
+  } else if(coordinator) {
+    coordinator = 0;
+    disassociate();
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+tschmac_is_coordinator(void)
+{
+  return coordinator;
+}
+/*---------------------------------------------------------------------------*/
+int
+tschmac_is_associated(void)
+{
+  return associated;
+}
+/*---------------------------------------------------------------------------*/
+void
+tschmac_set_time_source(const linkaddr_t *addr)
+{
+  if(!coordinator && addr != NULL) {
+    linkaddr_copy(&time_source, addr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if NETSTACK_CONF_WITH_IPV6 && UIP_CONF_IPV6_RPL
+void
+tschmac_rpl_parent_switch(rpl_parent_t *old, rpl_parent_t *new)
+{
+  if(new != NULL) {
+    tschmac_set_time_source(nbr_table_get_lladdr(rpl_parents, new));
+  }
+}
+#endif /* NETSTACK_CONF_WITH_IPV6 && UIP_CONF_IPV6_RPL */
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  memb_init(&neighbor_memb);
+  memb_init(&packet_memb);
+  list_init(neighbor_list);
+  tschmac_schedule_init();
+  is_on = 1;
+  start_scan();
+  process_start(&tschmac_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+input_packet(void)
+{
+  NETSTACK_LLSEC.input();
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_send_packet(mac_callback_t sent, void *ptr)
+{
+  /* Frames are sent from the slots of tschmac_driver */
+  mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *list)
+{
+  mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
+}
+/*---------------------------------------------------------------------------*/
+static int
+turn_on(void)
+{
+  is_on = 1;
+  if(!associated) {
+    start_scan();
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+turn_off(int keep_radio_on)
+{
+  is_on = 0;
+  listening = keep_radio_on;
+  if(keep_radio_on) {
+    return NETSTACK_RADIO.on();
+  }
+  return NETSTACK_RADIO.off();
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver tschmac_driver = {
+  "TSCH-MAC",
+  init,
+  send_packet,
+  input_packet,
+  turn_on,
+  turn_off,
+  channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver tschmac_rdc_driver = {
+  "TSCH-MAC RDC",
+  rdc_init,
+  rdc_send_packet,
+  rdc_send_list,
+  packet_input,
+  turn_on,
+  turn_off,
+  channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
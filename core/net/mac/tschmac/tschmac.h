@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Header file for TSCH-MAC, a time-slotted channel hopping MAC
+ *         layer in the style of IEEE 802.15.4e TSCH.
+ *
+ *         Time is divided into slots numbered by the absolute slot
+ *         number (ASN). Slotframes repeat a number of slots, and each
+ *         cell of a slotframe tells whether to transmit or listen in
+ *         one of its slots and on which channel offset. The channel
+ *         of a slot is taken from the hopping sequence with the ASN
+ *         and the channel offset.
+ *
+ *         A coordinator starts the network and all associated nodes
+ *         send enhanced beacons (EBs) carrying the ASN. Nodes join by
+ *         listening for an EB and then keep their slots aligned to
+ *         their time source, the EB sender or the RPL preferred
+ *         parent.
+ *
+ *         tschmac_driver and tschmac_rdc_driver must be used together
+ *         as NETSTACK_CONF_MAC and NETSTACK_CONF_RDC, with
+ *         framer_802154 as framer.
+ */
+
+#ifndef TSCHMAC_H_
+#define TSCHMAC_H_
+
+#include "contiki.h"
+#include "lib/list.h"
+#include "net/linkaddr.h"
+#include "net/mac/mac.h"
+#include "net/mac/rdc.h"
+
+/* Number of slotframes and cells */
+#ifdef TSCHMAC_CONF_MAX_SLOTFRAMES
+#define TSCHMAC_MAX_SLOTFRAMES TSCHMAC_CONF_MAX_SLOTFRAMES
+#else
+#define TSCHMAC_MAX_SLOTFRAMES 2
+#endif /* TSCHMAC_CONF_MAX_SLOTFRAMES */
+
+#ifdef TSCHMAC_CONF_MAX_CELLS
+#define TSCHMAC_MAX_CELLS TSCHMAC_CONF_MAX_CELLS
+#else
+#define TSCHMAC_MAX_CELLS 16
+#endif /* TSCHMAC_CONF_MAX_CELLS */
+
+/* Channels to hop over */
+#ifdef TSCHMAC_CONF_HOPPING_SEQUENCE
+#define TSCHMAC_HOPPING_SEQUENCE TSCHMAC_CONF_HOPPING_SEQUENCE
+#else
+#define TSCHMAC_HOPPING_SEQUENCE { 15, 25, 26, 20 }
+#endif /* TSCHMAC_CONF_HOPPING_SEQUENCE */
+
+/* With TSCHMAC_CONF_DEFAULT_SCHEDULE, tschmac installs a shared
+   slotframe of TSCHMAC_SHARED_SLOTFRAME_LENGTH slots with one shared
+   cell, and a slotframe of TSCHMAC_UNICAST_SLOTFRAME_LENGTH slots in
+   which every node has a receive cell. Nodes send unicast frames in
+   the receive cell of the neighbor, so that a parent in the
+   collection tree gets a slot of its own for its children. */
+#ifdef TSCHMAC_CONF_DEFAULT_SCHEDULE
+#define TSCHMAC_DEFAULT_SCHEDULE TSCHMAC_CONF_DEFAULT_SCHEDULE
+#else
+#define TSCHMAC_DEFAULT_SCHEDULE 1
+#endif /* TSCHMAC_CONF_DEFAULT_SCHEDULE */
+
+#ifdef TSCHMAC_CONF_SHARED_SLOTFRAME_LENGTH
+#define TSCHMAC_SHARED_SLOTFRAME_LENGTH TSCHMAC_CONF_SHARED_SLOTFRAME_LENGTH
+#else
+#define TSCHMAC_SHARED_SLOTFRAME_LENGTH 7
+#endif /* TSCHMAC_CONF_SHARED_SLOTFRAME_LENGTH */
+
+#ifdef TSCHMAC_CONF_UNICAST_SLOTFRAME_LENGTH
+#define TSCHMAC_UNICAST_SLOTFRAME_LENGTH TSCHMAC_CONF_UNICAST_SLOTFRAME_LENGTH
+#else
+#define TSCHMAC_UNICAST_SLOTFRAME_LENGTH 11
+#endif /* TSCHMAC_CONF_UNICAST_SLOTFRAME_LENGTH */
+
+/* Cell options */
+#define TSCHMAC_CELL_TX     0x01
+#define TSCHMAC_CELL_RX     0x02
+/* Shared transmit cells back off after failed transmissions */
+#define TSCHMAC_CELL_SHARED 0x04
+
+struct tschmac_cell {
+  struct tschmac_cell *next;
+  uint16_t timeslot;
+  uint8_t channel_offset;
+  uint8_t options;
+  /* Neighbor to transmit to, linkaddr_null for any neighbor without a
+     transmit cell of its own and for broadcast */
+  linkaddr_t addr;
+};
+
+struct tschmac_slotframe {
+  struct tschmac_slotframe *next;
+  uint16_t handle;
+  uint16_t size;
+  LIST_STRUCT(cells);
+};
+
+/* Slotframes are looked at in the order of their handles. In a slot,
+   a transmit cell with a packet to send comes before a receive cell. */
+struct tschmac_slotframe *tschmac_slotframe_add(uint16_t handle,
+                                                uint16_t size);
+struct tschmac_slotframe *tschmac_slotframe_get(uint16_t handle);
+struct tschmac_cell *tschmac_cell_add(struct tschmac_slotframe *sf,
+                                      uint16_t timeslot,
+                                      uint8_t channel_offset,
+                                      uint8_t options,
+                                      const linkaddr_t *addr);
+void tschmac_cell_remove(struct tschmac_slotframe *sf,
+                         struct tschmac_cell *cell);
+
+/* Start a network as its coordinator, or stop being one */
+void tschmac_set_coordinator(int enable);
+int tschmac_is_coordinator(void);
+int tschmac_is_associated(void);
+/* Keep the slots aligned to the frames received from this neighbor */
+void tschmac_set_time_source(const linkaddr_t *addr);
+
+/* Follows the RPL preferred parent, for RPL_CONF_CALLBACK_PARENT_SWITCH */
+struct rpl_parent;
+void tschmac_rpl_parent_switch(struct rpl_parent *old,
+                               struct rpl_parent *new);
+
+extern const struct mac_driver tschmac_driver;
+extern const struct rdc_driver tschmac_rdc_driver;
+
+#endif /* TSCHMAC_H_ */
@@ -62,6 +62,15 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+#if NBR_TABLE_HASH
+/* Hash index from link-layer address to neighbor index, using linear
+ * probing. Each slot holds a neighbor index, or HASH_EMPTY. */
+typedef uint16_t nbr_hash_slot_t;
+#define HASH_EMPTY ((nbr_hash_slot_t)~0)
+static nbr_hash_slot_t hash_index[NBR_TABLE_HASH_SIZE];
+static uint8_t hash_initialized;
+#endif /* NBR_TABLE_HASH */
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -105,16 +114,118 @@ key_from_item(nbr_table_t *table, const nbr_table_item_t *item)
   return key_from_index(index_from_item(table, item));
 }
 /*---------------------------------------------------------------------------*/
+#if NBR_TABLE_HASH
+/* Home slot of a link-layer address in the hash index */
+static int
+hash_slot(const linkaddr_t *lladdr)
+{
+  uint16_t h = 0;
+  int i;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    h = h * 31 + lladdr->u8[i];
+  }
+  return h % NBR_TABLE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_init(void)
+{
+  int i;
+  for(i = 0; i < NBR_TABLE_HASH_SIZE; i++) {
+    hash_index[i] = HASH_EMPTY;
+  }
+  hash_initialized = 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the slot holding a link-layer address, or -1 */
+static int
+hash_find(const linkaddr_t *lladdr)
+{
+  int slot;
+  int n;
+
+  if(!hash_initialized) {
+    return -1;
+  }
+  slot = hash_slot(lladdr);
+  for(n = 0; n < NBR_TABLE_HASH_SIZE; n++) {
+    if(hash_index[slot] == HASH_EMPTY) {
+      return -1;
+    }
+    if(linkaddr_cmp(lladdr, &key_from_index(hash_index[slot])->lladdr)) {
+      return slot;
+    }
+    slot = (slot + 1) % NBR_TABLE_HASH_SIZE;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Index a newly added neighbor key */
+static void
+hash_insert(nbr_table_key_t *key)
+{
+  int slot;
+
+  if(!hash_initialized) {
+    hash_init();
+  }
+  /* The index is larger than the number of neighbors, so a free slot
+   * always exists */
+  slot = hash_slot(&key->lladdr);
+  while(hash_index[slot] != HASH_EMPTY) {
+    slot = (slot + 1) % NBR_TABLE_HASH_SIZE;
+  }
+  hash_index[slot] = index_from_key(key);
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a neighbor key from the index. Entries after it in the probe
+ * sequence are shifted back so that no tombstones are needed. */
+static void
+hash_remove(nbr_table_key_t *key)
+{
+  int hole, slot, home;
+
+  hole = hash_find(&key->lladdr);
+  if(hole == -1) {
+    return;
+  }
+  slot = hole;
+  while(1) {
+    slot = (slot + 1) % NBR_TABLE_HASH_SIZE;
+    if(hash_index[slot] == HASH_EMPTY) {
+      break;
+    }
+    home = hash_slot(&key_from_index(hash_index[slot])->lladdr);
+    /* Leave the entry if its home slot lies cyclically in (hole, slot] */
+    if(hole <= slot ? (hole < home && home <= slot)
+                    : (hole < home || home <= slot)) {
+      continue;
+    }
+    hash_index[hole] = hash_index[slot];
+    hole = slot;
+  }
+  hash_index[hole] = HASH_EMPTY;
+}
+#endif /* NBR_TABLE_HASH */
+/*---------------------------------------------------------------------------*/
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const linkaddr_t *lladdr)
 {
+#if NBR_TABLE_HASH
+  int slot;
+#else /* NBR_TABLE_HASH */
   nbr_table_key_t *key;
+#endif /* NBR_TABLE_HASH */
   /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
    * Only one such entry is possible at a time, indexed by linkaddr_null. */
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
   }
+#if NBR_TABLE_HASH
+  slot = hash_find(lladdr);
+  return slot != -1 ? hash_index[slot] : -1;
+#else /* NBR_TABLE_HASH */
   key = list_head(nbr_table_keys);
   while(key != NULL) {
     if(lladdr && linkaddr_cmp(lladdr, &key->lladdr)) {
@@ -123,6 +234,7 @@ index_from_lladdr(const linkaddr_t *lladdr)
     key = list_item_next(key);
   }
   return -1;
+#endif /* NBR_TABLE_HASH */
 }
 /*---------------------------------------------------------------------------*/
 /* Get bit from "used" or "locked" bitmap */
@@ -156,6 +268,32 @@ nbr_set_bit(uint8_t *bitmap, nbr_table_t *table, nbr_table_item_t *item, int val
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+/* Remove a neighbor from all tables and free its key */
+static void
+remove_key(nbr_table_key_t *key)
+{
+  int i;
+
+  for(i = 0; i < MAX_NUM_TABLES; i++) {
+    if(all_tables[i] != NULL && all_tables[i]->callback != NULL) {
+      /* Call table callback for each table that uses this item */
+      nbr_table_item_t *removed_item = item_from_key(all_tables[i], key);
+      if(nbr_get_bit(used_map, all_tables[i], removed_item) == 1) {
+        all_tables[i]->callback(removed_item);
+      }
+    }
+  }
+  /* Empty used and locked maps */
+  used_map[index_from_key(key)] = 0;
+  locked_map[index_from_key(key)] = 0;
+  /* Remove neighbor from list */
+  list_remove(nbr_table_keys, key);
+#if NBR_TABLE_HASH
+  hash_remove(key);
+#endif /* NBR_TABLE_HASH */
+  memb_free(&neighbor_addr_mem, key);
+}
+/*---------------------------------------------------------------------------*/
 static nbr_table_key_t *
 nbr_table_allocate(void)
 {
@@ -204,22 +342,8 @@ nbr_table_allocate(void)
       return NULL;
     } else {
       /* Reuse least used item */
-      int i;
-      for(i = 0; i<MAX_NUM_TABLES; i++) {
-        if(all_tables[i] != NULL && all_tables[i]->callback != NULL) {
-          /* Call table callback for each table that uses this item */
-          nbr_table_item_t *removed_item = item_from_key(all_tables[i], least_used_key);
-          if(nbr_get_bit(used_map, all_tables[i], removed_item) == 1) {
-            all_tables[i]->callback(removed_item);
-          }
-        }
-      }
-      /* Empty used map */
-      used_map[index_from_key(least_used_key)] = 0;
-      /* Remove neighbor from list */
-      list_remove(nbr_table_keys, least_used_key);
-      /* Return associated key */
-      return least_used_key;
+      remove_key(least_used_key);
+      return memb_alloc(&neighbor_addr_mem);
     }
   }
 }
@@ -298,6 +422,9 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
 
     /* Set link-layer address */
     linkaddr_copy(&key->lladdr, lladdr);
+#if NBR_TABLE_HASH
+    hash_insert(key);
+#endif /* NBR_TABLE_HASH */
   }
 
   /* Get item in the current table */
@@ -318,6 +445,15 @@ nbr_table_get_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
   return nbr_get_bit(used_map, table, item) ? item : NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Get the item of a table for the same neighbor as an item of another
+   table. All tables share the neighbor index, so no search is needed. */
+void *
+nbr_table_get_from_item(nbr_table_t *table, nbr_table_t *from, const void *item)
+{
+  void *peer = item_from_index(table, index_from_item(from, item));
+  return nbr_get_bit(used_map, table, peer) ? peer : NULL;
+}
+/*---------------------------------------------------------------------------*/
 /* Removes a neighbor from the current table (unset "used" bit) */
 int
 nbr_table_remove(nbr_table_t *table, void *item)
@@ -348,3 +484,40 @@ nbr_table_get_lladdr(nbr_table_t *table, const void *item)
   nbr_table_key_t *key = key_from_item(table, item);
   return key != NULL ? &key->lladdr : NULL;
 }
+/*---------------------------------------------------------------------------*/
+/* Change the link-layer address of a neighbor. The address must not be
+   written in place, as the hash index locates the neighbor by it. */
+int
+nbr_table_update_lladdr(const linkaddr_t *old_addr, const linkaddr_t *new_addr,
+                        int remove_if_duplicate)
+{
+  int index;
+  int new_index;
+  nbr_table_key_t *key;
+
+  index = index_from_lladdr(old_addr);
+  if(index == -1) {
+    /* Nothing to change */
+    return 0;
+  }
+  new_index = index_from_lladdr(new_addr);
+  if(new_index == index) {
+    return 1;
+  }
+  key = key_from_index(index);
+  if(new_index != -1) {
+    /* Another neighbor already has the new address */
+    if(remove_if_duplicate) {
+      remove_key(key);
+    }
+    return 0;
+  }
+#if NBR_TABLE_HASH
+  hash_remove(key);
+#endif /* NBR_TABLE_HASH */
+  linkaddr_copy(&key->lladdr, new_addr);
+#if NBR_TABLE_HASH
+  hash_insert(key);
+#endif /* NBR_TABLE_HASH */
+  return 1;
+}
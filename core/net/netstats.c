@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Netstack statistics
+ */
+
+#include "net/netstats.h"
+#include "net/mac/mac.h"
+
+#include <string.h>
+
+#if NETSTATS_ENABLED
+struct netstats netstats;
+/*---------------------------------------------------------------------------*/
+void
+netstats_reset(void)
+{
+  memset(&netstats, 0, sizeof(netstats));
+}
+/*---------------------------------------------------------------------------*/
+void
+netstats_hist_add(struct netstats_hist *h, unsigned long value)
+{
+  uint8_t b;
+
+  for(b = 0; value != 0 && b < NETSTATS_HIST_BINS - 1; b++) {
+    value >>= 1;
+  }
+  if(h->bin[b] != 0xffff) {
+    h->bin[b]++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+netstats_rdc_tx(int status)
+{
+  netstats.rdc_tx++;
+  switch(status) {
+  case MAC_TX_OK:
+    netstats.rdc_tx_ok++;
+    break;
+  case MAC_TX_NOACK:
+    netstats.rdc_tx_noack++;
+    break;
+  case MAC_TX_COLLISION:
+    netstats.rdc_tx_collision++;
+    break;
+  default:
+    netstats.rdc_tx_err++;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* NETSTATS_ENABLED */
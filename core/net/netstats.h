@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Netstack statistics: per-layer counters, queue occupancy
+ *         histograms and MAC queueing latency.
+ *
+ *         The counters live in the global variable netstats, so a
+ *         simulator such as Cooja can read them straight from node
+ *         memory. The shell command netstats prints them.
+ */
+
+#ifndef NETSTATS_H_
+#define NETSTATS_H_
+
+#include "contiki-conf.h"
+
+#ifdef NETSTATS_CONF_ENABLED
+#define NETSTATS_ENABLED NETSTATS_CONF_ENABLED
+#else
+#define NETSTATS_ENABLED 0
+#endif
+
+/*
+ * Number of bins in each histogram. Bin 0 counts zero values, bin n
+ * counts values in [2^(n-1), 2^n) and the last bin also holds all
+ * larger values.
+ */
+#ifdef NETSTATS_CONF_HIST_BINS
+#define NETSTATS_HIST_BINS NETSTATS_CONF_HIST_BINS
+#else
+#define NETSTATS_HIST_BINS 16
+#endif
+
+struct netstats_hist {
+  uint16_t bin[NETSTATS_HIST_BINS];
+};
+
+struct netstats {
+  /* tcpip: packets from and to uIP */
+  unsigned long ip_in, ip_out,
+    ip_noroute, /* Off-link destination without route or default route */
+    ip_ndwait,  /* Packet held back or dropped during address resolution */
+    ip_drop;
+
+  /* sicslowpan */
+  unsigned long lowpan_in, lowpan_out,
+    lowpan_frag_in, lowpan_frag_out,
+    lowpan_reass_ok,
+    lowpan_reass_timeout, /* Datagram incomplete after SICSLOWPAN_REASS_MAXAGE */
+    lowpan_reass_evict,   /* Context taken over by a new datagram */
+    lowpan_frag_fwd,      /* Fragment relayed without reassembly */
+    lowpan_hc_saved,      /* IP and UDP header bytes saved by IPHC */
+    lowpan_hc_cache_hit, lowpan_hc_cache_miss,
+    lowpan_ghc_in,
+    /* Payload bytes saved by GHC, per message type */
+    lowpan_ghc_saved_rpl, lowpan_ghc_saved_nd, lowpan_ghc_saved_icmp,
+    lowpan_ghc_saved_udp,
+    lowpan_drop;
+
+  /* csma */
+  unsigned long mac_enqueue,
+    mac_queue_full, /* No neighbor, queue or buffer space left */
+    mac_retx,
+    mac_tx_ok,
+    mac_tx_fail;    /* Dropped after the last allowed transmission */
+
+  /* Radio duty cycling layer, one count per transmission attempt */
+  unsigned long rdc_tx, rdc_tx_ok, rdc_tx_noack, rdc_tx_collision,
+    rdc_tx_err, rdc_rx,
+    rdc_tx_burst;   /* Sent to a receiver kept awake by FRAME_PENDING */
+
+  /* queuebuf */
+  unsigned long qbuf_alloc, qbuf_alloc_fail;
+
+  /* phase, wake-ups observed where the drift estimate predicted one */
+  unsigned long phase_predict;
+
+  /* Packets queued for the neighbor, sampled on each MAC enqueue */
+  struct netstats_hist mac_queue;
+  /* Queuebufs in use, sampled on each allocation */
+  struct netstats_hist qbuf_used;
+  /* rtimer ticks from MAC enqueue until the packet is sent */
+  struct netstats_hist mac_latency;
+  /* rtimer ticks between predicted and observed wake-ups */
+  struct netstats_hist phase_error;
+};
+
+#if NETSTATS_ENABLED
+/* Read with NETSTATS_GET, update with the macros below */
+extern struct netstats netstats;
+
+void netstats_reset(void);
+void netstats_hist_add(struct netstats_hist *h, unsigned long value);
+void netstats_rdc_tx(int status);
+
+#define NETSTATS_ADD(x) netstats.x++
+#define NETSTATS_SUM(x, n) netstats.x += (n)
+#define NETSTATS_GET(x) netstats.x
+#define NETSTATS_HIST(h, v) netstats_hist_add(&netstats.h, (v))
+#define NETSTATS_RDC_TX(status) netstats_rdc_tx(status)
+#else /* NETSTATS_ENABLED */
+#define NETSTATS_ADD(x)
+#define NETSTATS_SUM(x, n)
+#define NETSTATS_GET(x) 0
+#define NETSTATS_HIST(h, v)
+#define NETSTATS_RDC_TX(status)
+#endif /* NETSTATS_ENABLED */
+
+#endif /* NETSTATS_H_ */
@@ -51,6 +51,10 @@
 struct packetbuf_attr packetbuf_attrs[PACKETBUF_NUM_ATTRS];
 struct packetbuf_addr packetbuf_addrs[PACKETBUF_NUM_ADDRS];
 
+#if PACKETBUF_STATS
+struct packetbuf_stats packetbuf_stats;
+#endif /* PACKETBUF_STATS */
+
 
 static uint16_t buflen, bufptr;
 static uint8_t hdrptr;
@@ -98,6 +102,10 @@ packetbuf_copyfrom(const void *from, uint16_t len)
   l = len > PACKETBUF_SIZE? PACKETBUF_SIZE: len;
   memcpy(packetbufptr, from, l);
   buflen = l;
+#if PACKETBUF_STATS
+  packetbuf_stats.copyfrom++;
+  packetbuf_stats.bytes += l;
+#endif /* PACKETBUF_STATS */
   return l;
 }
 /*---------------------------------------------------------------------------*/
@@ -162,6 +170,10 @@ packetbuf_copyto(void *to)
   memcpy(to, packetbuf + hdrptr, PACKETBUF_HDR_SIZE - hdrptr);
   memcpy((uint8_t *)to + PACKETBUF_HDR_SIZE - hdrptr, packetbufptr + bufptr,
 	 buflen);
+#if PACKETBUF_STATS
+  packetbuf_stats.copyto++;
+  packetbuf_stats.bytes += PACKETBUF_HDR_SIZE - hdrptr + buflen;
+#endif /* PACKETBUF_STATS */
   return PACKETBUF_HDR_SIZE - hdrptr + buflen;
 }
 /*---------------------------------------------------------------------------*/
@@ -80,6 +80,32 @@
 #define PACKETBUF_WITH_PACKET_TYPE NETSTACK_CONF_WITH_RIME
 #endif
 
+#ifdef PACKETBUF_CONF_STATS
+#define PACKETBUF_STATS PACKETBUF_CONF_STATS
+#else
+#define PACKETBUF_STATS 0
+#endif
+
+#if PACKETBUF_STATS
+/**
+ * \brief      Counters of whole-frame copies into and out of the packetbuf
+ *
+ *             copyfrom and copyto count the calls to
+ *             packetbuf_copyfrom() and packetbuf_copyto(), bytes the
+ *             total number of bytes moved by them. Every queuebuf
+ *             enqueue and dequeue goes through one of the two, so
+ *             the counters show how often a frame is copied on its
+ *             way through the stack.
+ */
+struct packetbuf_stats {
+  uint32_t copyfrom;
+  uint32_t copyto;
+  uint32_t bytes;
+};
+
+extern struct packetbuf_stats packetbuf_stats;
+#endif /* PACKETBUF_STATS */
+
 /**
  * \brief      Clear and reset the packetbuf
  *
@@ -297,6 +323,10 @@ struct packetbuf_addr {
 #define PACKETBUF_ATTR_PACKET_TYPE_STREAM_END 3
 #define PACKETBUF_ATTR_PACKET_TYPE_TIMESTAMP 4
 
+#define PACKETBUF_ATTR_TRAFFIC_CLASS_DATA    0
+#define PACKETBUF_ATTR_TRAFFIC_CLASS_CONTROL 1
+#define PACKETBUF_NUM_TRAFFIC_CLASSES        2
+
 enum {
   PACKETBUF_ATTR_NONE,
 
@@ -313,6 +343,10 @@ enum {
   PACKETBUF_ATTR_MAC_SEQNO,
   PACKETBUF_ATTR_MAC_ACK,
   PACKETBUF_ATTR_IS_CREATED_AND_SECURED,
+  PACKETBUF_ATTR_TRAFFIC_CLASS,
+  /* Frames of a fragmented datagram still to be sent, this one
+     included, or 0 */
+  PACKETBUF_ATTR_FRAGMENTS,
   
   /* Scope 1 attributes: used between two neighbors only. */
 #if PACKETBUF_WITH_PACKET_TYPE
@@ -327,6 +361,7 @@ enum {
 #endif /* NETSTACK_CONF_WITH_RIME */
   PACKETBUF_ATTR_PENDING,
   PACKETBUF_ATTR_FRAME_TYPE,
+  PACKETBUF_ATTR_WAKEUP_LEVEL,
 #if LLSEC802154_SECURITY_LEVEL
   PACKETBUF_ATTR_SECURITY_LEVEL,
   PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1,
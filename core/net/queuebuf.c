@@ -43,6 +43,7 @@
  */
 
 #include "contiki-net.h"
+#include "net/netstats.h"
 
 #if WITH_SWAP
 #include "cfs/cfs.h"
@@ -334,6 +335,7 @@ queuebuf_new_from_packetbuf(void)
     if(buf->ram_ptr == NULL) {
       PRINTF("queuebuf_new_from_packetbuf: could not queuebuf data\n");
       memb_free(&bufmem, buf);
+      NETSTATS_ADD(qbuf_alloc_fail);
       return NULL;
     }
     buframptr = buf->ram_ptr;
@@ -359,9 +361,12 @@ queuebuf_new_from_packetbuf(void)
       queuebuf_max_len = queuebuf_len;
     }
 #endif /* QUEUEBUF_STATS */
+    NETSTATS_ADD(qbuf_alloc);
+    NETSTATS_HIST(qbuf_used, QUEUEBUF_NUM - memb_numfree(&bufmem));
 
   } else {
     PRINTF("queuebuf_new_from_packetbuf: could not allocate a queuebuf\n");
+    NETSTATS_ADD(qbuf_alloc_fail);
   }
   return buf;
 }
@@ -77,6 +77,44 @@
 #endif
 #endif /* RPL_CONF_OF */
 
+/*
+ * The objective functions linked into the system image. A node joins
+ * DAGs that advertise any of them, and a root can switch between them
+ * at run time with rpl_set_of(). The list must contain RPL_OF, which
+ * is used until rpl_set_of() is called.
+ */
+#ifdef RPL_CONF_SUPPORTED_OFS
+#define RPL_SUPPORTED_OFS RPL_CONF_SUPPORTED_OFS
+#else
+#define RPL_SUPPORTED_OFS { &RPL_OF }
+#endif /* RPL_CONF_SUPPORTED_OFS */
+
+/* The objective code point of the composite objective function. */
+#ifdef RPL_CONF_OF_COMPOSITE_OCP
+#define RPL_OF_COMPOSITE_OCP RPL_CONF_OF_COMPOSITE_OCP
+#else
+#define RPL_OF_COMPOSITE_OCP 0xfe
+#endif /* RPL_CONF_OF_COMPOSITE_OCP */
+
+/*
+ * With RPL_CONF_MULTIPATH, upward traffic that would go to the preferred
+ * parent is spread over all parents with a lower rank, weighted by link
+ * ETX and by the number of packets already queued for each parent.
+ * Parents whose rank through them would exceed our own by more than
+ * RPL_MULTIPATH_RANK_TOLERANCE are not used.
+ */
+#ifdef RPL_CONF_MULTIPATH
+#define RPL_MULTIPATH RPL_CONF_MULTIPATH
+#else
+#define RPL_MULTIPATH 0
+#endif /* RPL_CONF_MULTIPATH */
+
+#ifdef RPL_CONF_MULTIPATH_RANK_TOLERANCE
+#define RPL_MULTIPATH_RANK_TOLERANCE RPL_CONF_MULTIPATH_RANK_TOLERANCE
+#else
+#define RPL_MULTIPATH_RANK_TOLERANCE RPL_MIN_HOPRANKINC
+#endif /* RPL_CONF_MULTIPATH_RANK_TOLERANCE */
+
 /* This value decides which DAG instance we should participate in by default. */
 #ifdef RPL_CONF_DEFAULT_INSTANCE
 #define RPL_DEFAULT_INSTANCE RPL_CONF_DEFAULT_INSTANCE
@@ -291,4 +329,13 @@
     + random_rand() % (RPL_PROBING_INTERVAL))
 #endif
 
+/*
+ * Function called with the old and the new preferred parent whenever
+ * the preferred parent changes, e.g. to let a TSCH MAC follow it:
+ * #define RPL_CONF_CALLBACK_PARENT_SWITCH tschmac_rpl_parent_switch
+ * */
+#ifdef RPL_CONF_CALLBACK_PARENT_SWITCH
+#define RPL_CALLBACK_PARENT_SWITCH RPL_CONF_CALLBACK_PARENT_SWITCH
+#endif
+
 #endif /* RPL_CONF_H */
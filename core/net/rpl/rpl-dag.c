@@ -49,6 +49,7 @@
 #include "net/ipv6/uip-nd6.h"
 #include "net/ipv6/uip-ds6-nbr.h"
 #include "net/nbr-table.h"
+#include "net/mac/csma.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
 #include "lib/list.h"
 #include "lib/memb.h"
@@ -62,7 +63,10 @@
 
 /*---------------------------------------------------------------------------*/
 extern rpl_of_t RPL_OF;
-static rpl_of_t * const objective_functions[] = {&RPL_OF};
+static rpl_of_t * const objective_functions[] = RPL_SUPPORTED_OFS;
+
+/* The objective function used for DAGs that this node roots. */
+static rpl_of_t *root_of = &RPL_OF;
 
 /*---------------------------------------------------------------------------*/
 /* RPL definitions. */
@@ -101,6 +105,10 @@ rpl_print_neighbor_list()
           default_instance->of->calculate_rank(p, 0),
           p == default_instance->current_dag->preferred_parent ? '*' : ' ',
           (unsigned)((now - p->last_tx_time) / (60 * CLOCK_SECOND)));
+#if RPL_MULTIPATH
+      printf("RPL: nbr %3u forwarded %u\n",
+          nbr_table_get_lladdr(rpl_parents, p)->u8[7], p->mp_tx);
+#endif /* RPL_MULTIPATH */
       p = nbr_table_next(rpl_parents, p);
     }
     printf("RPL: end of list\n");
@@ -191,6 +199,9 @@ rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
      * neighbor table. */
     nbr_table_unlock(rpl_parents, dag->preferred_parent);
     nbr_table_lock(rpl_parents, p);
+#ifdef RPL_CALLBACK_PARENT_SWITCH
+    RPL_CALLBACK_PARENT_SWITCH(dag->preferred_parent, p);
+#endif
     dag->preferred_parent = p;
   }
 }
@@ -330,7 +341,7 @@ rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id)
   dag->grounded = RPL_GROUNDED;
   dag->preference = RPL_PREFERENCE;
   instance->mop = RPL_MOP_DEFAULT;
-  instance->of = &RPL_OF;
+  instance->of = root_of;
   rpl_set_preferred_parent(dag, NULL);
 
   memcpy(&dag->dag_id, dag_id, sizeof(dag->dag_id));
@@ -392,6 +403,40 @@ rpl_repair_root(uint8_t instance_id)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+int
+rpl_set_of(rpl_ocp_t ocp)
+{
+  rpl_instance_t *instance, *end;
+  rpl_of_t *of;
+
+  of = rpl_find_of(ocp);
+  if(of == NULL) {
+    PRINTF("RPL: Objective function %u is not supported\n", ocp);
+    return 0;
+  }
+  root_of = of;
+
+  /* Move the DAGs we are root of to the new objective function. The
+     global repair carries the new OCP to the rest of the network. */
+  for(instance = &instance_table[0], end = instance + RPL_MAX_INSTANCES;
+      instance < end; ++instance) {
+    if(instance->used && instance->of != of &&
+       instance->current_dag->rank == ROOT_RANK(instance)) {
+      instance->of = of;
+      of->reset(instance->current_dag);
+      of->update_metric_container(instance);
+      rpl_repair_root(instance->instance_id);
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+rpl_of_t *
+rpl_get_of(void)
+{
+  return root_of;
+}
+/*---------------------------------------------------------------------------*/
 static void
 set_ip_from_prefix(uip_ipaddr_t *ipaddr, rpl_prefix_t *prefix)
 {
@@ -635,6 +680,10 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
       p->dag = dag;
       p->rank = dio->rank;
       p->dtsn = dio->dtsn;
+#if RPL_MULTIPATH
+      p->mp_credit = 0;
+      p->mp_tx = 0;
+#endif /* RPL_MULTIPATH */
       
       /* Check whether we have a neighbor that has not gotten a link metric yet */
       if(nbr != NULL && nbr->link_metric == 0) {
@@ -806,6 +855,82 @@ best_parent(rpl_dag_t *dag)
   return best;
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_MULTIPATH
+/* Forwarding weight of a parent, or 0 if it must not be used. */
+static int
+multipath_weight(rpl_dag_t *dag, rpl_parent_t *p)
+{
+  rpl_instance_t *instance = dag->instance;
+  uip_ds6_nbr_t *nbr;
+  uint32_t cost;
+
+  /* Only parents with a strictly lower rank are loop free. */
+  if(p->dag != dag || p->rank == INFINITE_RANK ||
+     DAG_RANK(p->rank, instance) >= DAG_RANK(dag->rank, instance)) {
+    return 0;
+  }
+  if(p != dag->preferred_parent &&
+     (uint32_t)instance->of->calculate_rank(p, 0) >
+     (uint32_t)dag->rank + RPL_MULTIPATH_RANK_TOLERANCE) {
+    return 0;
+  }
+  nbr = rpl_get_nbr(p);
+  if(nbr == NULL) {
+    return 0;
+  }
+
+  cost = nbr->link_metric != 0 ? nbr->link_metric : RPL_DAG_MC_ETX_DIVISOR;
+  cost *= 1 + csma_queue_length(nbr_table_get_lladdr(rpl_parents, p));
+  /* A perfect, idle link gets a weight of 64. */
+  return 64UL * RPL_DAG_MC_ETX_DIVISOR / cost + 1;
+}
+#endif /* RPL_MULTIPATH */
+/*---------------------------------------------------------------------------*/
+uip_ipaddr_t *
+rpl_multipath_nexthop(uip_ipaddr_t *defrt)
+{
+#if RPL_MULTIPATH
+  rpl_dag_t *dag;
+  rpl_parent_t *p, *best;
+  int w, total;
+
+  if(default_instance == NULL ||
+     (dag = default_instance->current_dag) == NULL ||
+     dag->preferred_parent == NULL ||
+     !uip_ipaddr_cmp(defrt, rpl_get_parent_ipaddr(dag->preferred_parent))) {
+    return defrt;
+  }
+
+  /* Smooth weighted round-robin over the usable parents. */
+  best = NULL;
+  total = 0;
+  for(p = nbr_table_head(rpl_parents); p != NULL;
+      p = nbr_table_next(rpl_parents, p)) {
+    w = multipath_weight(dag, p);
+    if(w == 0) {
+      p->mp_credit = 0;
+      continue;
+    }
+    p->mp_credit += w;
+    total += w;
+    if(best == NULL || p->mp_credit > best->mp_credit) {
+      best = p;
+    }
+  }
+  if(best == NULL) {
+    return defrt;
+  }
+  best->mp_credit -= total;
+  best->mp_tx++;
+  if(best != dag->preferred_parent) {
+    RPL_STAT(rpl_stats.multipath_alt++);
+  }
+  return rpl_get_parent_ipaddr(best);
+#else /* RPL_MULTIPATH */
+  return defrt;
+#endif /* RPL_MULTIPATH */
+}
+/*---------------------------------------------------------------------------*/
 rpl_parent_t *
 rpl_select_parent(rpl_dag_t *dag)
 {
@@ -1113,6 +1238,7 @@ static void
 global_repair(uip_ipaddr_t *from, rpl_dag_t *dag, rpl_dio_t *dio)
 {
   rpl_parent_t *p;
+  rpl_of_t *of;
 
   remove_parents(dag, 0);
   dag->version = dio->version;
@@ -1124,6 +1250,15 @@ global_repair(uip_ipaddr_t *from, rpl_dag_t *dag, rpl_dio_t *dio)
   dag->instance->default_lifetime = dio->default_lifetime;
   dag->instance->lifetime_unit = dio->lifetime_unit;
 
+  /* The root may have switched to another objective function. */
+  of = rpl_find_of(dio->ocp);
+  if(of != NULL) {
+    dag->instance->of = of;
+  } else {
+    PRINTF("RPL: DIO OCP %u not supported, keeping the current OF\n",
+           dio->ocp);
+  }
+
   dag->instance->of->reset(dag);
   dag->min_rank = INFINITE_RANK;
   RPL_LOLLIPOP_INCREMENT(dag->instance->dtsn_out);
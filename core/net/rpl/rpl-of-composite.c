@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A composite objective function. The rank increase towards a
+ *         parent is a weighted sum of the link ETX, a per-hop cost and
+ *         the number of packets queued in the MAC layer for that
+ *         parent. A node also adds a cost for its own radio duty cycle
+ *         (from energest) to the rank it advertises, so that children
+ *         prefer parents that have spent less energy.
+ *
+ *         The weights can be changed at run time with
+ *         rpl_of_composite_set_weights().
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+#include "net/rpl/rpl-private.h"
+#include "net/mac/csma.h"
+#include "net/nbr-table.h"
+#include "sys/energest.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+static void reset(rpl_dag_t *);
+static void neighbor_link_callback(rpl_parent_t *, int, int);
+static rpl_parent_t *best_parent(rpl_parent_t *, rpl_parent_t *);
+static rpl_dag_t *best_dag(rpl_dag_t *, rpl_dag_t *);
+static rpl_rank_t calculate_rank(rpl_parent_t *, rpl_rank_t);
+static void update_metric_container(rpl_instance_t *);
+
+rpl_of_t rpl_of_composite = {
+  reset,
+  neighbor_link_callback,
+  best_parent,
+  best_dag,
+  calculate_rank,
+  update_metric_container,
+  RPL_OF_COMPOSITE_OCP
+};
+
+/* Default weights, in units of 1/RPL_OF_COMPOSITE_WEIGHT_SCALE */
+#ifdef RPL_CONF_OF_COMPOSITE_WEIGHT_ETX
+#define WEIGHT_ETX RPL_CONF_OF_COMPOSITE_WEIGHT_ETX
+#else
+#define WEIGHT_ETX 8
+#endif /* RPL_CONF_OF_COMPOSITE_WEIGHT_ETX */
+
+#ifdef RPL_CONF_OF_COMPOSITE_WEIGHT_HOP
+#define WEIGHT_HOP RPL_CONF_OF_COMPOSITE_WEIGHT_HOP
+#else
+#define WEIGHT_HOP 2
+#endif /* RPL_CONF_OF_COMPOSITE_WEIGHT_HOP */
+
+#ifdef RPL_CONF_OF_COMPOSITE_WEIGHT_QUEUE
+#define WEIGHT_QUEUE RPL_CONF_OF_COMPOSITE_WEIGHT_QUEUE
+#else
+#define WEIGHT_QUEUE 4
+#endif /* RPL_CONF_OF_COMPOSITE_WEIGHT_QUEUE */
+
+#ifdef RPL_CONF_OF_COMPOSITE_WEIGHT_ENERGY
+#define WEIGHT_ENERGY RPL_CONF_OF_COMPOSITE_WEIGHT_ENERGY
+#else
+#define WEIGHT_ENERGY 4
+#endif /* RPL_CONF_OF_COMPOSITE_WEIGHT_ENERGY */
+
+/* Reject parents that have a higher path cost than the following. */
+#define MAX_PATH_COST			100
+
+/*
+ * The path cost must differ more than 1/PARENT_SWITCH_THRESHOLD_DIV of
+ * an ETX in order to switch preferred parent. The queue term changes
+ * with every packet, so this keeps the parent from flapping.
+ */
+#define PARENT_SWITCH_THRESHOLD_DIV	2
+
+static struct rpl_of_composite_weights weights = {
+  WEIGHT_ETX, WEIGHT_HOP, WEIGHT_QUEUE, WEIGHT_ENERGY
+};
+
+typedef uint32_t rpl_path_metric_t;
+
+/*---------------------------------------------------------------------------*/
+void
+rpl_of_composite_set_weights(const struct rpl_of_composite_weights *w)
+{
+  weights = *w;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_of_composite_get_weights(struct rpl_of_composite_weights *w)
+{
+  *w = weights;
+}
+/*---------------------------------------------------------------------------*/
+/* The cost of using parent p as the next hop, without its rank. */
+static rpl_path_metric_t
+link_cost(rpl_parent_t *p, uip_ds6_nbr_t *nbr)
+{
+  rpl_path_metric_t cost;
+  linkaddr_t *lladdr;
+
+  cost = (rpl_path_metric_t)weights.etx * nbr->link_metric;
+  cost += (rpl_path_metric_t)weights.hop * p->dag->instance->min_hoprankinc;
+
+  lladdr = nbr_table_get_lladdr(rpl_parents, p);
+  if(lladdr != NULL && weights.queue != 0) {
+    cost += (rpl_path_metric_t)weights.queue *
+      csma_queue_length(lladdr) * RPL_DAG_MC_ETX_DIVISOR;
+  }
+
+  return cost / RPL_OF_COMPOSITE_WEIGHT_SCALE;
+}
+/*---------------------------------------------------------------------------*/
+/* The cost this node adds for its own energy use. */
+static rpl_path_metric_t
+node_cost(void)
+{
+#if ENERGEST_CONF_ON
+  unsigned long on, total;
+
+  if(weights.energy == 0) {
+    return 0;
+  }
+
+  on = energest_type_time(ENERGEST_TYPE_LISTEN) +
+    energest_type_time(ENERGEST_TYPE_TRANSMIT);
+  total = energest_type_time(ENERGEST_TYPE_CPU) +
+    energest_type_time(ENERGEST_TYPE_LPM);
+  if(total == 0) {
+    return 0;
+  }
+  /* Scale down until the multiplication below cannot overflow. */
+  while(total > 0xffffUL) {
+    on >>= 1;
+    total >>= 1;
+  }
+  if(on > total) {
+    on = total;
+  }
+
+  /* An always-on radio costs one ETX at a weight of one. */
+  return (rpl_path_metric_t)weights.energy * on * RPL_DAG_MC_ETX_DIVISOR /
+    total / RPL_OF_COMPOSITE_WEIGHT_SCALE;
+#else /* ENERGEST_CONF_ON */
+  return 0;
+#endif /* ENERGEST_CONF_ON */
+}
+/*---------------------------------------------------------------------------*/
+static rpl_path_metric_t
+calculate_path_metric(rpl_parent_t *p)
+{
+  uip_ds6_nbr_t *nbr;
+
+  if(p == NULL || (nbr = rpl_get_nbr(p)) == NULL) {
+    return MAX_PATH_COST * RPL_DAG_MC_ETX_DIVISOR;
+  }
+  return p->rank + link_cost(p, nbr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+reset(rpl_dag_t *dag)
+{
+  PRINTF("RPL: Reset composite OF\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+neighbor_link_callback(rpl_parent_t *p, int status, int numtx)
+{
+  /* The ETX estimate is maintained the same way as in MRHOF. */
+  rpl_mrhof.neighbor_link_callback(p, status, numtx);
+}
+/*---------------------------------------------------------------------------*/
+static rpl_rank_t
+calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
+{
+  rpl_path_metric_t rank_increase;
+  uip_ds6_nbr_t *nbr;
+
+  if(p == NULL || (nbr = rpl_get_nbr(p)) == NULL) {
+    if(base_rank == 0) {
+      return INFINITE_RANK;
+    }
+    rank_increase = RPL_INIT_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
+  } else {
+    rank_increase = link_cost(p, nbr);
+    if(base_rank == 0) {
+      base_rank = p->rank;
+    }
+  }
+  rank_increase += node_cost();
+
+  /* The rank must increase by at least one hop to avoid loops. */
+  if(p != NULL && rank_increase < p->dag->instance->min_hoprankinc) {
+    rank_increase = p->dag->instance->min_hoprankinc;
+  }
+
+  if(INFINITE_RANK - base_rank < rank_increase) {
+    return INFINITE_RANK;
+  }
+  return base_rank + rank_increase;
+}
+/*---------------------------------------------------------------------------*/
+static rpl_dag_t *
+best_dag(rpl_dag_t *d1, rpl_dag_t *d2)
+{
+  if(d1->grounded != d2->grounded) {
+    return d1->grounded ? d1 : d2;
+  }
+
+  if(d1->preference != d2->preference) {
+    return d1->preference > d2->preference ? d1 : d2;
+  }
+
+  return d1->rank < d2->rank ? d1 : d2;
+}
+/*---------------------------------------------------------------------------*/
+static rpl_parent_t *
+best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
+{
+  rpl_dag_t *dag;
+  rpl_path_metric_t min_diff;
+  rpl_path_metric_t p1_metric;
+  rpl_path_metric_t p2_metric;
+
+  dag = p1->dag; /* Both parents are in the same DAG. */
+
+  min_diff = RPL_DAG_MC_ETX_DIVISOR / PARENT_SWITCH_THRESHOLD_DIV;
+
+  p1_metric = calculate_path_metric(p1);
+  p2_metric = calculate_path_metric(p2);
+
+  /* Maintain stability of the preferred parent in case of similar costs. */
+  if(p1 == dag->preferred_parent || p2 == dag->preferred_parent) {
+    if(p1_metric < p2_metric + min_diff &&
+       p1_metric + min_diff > p2_metric) {
+      PRINTF("RPL: composite OF hysteresis: %lu ~ %lu\n",
+             (unsigned long)p1_metric, (unsigned long)p2_metric);
+      return dag->preferred_parent;
+    }
+  }
+
+  return p1_metric < p2_metric ? p1 : p2;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_metric_container(rpl_instance_t *instance)
+{
+  /* The composite cost is carried in the rank only. */
+  instance->mc.type = RPL_DAG_MC_NONE;
+}
+/*---------------------------------------------------------------------------*/
+/** @}*/
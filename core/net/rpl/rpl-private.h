@@ -246,6 +246,7 @@ struct rpl_stats {
   uint16_t loop_errors;
   uint16_t loop_warnings;
   uint16_t root_repairs;
+  uint16_t multipath_alt;
 };
 typedef struct rpl_stats rpl_stats_t;
 
@@ -321,6 +322,10 @@ void rpl_reset_periodic_timer(void);
 /* Route poisoning. */
 void rpl_poison_routes(rpl_dag_t *, rpl_parent_t *);
 
+#ifdef RPL_CALLBACK_PARENT_SWITCH
+void RPL_CALLBACK_PARENT_SWITCH(rpl_parent_t *old, rpl_parent_t *new);
+#endif
+
 
 rpl_instance_t *rpl_get_default_instance(void);
 
@@ -334,7 +334,8 @@ rpl_print_stats(void)
 			"forward_erros: %d\n"
 			"loop_errors: %d\n"
 			"loop_warnings: %d\n"
-			"root_repairs: %d\n",
+			"root_repairs: %d\n"
+			"multipath_alt: %d\n",
 			rpl_stats.mem_overflows,
 			rpl_stats.local_repairs,
 			rpl_stats.global_repairs,
@@ -344,7 +345,8 @@ rpl_print_stats(void)
 			rpl_stats.forward_errors,
 			rpl_stats.loop_errors,
 			rpl_stats.loop_warnings,
-			rpl_stats.root_repairs
+			rpl_stats.root_repairs,
+			rpl_stats.multipath_alt
 			);
 	PRINTF("=====================\n");
 }
@@ -115,6 +115,10 @@ struct rpl_parent {
 #endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
   rpl_rank_t rank;
   clock_time_t last_tx_time;
+#if RPL_MULTIPATH
+  int16_t mp_credit;  /* Weighted round-robin credit */
+  uint16_t mp_tx;     /* Packets forwarded through this parent */
+#endif /* RPL_MULTIPATH */
   uint8_t dtsn;
   uint8_t flags;
 };
@@ -195,6 +199,27 @@ typedef struct rpl_of rpl_of_t;
 
 /* Declare the selected objective function. */
 extern rpl_of_t RPL_OF;
+
+/* Objective functions that can be listed in RPL_CONF_SUPPORTED_OFS. */
+extern rpl_of_t rpl_of0;
+extern rpl_of_t rpl_mrhof;
+extern rpl_of_t rpl_of_composite;
+
+/*
+ * Weights of the composite objective function, in units of
+ * 1/RPL_OF_COMPOSITE_WEIGHT_SCALE. A weight of zero disables a term.
+ */
+#define RPL_OF_COMPOSITE_WEIGHT_SCALE 8
+
+struct rpl_of_composite_weights {
+  uint8_t etx;     /* Link ETX */
+  uint8_t hop;     /* Minimum rank increase per hop */
+  uint8_t queue;   /* Packets queued in the MAC for the parent */
+  uint8_t energy;  /* Radio duty cycle of this node */
+};
+
+void rpl_of_composite_set_weights(const struct rpl_of_composite_weights *w);
+void rpl_of_composite_get_weights(struct rpl_of_composite_weights *w);
 /*---------------------------------------------------------------------------*/
 /* Instance */
 struct rpl_instance {
@@ -240,6 +265,9 @@ void uip_rpl_input(void);
 rpl_dag_t *rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id);
 int rpl_set_prefix(rpl_dag_t *dag, uip_ipaddr_t *prefix, unsigned len);
 int rpl_repair_root(uint8_t instance_id);
+int rpl_set_of(rpl_ocp_t ocp);
+uip_ipaddr_t *rpl_multipath_nexthop(uip_ipaddr_t *defrt);
+rpl_of_t *rpl_get_of(void);
 int rpl_set_default_route(rpl_instance_t *instance, uip_ipaddr_t *from);
 rpl_dag_t *rpl_get_any_dag(void);
 rpl_instance_t *rpl_get_instance(uint8_t instance_id);
@@ -54,6 +54,201 @@ static clock_time_t next_expiration;
 
 PROCESS(etimer_process, "Event timer");
 /*---------------------------------------------------------------------------*/
+#if ETIMER_CONF_HEAP
+/*
+ * With ETIMER_CONF_HEAP, timerlist is the root of a pairing heap
+ * ordered by expiration time. Children of a node are linked through
+ * the next pointer; the prev pointer of a node points to its left
+ * sibling, or to its parent for the first child. The root is the only
+ * node on the heap with a NULL prev pointer.
+ */
+
+/* Expiration times are compared relative to each other, which is
+   correct as long as pending timers expire within half the clock
+   range of each other, the same assumption that timer_expired()
+   makes. */
+#define EXPIRATION(t) ((t)->timer.start + (t)->timer.interval)
+#define EXPIRES_BEFORE(a, b)                                   \
+  ((clock_time_t)(EXPIRATION(a) - EXPIRATION(b)) >              \
+   ((clock_time_t)~(clock_time_t)0 >> 1))
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Meld two heaps and return the new root. The next and prev pointers
+ * of the returned root are left for the caller to set.
+ */
+static struct etimer *
+meld(struct etimer *a, struct etimer *b)
+{
+  struct etimer *tmp;
+
+  if(a == NULL) {
+    return b;
+  }
+  if(b == NULL) {
+    return a;
+  }
+  if(EXPIRES_BEFORE(b, a)) {
+    tmp = a;
+    a = b;
+    b = tmp;
+  }
+  b->prev = a;
+  b->next = a->child;
+  if(a->child != NULL) {
+    a->child->prev = b;
+  }
+  a->child = b;
+  return a;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Standard two-pass pairing of a list of sibling heaps: meld them
+ * pairwise from left to right, then meld the pairs from right to
+ * left.
+ */
+static struct etimer *
+merge_pairs(struct etimer *first)
+{
+  struct etimer *a, *b, *pairs, *root;
+
+  pairs = NULL;
+  while(first != NULL) {
+    a = first;
+    b = a->next;
+    if(b == NULL) {
+      first = NULL;
+    } else {
+      first = b->next;
+      a = meld(a, b);
+    }
+    a->prev = NULL;
+    a->next = pairs;
+    pairs = a;
+  }
+
+  root = NULL;
+  while(pairs != NULL) {
+    a = pairs;
+    pairs = a->next;
+    a->next = NULL;
+    root = meld(root, a);
+  }
+  if(root != NULL) {
+    root->prev = NULL;
+    root->next = NULL;
+  }
+  return root;
+}
+/*---------------------------------------------------------------------------*/
+static int
+heap_contains(struct etimer *t)
+{
+  return t->p != PROCESS_NONE && (t == timerlist || t->prev != NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_insert(struct etimer *t)
+{
+  t->child = t->next = t->prev = NULL;
+  timerlist = meld(timerlist, t);
+  timerlist->prev = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_remove(struct etimer *t)
+{
+  struct etimer *sub;
+
+  if(t == timerlist) {
+    timerlist = merge_pairs(t->child);
+  } else {
+    /* Unlink t and its subtree from its parent's child list. */
+    if(t->prev->child == t) {
+      t->prev->child = t->next;
+    } else {
+      t->prev->next = t->next;
+    }
+    if(t->next != NULL) {
+      t->next->prev = t->prev;
+    }
+    sub = merge_pairs(t->child);
+    timerlist = meld(timerlist, sub);
+    timerlist->prev = NULL;
+  }
+  t->child = t->next = t->prev = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_time(void)
+{
+  next_expiration = timerlist == NULL ? 0 : EXPIRATION(timerlist);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Remove all timers that belong to a process that has exited.
+ */
+static void
+remove_process_timers(struct process *p)
+{
+  struct etimer *t, *keep;
+
+  keep = NULL;
+  while(timerlist != NULL) {
+    t = timerlist;
+    heap_remove(t);
+    if(t->p == p) {
+      t->p = PROCESS_NONE;
+    } else {
+      t->next = keep;
+      keep = t;
+    }
+  }
+  while(keep != NULL) {
+    t = keep;
+    keep = t->next;
+    heap_insert(t);
+  }
+  update_time();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_process, ev, data)
+{
+  struct etimer *t;
+
+  PROCESS_BEGIN();
+
+  timerlist = NULL;
+
+  while(1) {
+    PROCESS_YIELD();
+
+    if(ev == PROCESS_EVENT_EXITED) {
+      remove_process_timers(data);
+      continue;
+    } else if(ev != PROCESS_EVENT_POLL) {
+      continue;
+    }
+
+    while(timerlist != NULL && timer_expired(&timerlist->timer)) {
+      t = timerlist;
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) != PROCESS_ERR_OK) {
+        etimer_request_poll();
+        break;
+      }
+      heap_remove(t);
+      /* Reset the process ID of the event timer, to signal that the
+         etimer has expired. This is later checked in the
+         etimer_expired() function. */
+      t->p = PROCESS_NONE;
+    }
+    update_time();
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+#else /* ETIMER_CONF_HEAP */
 static void
 update_time(void)
 {
@@ -140,6 +335,7 @@ PROCESS_THREAD(etimer_process, ev, data)
   
   PROCESS_END();
 }
+#endif /* ETIMER_CONF_HEAP */
 /*---------------------------------------------------------------------------*/
 void
 etimer_request_poll(void)
@@ -147,6 +343,23 @@ etimer_request_poll(void)
   process_poll(&etimer_process);
 }
 /*---------------------------------------------------------------------------*/
+#if ETIMER_CONF_HEAP
+static void
+add_timer(struct etimer *timer)
+{
+  etimer_request_poll();
+
+  /* The expiration time has changed, so a timer that is already on
+     the heap must be moved to its new position. */
+  if(heap_contains(timer)) {
+    heap_remove(timer);
+  }
+  timer->p = PROCESS_CURRENT();
+  heap_insert(timer);
+
+  update_time();
+}
+#else /* ETIMER_CONF_HEAP */
 static void
 add_timer(struct etimer *timer)
 {
@@ -172,6 +385,7 @@ add_timer(struct etimer *timer)
 
   update_time();
 }
+#endif /* ETIMER_CONF_HEAP */
 /*---------------------------------------------------------------------------*/
 void
 etimer_set(struct etimer *et, clock_time_t interval)
@@ -197,7 +411,17 @@ etimer_restart(struct etimer *et)
 void
 etimer_adjust(struct etimer *et, int timediff)
 {
+#if ETIMER_CONF_HEAP
+  if(heap_contains(et)) {
+    heap_remove(et);
+    et->timer.start += timediff;
+    heap_insert(et);
+  } else {
+    et->timer.start += timediff;
+  }
+#else /* ETIMER_CONF_HEAP */
   et->timer.start += timediff;
+#endif /* ETIMER_CONF_HEAP */
   update_time();
 }
 /*---------------------------------------------------------------------------*/
@@ -234,6 +458,12 @@ etimer_next_expiration_time(void)
 void
 etimer_stop(struct etimer *et)
 {
+#if ETIMER_CONF_HEAP
+  if(heap_contains(et)) {
+    heap_remove(et);
+    update_time();
+  }
+#else /* ETIMER_CONF_HEAP */
   struct etimer *t;
 
   /* First check if et is the first event timer on the list. */
@@ -254,6 +484,7 @@ etimer_stop(struct etimer *et)
       update_time();
     }
   }
+#endif /* ETIMER_CONF_HEAP */
 
   /* Remove the next pointer from the item to be removed. */
   et->next = NULL;
@@ -65,6 +65,19 @@
 #include "sys/timer.h"
 #include "sys/process.h"
 
+/*
+ * Pending event timers are kept in an unsorted list by default, which
+ * makes adding a timer and finding the next expiration time linear in
+ * the number of timers. Setting ETIMER_CONF_HEAP keeps them in a
+ * pairing heap ordered by expiration time instead: adding a timer and
+ * querying the next expiration are constant time, and stopping or
+ * expiring a timer is logarithmic (amortized). This costs two extra
+ * pointers per etimer and pays off with many concurrent timers.
+ */
+#ifndef ETIMER_CONF_HEAP
+#define ETIMER_CONF_HEAP 0
+#endif /* ETIMER_CONF_HEAP */
+
 /**
  * A timer.
  *
@@ -77,6 +90,9 @@ struct etimer {
   struct timer timer;
   struct etimer *next;
   struct process *p;
+#if ETIMER_CONF_HEAP
+  struct etimer *child, *prev;
+#endif /* ETIMER_CONF_HEAP */
 };
 
 /**
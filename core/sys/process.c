@@ -44,6 +44,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "sys/process.h"
 #include "sys/arg.h"
@@ -65,13 +66,42 @@ struct event_data {
   struct process *p;
 };
 
-static process_num_events_t nevents, fevent;
-static struct event_data events[PROCESS_CONF_NUMEVENTS];
+/*
+ * One circular event queue per priority level.
+ */
+struct event_queue {
+  process_num_events_t nevents, fevent;
+  struct event_data events[PROCESS_CONF_NUMEVENTS];
+};
+
+#if PROCESS_PRIORITIES * PROCESS_CONF_NUMEVENTS > 255
+#error PROCESS_CONF_PRIORITIES * PROCESS_CONF_NUMEVENTS must not exceed 255
+#endif
+
+/* Total number of events waiting in all queues. */
+static process_num_events_t nevents;
+static struct event_queue queues[PROCESS_PRIORITIES];
+
+#if PROCESS_PRIORITIES > 1
+#define EVENT_QUEUE(p) (&queues[(p) == PROCESS_BROADCAST ? \
+                                PROCESS_PRIO_NORMAL : (p)->prio])
+#else
+#define EVENT_QUEUE(p) (&queues[0])
+#endif /* PROCESS_PRIORITIES > 1 */
 
 #if PROCESS_CONF_STATS
 process_num_events_t process_maxevents;
+struct process_stats process_stats;
 #endif
 
+#if PROCESS_CONF_SUBSCRIPTIONS
+struct subscription {
+  struct process *p;
+  process_event_t ev;
+};
+static struct subscription subscriptions[PROCESS_CONF_SUBSCRIPTIONS];
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
+
 static volatile unsigned char poll_requested;
 
 #define PROCESS_STATE_NONE        0
@@ -125,6 +155,9 @@ exit_process(struct process *p, struct process *fromprocess)
 {
   register struct process *q;
   struct process *old_current = process_current;
+#if PROCESS_CONF_SUBSCRIPTIONS
+  int i;
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
 
   PRINTF("process: exit_process '%s'\n", PROCESS_NAME_STRING(p));
 
@@ -157,6 +190,15 @@ exit_process(struct process *p, struct process *fromprocess)
     }
   }
 
+#if PROCESS_CONF_SUBSCRIPTIONS
+  for(i = 0; i < PROCESS_CONF_SUBSCRIPTIONS; i++) {
+    if(subscriptions[i].p == p) {
+      subscriptions[i].p = NULL;
+    }
+  }
+  p->nsubscriptions = 0;
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
+
   if(p == process_list) {
     process_list = process_list->next;
   } else {
@@ -209,10 +251,15 @@ process_init(void)
 {
   lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  memset(queues, 0, sizeof(queues));
+  nevents = 0;
 #if PROCESS_CONF_STATS
   process_maxevents = 0;
+  memset(&process_stats, 0, sizeof(process_stats));
 #endif /* PROCESS_CONF_STATS */
+#if PROCESS_CONF_SUBSCRIPTIONS
+  memset(subscriptions, 0, sizeof(subscriptions));
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
 
   process_current = process_list = NULL;
 }
@@ -237,6 +284,30 @@ do_poll(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_SUBSCRIPTIONS
+/*
+ * Check whether a broadcast event should be delivered to a process.
+ */
+static int
+wants_broadcast(struct process *p, process_event_t ev)
+{
+  int i;
+
+  if(p->nsubscriptions == 0 || ev < PROCESS_EVENT_MAX) {
+    return 1;
+  }
+  for(i = 0; i < PROCESS_CONF_SUBSCRIPTIONS; i++) {
+    if(subscriptions[i].p == p && subscriptions[i].ev == ev) {
+      return 1;
+    }
+  }
+#if PROCESS_CONF_STATS
+  process_stats.filtered++;
+#endif /* PROCESS_CONF_STATS */
+  return 0;
+}
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
+/*---------------------------------------------------------------------------*/
 /*
  * Process the next event in the event queue and deliver it to
  * listening processes.
@@ -249,6 +320,7 @@ do_event(void)
   static process_data_t data;
   static struct process *receiver;
   static struct process *p;
+  static struct event_queue *q;
   
   /*
    * If there are any events in the queue, take the first one and walk
@@ -259,16 +331,20 @@ do_event(void)
    */
 
   if(nevents > 0) {
+
+    /* Pick the highest priority queue that holds an event. */
+    for(q = &queues[PROCESS_PRIORITIES - 1]; q->nevents == 0; --q);
     
     /* There are events that we should deliver. */
-    ev = events[fevent].ev;
+    ev = q->events[q->fevent].ev;
     
-    data = events[fevent].data;
-    receiver = events[fevent].p;
+    data = q->events[q->fevent].data;
+    receiver = q->events[q->fevent].p;
 
     /* Since we have seen the new event, we move pointer upwards
        and decrease the number of events. */
-    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    q->fevent = (q->fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    --q->nevents;
     --nevents;
 
     /* If this is a broadcast event, we deliver it to all events, in
@@ -281,6 +357,11 @@ do_event(void)
 	if(poll_requested) {
 	  do_poll();
 	}
+#if PROCESS_CONF_SUBSCRIPTIONS
+	if(!wants_broadcast(p, ev)) {
+	  continue;
+	}
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
 	call_process(p, ev, data);
       }
     } else {
@@ -301,6 +382,10 @@ do_event(void)
 int
 process_run(void)
 {
+#if PROCESS_CONF_EVENT_BATCH > 1
+  int i;
+#endif /* PROCESS_CONF_EVENT_BATCH > 1 */
+
   /* Process poll events. */
   if(poll_requested) {
     do_poll();
@@ -309,6 +394,17 @@ process_run(void)
   /* Process one event from the queue */
   do_event();
 
+#if PROCESS_CONF_EVENT_BATCH > 1
+  /* Drain more events while there are any, still running the poll
+     handlers in between. */
+  for(i = 1; i < PROCESS_CONF_EVENT_BATCH && nevents > 0; i++) {
+    if(poll_requested) {
+      do_poll();
+    }
+    do_event();
+  }
+#endif /* PROCESS_CONF_EVENT_BATCH > 1 */
+
   return nevents + poll_requested;
 }
 /*---------------------------------------------------------------------------*/
@@ -322,6 +418,7 @@ int
 process_post(struct process *p, process_event_t ev, process_data_t data)
 {
   static process_num_events_t snum;
+  struct event_queue *q;
 
   if(PROCESS_CURRENT() == NULL) {
     PRINTF("process_post: NULL process posts event %d to process '%s', nevents %d\n",
@@ -332,7 +429,12 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
 	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
   }
   
-  if(nevents == PROCESS_CONF_NUMEVENTS) {
+  q = EVENT_QUEUE(p);
+
+  if(q->nevents == PROCESS_CONF_NUMEVENTS) {
+#if PROCESS_CONF_STATS
+    process_stats.dropped[q - queues]++;
+#endif /* PROCESS_CONF_STATS */
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
       printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_current));
@@ -343,16 +445,20 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
     return PROCESS_ERR_FULL;
   }
   
-  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
-  events[snum].ev = ev;
-  events[snum].data = data;
-  events[snum].p = p;
+  snum = (process_num_events_t)(q->fevent + q->nevents) % PROCESS_CONF_NUMEVENTS;
+  q->events[snum].ev = ev;
+  q->events[snum].data = data;
+  q->events[snum].p = p;
+  ++q->nevents;
   ++nevents;
 
 #if PROCESS_CONF_STATS
   if(nevents > process_maxevents) {
     process_maxevents = nevents;
   }
+  if(q->nevents > process_stats.maxevents[q - queues]) {
+    process_stats.maxevents[q - queues] = q->nevents;
+  }
 #endif /* PROCESS_CONF_STATS */
   
   return PROCESS_ERR_OK;
@@ -385,4 +491,54 @@ process_is_running(struct process *p)
   return p->state != PROCESS_STATE_NONE;
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_PRIORITIES > 1
+void
+process_set_priority(struct process *p, unsigned char prio)
+{
+  if(prio > PROCESS_PRIO_HIGH) {
+    prio = PROCESS_PRIO_HIGH;
+  }
+  p->prio = prio;
+}
+#endif /* PROCESS_PRIORITIES > 1 */
+/*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_SUBSCRIPTIONS
+int
+process_subscribe(struct process *p, process_event_t ev)
+{
+  int i, free_slot;
+
+  free_slot = -1;
+  for(i = 0; i < PROCESS_CONF_SUBSCRIPTIONS; i++) {
+    if(subscriptions[i].p == p && subscriptions[i].ev == ev) {
+      return PROCESS_ERR_OK;
+    }
+    if(subscriptions[i].p == NULL && free_slot < 0) {
+      free_slot = i;
+    }
+  }
+  if(free_slot < 0) {
+    return PROCESS_ERR_FULL;
+  }
+  subscriptions[free_slot].p = p;
+  subscriptions[free_slot].ev = ev;
+  p->nsubscriptions++;
+  return PROCESS_ERR_OK;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_unsubscribe(struct process *p, process_event_t ev)
+{
+  int i;
+
+  for(i = 0; i < PROCESS_CONF_SUBSCRIPTIONS; i++) {
+    if(subscriptions[i].p == p && subscriptions[i].ev == ev) {
+      subscriptions[i].p = NULL;
+      p->nsubscriptions--;
+      return;
+    }
+  }
+}
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
+/*---------------------------------------------------------------------------*/
 /** @} */
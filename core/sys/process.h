@@ -88,6 +88,43 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/*
+ * Number of event priority levels. Each level has its own event queue
+ * of PROCESS_CONF_NUMEVENTS entries, and process_run() always serves
+ * the highest non-empty level first. With the default of one level
+ * the kernel behaves as a single FIFO event queue.
+ */
+#ifndef PROCESS_CONF_PRIORITIES
+#define PROCESS_CONF_PRIORITIES 1
+#endif /* PROCESS_CONF_PRIORITIES */
+#define PROCESS_PRIORITIES PROCESS_CONF_PRIORITIES
+
+/*
+ * Maximum number of queued events delivered by a single call to
+ * process_run(). Poll handlers are still run between events.
+ */
+#ifndef PROCESS_CONF_EVENT_BATCH
+#define PROCESS_CONF_EVENT_BATCH 1
+#endif /* PROCESS_CONF_EVENT_BATCH */
+
+/*
+ * Size of the broadcast subscription table, see
+ * process_subscribe(). Zero disables subscriptions.
+ */
+#ifndef PROCESS_CONF_SUBSCRIPTIONS
+#define PROCESS_CONF_SUBSCRIPTIONS 0
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
+
+/**
+ * \name Process priorities
+ * @{
+ */
+/** The default, and lowest, priority of a process. */
+#define PROCESS_PRIO_NORMAL   0
+/** The highest priority available with the current configuration. */
+#define PROCESS_PRIO_HIGH     (PROCESS_PRIORITIES - 1)
+/* @} */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -323,8 +360,30 @@ struct process {
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
   unsigned char state, needspoll;
+#if PROCESS_PRIORITIES > 1
+  unsigned char prio;
+#endif /* PROCESS_PRIORITIES > 1 */
+#if PROCESS_CONF_SUBSCRIPTIONS
+  unsigned char nsubscriptions;
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
+};
+
+#if PROCESS_CONF_STATS
+/**
+ * Event queue statistics, kept per priority level.
+ */
+struct process_stats {
+  /** Highest number of events seen waiting in each queue. */
+  process_num_events_t maxevents[PROCESS_PRIORITIES];
+  /** Number of events refused by process_post() because the queue was full. */
+  unsigned short dropped[PROCESS_PRIORITIES];
+  /** Number of broadcast deliveries skipped due to subscriptions. */
+  unsigned short filtered;
 };
 
+extern struct process_stats process_stats;
+#endif /* PROCESS_CONF_STATS */
+
 /**
  * \name Functions called from application programs
  * @{
@@ -452,6 +511,54 @@ process_current = p
  */
 CCIF process_event_t process_alloc_event(void);
 
+#if PROCESS_PRIORITIES > 1
+/**
+ * \brief      Set the priority of a process.
+ * \param p    The process
+ * \param prio The priority, from PROCESS_PRIO_NORMAL to PROCESS_PRIO_HIGH
+ *
+ *             Events posted to a process with process_post() are
+ *             placed in the event queue of the receiver's priority
+ *             and are delivered before any event of a lower
+ *             priority. Broadcast events are always queued at
+ *             PROCESS_PRIO_NORMAL.
+ */
+CCIF void process_set_priority(struct process *p, unsigned char prio);
+#define process_get_priority(p) ((p)->prio)
+#else
+#define process_set_priority(p, prio)
+#define process_get_priority(p) PROCESS_PRIO_NORMAL
+#endif /* PROCESS_PRIORITIES > 1 */
+
+#if PROCESS_CONF_SUBSCRIPTIONS
+/**
+ * \brief      Subscribe a process to a broadcast event.
+ * \param p    The process
+ * \param ev   The global event number
+ * \retval PROCESS_ERR_OK The subscription was registered.
+ * \retval PROCESS_ERR_FULL The subscription table is full.
+ *
+ *             By default a process receives every broadcast
+ *             event. Once a process has subscribed to at least one
+ *             event, it only receives the broadcast events it has
+ *             subscribed to, which saves calling processes that
+ *             would ignore the event anyway. Kernel events below
+ *             PROCESS_EVENT_MAX are always delivered. All
+ *             subscriptions of a process are removed when it exits.
+ */
+CCIF int process_subscribe(struct process *p, process_event_t ev);
+
+/**
+ * \brief      Remove a broadcast event subscription.
+ * \param p    The process
+ * \param ev   The global event number
+ *
+ *             When the last subscription of a process is removed,
+ *             the process receives all broadcast events again.
+ */
+CCIF void process_unsubscribe(struct process *p, process_event_t ev);
+#endif /* PROCESS_CONF_SUBSCRIPTIONS */
+
 /** @} */
 
 /**
@@ -489,7 +596,8 @@ void process_init(void);
  *
  * This function should be called repeatedly from the main() program
  * to actually run the Contiki system. It calls the necessary poll
- * handlers, and processes one event. The function returns the number
+ * handlers, and processes one event (or up to
+ * PROCESS_CONF_EVENT_BATCH events). The function returns the number
  * of events that are waiting in the event queue so that the caller
  * may choose to put the CPU to sleep when there are no pending
  * events.
@@ -63,6 +63,165 @@ rtimer_init(void)
   rtimer_arch_init();
 }
 /*---------------------------------------------------------------------------*/
+#if RTIMER_CONF_MULTIPLE
+
+struct rtimer_stats rtimer_stats;
+
+/* Set while rtimer_run_next() executes tasks, which defers
+   reprogramming the hardware timer until all due tasks have run. */
+static unsigned char running;
+static unsigned short npending;
+/*---------------------------------------------------------------------------*/
+/*
+ * Unlink a task from the list of pending tasks. Returns non-zero if
+ * the task was found.
+ */
+static int
+remove_rtimer(struct rtimer *rtimer)
+{
+  struct rtimer **tp;
+
+  for(tp = &next_rtimer; *tp != NULL; tp = &(*tp)->next) {
+    if(*tp == rtimer) {
+      *tp = rtimer->next;
+      rtimer->next = NULL;
+      npending--;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Insert a task in the list of pending tasks, keeping it sorted by
+ * expiration time. Tasks with equal times run in the order they were
+ * set.
+ */
+static void
+insert_rtimer(struct rtimer *rtimer)
+{
+  struct rtimer **tp;
+
+  for(tp = &next_rtimer; *tp != NULL; tp = &(*tp)->next) {
+    if(RTIMER_CLOCK_LT(rtimer->time, (*tp)->time)) {
+      break;
+    }
+  }
+  rtimer->next = *tp;
+  *tp = rtimer;
+
+  if(++npending > rtimer_stats.max_pending) {
+    rtimer_stats.max_pending = npending;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_reschedule(struct rtimer *rtimer, rtimer_clock_t time)
+{
+  struct rtimer *head;
+  rtimer_clock_t head_time;
+  int s;
+
+  PRINTF("rtimer_reschedule time %d\n", time);
+
+  s = RTIMER_ARCH_DISABLE_INTERRUPTS();
+  head = next_rtimer;
+  head_time = head != NULL ? head->time : 0;
+
+  remove_rtimer(rtimer);
+  rtimer->time = time;
+  insert_rtimer(rtimer);
+  rtimer_stats.scheduled++;
+
+  /* Only touch the hardware when the earliest expiration time
+     changed, which includes moving the head task itself. */
+  if(!running && (next_rtimer != head || next_rtimer->time != head_time)) {
+    rtimer_arch_schedule(next_rtimer->time);
+  }
+  RTIMER_ARCH_RESTORE_INTERRUPTS(s);
+  return RTIMER_OK;
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
+	   rtimer_clock_t duration,
+	   rtimer_callback_t func, void *ptr)
+{
+  rtimer->func = func;
+  rtimer->ptr = ptr;
+  return rtimer_reschedule(rtimer, time);
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_cancel(struct rtimer *rtimer)
+{
+  struct rtimer *head;
+  int s;
+
+  s = RTIMER_ARCH_DISABLE_INTERRUPTS();
+  head = next_rtimer;
+  if(!remove_rtimer(rtimer)) {
+    RTIMER_ARCH_RESTORE_INTERRUPTS(s);
+    return 0;
+  }
+  rtimer_stats.cancelled++;
+
+  /* If the earliest task was removed, the hardware timer will fire
+     early; rtimer_run_next() then only reprograms it. Scheduling the
+     new head right away avoids the spurious interrupt. */
+  if(!running && head == rtimer && next_rtimer != NULL) {
+    rtimer_arch_schedule(next_rtimer->time);
+  }
+  RTIMER_ARCH_RESTORE_INTERRUPTS(s);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+rtimer_is_scheduled(struct rtimer *rtimer)
+{
+  struct rtimer *t;
+  int s;
+
+  s = RTIMER_ARCH_DISABLE_INTERRUPTS();
+  for(t = next_rtimer; t != NULL && t != rtimer; t = t->next);
+  RTIMER_ARCH_RESTORE_INTERRUPTS(s);
+  return t != NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+rtimer_run_next(void)
+{
+  struct rtimer *t;
+  rtimer_clock_t now, lateness;
+
+  running = 1;
+  now = RTIMER_NOW();
+  while(next_rtimer != NULL && !RTIMER_CLOCK_LT(now, next_rtimer->time)) {
+    t = next_rtimer;
+    next_rtimer = t->next;
+    t->next = NULL;
+    npending--;
+
+    lateness = now - t->time;
+    if(lateness > rtimer_stats.max_lateness) {
+      rtimer_stats.max_lateness = lateness;
+    }
+    if(lateness > RTIMER_CONF_DEADLINE_MISS) {
+      rtimer_stats.missed++;
+    }
+    rtimer_stats.executed++;
+
+    t->func(t, t->ptr);
+    now = RTIMER_NOW();
+  }
+  running = 0;
+
+  if(next_rtimer != NULL) {
+    rtimer_arch_schedule(next_rtimer->time);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#else /* RTIMER_CONF_MULTIPLE */
 int
 rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
 	   rtimer_clock_t duration,
@@ -103,6 +262,7 @@ rtimer_run_next(void)
   }
   return;
 }
+#endif /* RTIMER_CONF_MULTIPLE */
 /*---------------------------------------------------------------------------*/
 
 /** @}*/
@@ -62,6 +62,38 @@ typedef unsigned short rtimer_clock_t;
 
 #include "rtimer-arch.h"
 
+/*
+ * When RTIMER_CONF_MULTIPLE is set, the real-time module keeps all
+ * pending tasks in a list sorted by expiration time, so several
+ * subsystems can use rtimers at the same time. Otherwise only one
+ * task can be pending and rtimer_set() replaces it.
+ */
+#ifndef RTIMER_CONF_MULTIPLE
+#define RTIMER_CONF_MULTIPLE 0
+#endif /* RTIMER_CONF_MULTIPLE */
+
+/*
+ * The list of pending tasks is also updated by rtimer_run_next() from
+ * the timer interrupt. Ports that use RTIMER_CONF_MULTIPLE mask that
+ * interrupt around list updates by defining these in rtimer-arch.h:
+ * RTIMER_ARCH_DISABLE_INTERRUPTS() returns the previous state as an
+ * int, which is handed back to RTIMER_ARCH_RESTORE_INTERRUPTS().
+ */
+#ifndef RTIMER_ARCH_DISABLE_INTERRUPTS
+#define RTIMER_ARCH_DISABLE_INTERRUPTS() 0
+#endif /* RTIMER_ARCH_DISABLE_INTERRUPTS */
+#ifndef RTIMER_ARCH_RESTORE_INTERRUPTS
+#define RTIMER_ARCH_RESTORE_INTERRUPTS(s) ((void)(s))
+#endif /* RTIMER_ARCH_RESTORE_INTERRUPTS */
+
+/*
+ * A task that is executed more than RTIMER_CONF_DEADLINE_MISS ticks
+ * after its scheduled time is counted as a deadline miss.
+ */
+#ifndef RTIMER_CONF_DEADLINE_MISS
+#define RTIMER_CONF_DEADLINE_MISS (RTIMER_ARCH_SECOND / 10000 + 1)
+#endif /* RTIMER_CONF_DEADLINE_MISS */
+
 /**
  * \brief      Initialize the real-time scheduler.
  *
@@ -82,11 +114,36 @@ typedef void (* rtimer_callback_t)(struct rtimer *t, void *ptr);
  *             support module for the real-time module.
  */
 struct rtimer {
+#if RTIMER_CONF_MULTIPLE
+  struct rtimer *next;
+#endif /* RTIMER_CONF_MULTIPLE */
   rtimer_clock_t time;
   rtimer_callback_t func;
   void *ptr;
 };
 
+#if RTIMER_CONF_MULTIPLE
+/**
+ * \brief      Statistics of the real-time scheduler
+ */
+struct rtimer_stats {
+  /** Number of tasks scheduled with rtimer_set() or rtimer_reschedule(). */
+  unsigned long scheduled;
+  /** Number of pending tasks removed with rtimer_cancel(). */
+  unsigned long cancelled;
+  /** Number of tasks executed. */
+  unsigned long executed;
+  /** Number of tasks executed later than RTIMER_CONF_DEADLINE_MISS ticks. */
+  unsigned long missed;
+  /** Largest observed delay between scheduled and actual execution time. */
+  rtimer_clock_t max_lateness;
+  /** Highest number of simultaneously pending tasks. */
+  unsigned short max_pending;
+};
+
+extern struct rtimer_stats rtimer_stats;
+#endif /* RTIMER_CONF_MULTIPLE */
+
 enum {
   RTIMER_OK,
   RTIMER_ERR_FULL,
@@ -105,12 +162,40 @@ enum {
  *             (false) if the task could not be scheduled.
  *
  *             This function schedules a real-time task at a specified
- *             time in the future.
+ *             time in the future. With RTIMER_CONF_MULTIPLE, setting a
+ *             task that is already pending moves it to the new time.
  *
  */
 int rtimer_set(struct rtimer *task, rtimer_clock_t time,
 	       rtimer_clock_t duration, rtimer_callback_t func, void *ptr);
 
+#if RTIMER_CONF_MULTIPLE
+/**
+ * \brief      Move a real-time task to a new time
+ * \param task The task
+ * \param time The new time when the task is to be executed.
+ * \return     RTIMER_OK
+ *
+ *             This function (re)schedules a task with the callback
+ *             function and pointer it was last set with.
+ */
+int rtimer_reschedule(struct rtimer *task, rtimer_clock_t time);
+
+/**
+ * \brief      Cancel a pending real-time task
+ * \param task The task
+ * \return     Non-zero if the task was pending, zero otherwise.
+ */
+int rtimer_cancel(struct rtimer *task);
+
+/**
+ * \brief      Check if a real-time task is pending
+ * \param task The task
+ * \return     Non-zero if the task is pending, zero otherwise.
+ */
+int rtimer_is_scheduled(struct rtimer *task);
+#endif /* RTIMER_CONF_MULTIPLE */
+
 /**
  * \brief      Execute the next real-time task and schedule the next task, if any
  *
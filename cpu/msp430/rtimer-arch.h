@@ -40,6 +40,10 @@
 #ifndef RTIMER_ARCH_H_
 #define RTIMER_ARCH_H_
 
+/* Mask interrupts while the rtimer task list is updated */
+#define RTIMER_ARCH_DISABLE_INTERRUPTS() splhigh()
+#define RTIMER_ARCH_RESTORE_INTERRUPTS(s) splx(s)
+
 #include "sys/rtimer.h"
 
 #ifdef RTIMER_CONF_SECOND
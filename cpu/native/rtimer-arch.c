@@ -90,3 +90,32 @@ rtimer_arch_schedule(rtimer_clock_t t)
 #endif /* !_WIN32 */
 }
 /*---------------------------------------------------------------------------*/
+int
+rtimer_arch_disable_interrupts(void)
+{
+#ifndef _WIN32
+  sigset_t set, old;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGALRM);
+  sigprocmask(SIG_BLOCK, &set, &old);
+  return sigismember(&old, SIGALRM);
+#else /* !_WIN32 */
+  return 0;
+#endif /* !_WIN32 */
+}
+/*---------------------------------------------------------------------------*/
+void
+rtimer_arch_restore_interrupts(int s)
+{
+#ifndef _WIN32
+  sigset_t set;
+
+  if(!s) {
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+  }
+#endif /* !_WIN32 */
+}
+/*---------------------------------------------------------------------------*/
@@ -46,4 +46,11 @@
 
 #define rtimer_arch_now() clock_time()
 
+/* Block the timer signal while the rtimer task list is updated */
+int rtimer_arch_disable_interrupts(void);
+void rtimer_arch_restore_interrupts(int s);
+
+#define RTIMER_ARCH_DISABLE_INTERRUPTS() rtimer_arch_disable_interrupts()
+#define RTIMER_ARCH_RESTORE_INTERRUPTS(s) rtimer_arch_restore_interrupts(s)
+
 #endif /* RTIMER_ARCH_H_ */
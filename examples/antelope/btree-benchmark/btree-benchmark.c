@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Benchmark of range selections in Antelope with a B+-tree
+ *         index, compared with selections on an unindexed copy of the
+ *         same attribute. Prints the tuples processed and the storage
+ *         accesses of each selection. The index grows past the initial
+ *         size of its file, and the selections are repeated after the
+ *         index has been released and loaded again.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/random.h"
+#include "antelope.h"
+#include "index.h"
+#include "relation.h"
+
+#include <stdio.h>
+
+#define ROWS      5000
+#define KEYS      2500
+
+static const int ranges[][2] = { { 100, 100 }, { 2000, 2009 }, { 450, 600 },
+                                 { 0, 49 } };
+
+static uint8_t key_count[KEYS];
+static db_handle_t handle;
+static int errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(btree_benchmark_process, "B+-tree benchmark");
+AUTOSTART_PROCESSES(&btree_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long processed, unsigned long found)
+{
+  struct cfs_coffee_stats stats;
+
+  cfs_coffee_get_stats(&stats);
+  printf("%s: %lu tuples processed, %lu found, %lu reads, %lu writes, "
+         "%lu erases\n", what, processed, found, stats.reads, stats.writes,
+         stats.erases);
+  cfs_coffee_reset_stats();
+}
+/*---------------------------------------------------------------------------*/
+static void
+query(const char *query)
+{
+  if(DB_ERROR(db_query(&handle, query))) {
+    printf("Query \"%s\" failed\n", query);
+    errors++;
+  }
+  db_free(&handle);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Select the keys between low and high from the given attribute, and
+ * check the result against the inserted keys.
+ */
+static void
+select_range(const char *attribute, int low, int high)
+{
+  attribute_value_t value;
+  unsigned long processed, found, expected;
+  db_result_t result;
+  long key;
+  int i;
+
+  if(DB_ERROR(db_query(&handle,
+                       "SELECT k, c FROM r WHERE %s >= %d AND %s <= %d;",
+                       attribute, low, attribute, high))) {
+    errors++;
+    return;
+  }
+
+  processed = found = 0;
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      found++;
+      if(DB_ERROR(db_get_value(&value, &handle, 0))) {
+        errors++;
+        break;
+      }
+      key = db_value_to_long(&value);
+      if(key < low || key > high) {
+        errors++;
+      }
+    } else if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      /* The index reports an empty range as an error. */
+      if(found > 0) {
+        errors++;
+      }
+      break;
+    }
+    processed++;
+  }
+  db_free(&handle);
+
+  for(i = low, expected = 0; i <= high && i < KEYS; i++) {
+    expected += key_count[i];
+  }
+  if(found != expected) {
+    printf("Expected %lu tuples in [%d, %d], found %lu\n",
+           expected, low, high, found);
+    errors++;
+  }
+
+  printf("[%d, %d] on %s: ", low, high, attribute);
+  report(attribute[0] == 'k' ? "index" : "scan", processed, found);
+}
+/*---------------------------------------------------------------------------*/
+/* Release the index and load it again from its file. */
+static void
+reload_index(void)
+{
+  relation_t *rel;
+  attribute_t *attr;
+
+  rel = relation_load("r");
+  if(rel == NULL) {
+    errors++;
+    return;
+  }
+  attr = relation_attribute_get(rel, "k");
+  if(attr == NULL || attr->index == NULL ||
+     DB_ERROR(index_release(attr->index)) ||
+     DB_ERROR(index_load(rel, attr))) {
+    printf("Failed to reload the index\n");
+    errors++;
+  }
+  relation_release(rel);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(btree_benchmark_process, ev, data)
+{
+  static int i;
+  int key;
+
+  PROCESS_BEGIN();
+
+  printf("B+-tree benchmark, %d rows, order %d\n", ROWS, DB_BTREE_ORDER);
+
+  cfs_coffee_format();
+  db_init();
+  cfs_coffee_reset_stats();
+
+  query("CREATE RELATION r;");
+  query("CREATE ATTRIBUTE k DOMAIN INT IN r;");
+  query("CREATE ATTRIBUTE c DOMAIN INT IN r;");
+  query("CREATE INDEX r.k TYPE BTREE;");
+
+  for(i = 0; i < ROWS; i++) {
+    key = random_rand() % KEYS;
+    key_count[key]++;
+    if(DB_ERROR(db_query(&handle, "INSERT (%d, %d) INTO r;", key, key))) {
+      errors++;
+    }
+    db_free(&handle);
+  }
+  report("insert", ROWS, ROWS);
+
+  for(i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+    select_range("k", ranges[i][0], ranges[i][1]);
+    select_range("c", ranges[i][0], ranges[i][1]);
+    PROCESS_PAUSE();
+  }
+
+  reload_index();
+  report("reload", 0, 0);
+  for(i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+    select_range("k", ranges[i][0], ranges[i][1]);
+    PROCESS_PAUSE();
+  }
+
+  printf("B+-tree benchmark done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Benchmark of the Internet checksum. Checks the checksum and
+ *         its incremental update against a plain reference sum, then
+ *         measures the throughput for a few packet sizes. Build with
+ *         CHKSUM_WIDTH=16, 32 or 64 to compare the accumulator widths.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/uip-chksum.h"
+#include "lib/random.h"
+#include "apps/benchmark/benchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Statistics used by the IPv6 stack, see apps/benchmark */
+struct netstat_t UNET_NodeStat;
+char NodeStat_Ctrl = 0;
+
+#define BUFSIZE     1284
+#define CHECKS      10000
+#define TOTAL_BYTES 1000000000UL
+
+static const int sizes[] = { 20, 48, 127, 1280 };
+static uint8_t buf[BUFSIZE];
+static uint8_t packet[BUFSIZE];
+static volatile uint16_t sink;
+static int errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(chksum_benchmark_process, "Checksum benchmark");
+AUTOSTART_PROCESSES(&chksum_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static uint16_t
+ref_sum(uint16_t sum, const uint8_t *data, int len)
+{
+  uint32_t acc;
+  int i;
+
+  acc = sum;
+  for(i = 0; i < len; i++) {
+    acc += (i & 1) ? data[i] : data[i] << 8;
+  }
+  while(acc >> 16) {
+    acc = (acc >> 16) + (acc & 0xffff);
+  }
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Sum random buffers at random alignments and compare with the
+ * reference.
+ */
+static void
+check_sum(void)
+{
+  uint16_t len, off, sum;
+  int i;
+
+  for(i = 0; i < CHECKS; i++) {
+    len = random_rand() % (BUFSIZE - 4);
+    off = random_rand() % 4;
+    sum = random_rand();
+    if(uip_chksum_add(sum, buf + off, len) != ref_sum(sum, buf + off, len)) {
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Replace a 32-byte pseudo-header by an 8-byte one and a port number,
+ * as an IPv6 to IPv4 translator does, and compare the incrementally
+ * updated checksum with a full recomputation.
+ */
+static void
+check_adjust(void)
+{
+  uint16_t len, chksum, port;
+  uint8_t newhdr[8];
+  int i, j;
+
+  for(i = 0; i < CHECKS; i++) {
+    len = 40 + random_rand() % (BUFSIZE - 40);
+    for(j = 0; j < len; j++) {
+      packet[j] = random_rand();
+    }
+    for(j = 0; j < sizeof(newhdr); j++) {
+      newhdr[j] = random_rand();
+    }
+    /* 32 bytes of addresses followed by the transport header, with
+       the checksum at offset 38. */
+    packet[38] = packet[39] = 0;
+    chksum = uip_htons(~uip_chksum_add(0, packet, len));
+    port = random_rand();
+
+    chksum = uip_chksum_adjust(chksum, packet, 32, newhdr, sizeof(newhdr));
+    chksum = uip_chksum_adjust(chksum, &packet[32], 2, &port, 2);
+
+    memcpy(&packet[32], &port, 2);
+    if(chksum != uip_htons((uint16_t)~ref_sum(ref_sum(0, newhdr, sizeof(newhdr)),
+                                              &packet[32], len - 32))) {
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the elapsed time in milliseconds. */
+static unsigned long
+run(int size, unsigned long rounds)
+{
+  clock_time_t start;
+  unsigned long r;
+  uint16_t sum;
+
+  sum = 0;
+  start = clock_time();
+  for(r = 0; r < rounds; r++) {
+    sum = uip_chksum_add(sum, buf, size);
+  }
+  sink = sum;
+  return (unsigned long)(clock_time() - start) * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(chksum_benchmark_process, ev, data)
+{
+  static int s;
+  unsigned long ms, rounds;
+  int i;
+
+  PROCESS_BEGIN();
+
+  printf("checksum benchmark, %d-bit accumulator\n", UIP_CHKSUM_WIDTH);
+
+  for(i = 0; i < BUFSIZE; i++) {
+    buf[i] = random_rand();
+  }
+  check_sum();
+  check_adjust();
+
+  for(s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    rounds = TOTAL_BYTES / sizes[s];
+    ms = run(sizes[s], rounds);
+    printf("%d bytes: %lu checksums in %lu ms (%lu MB/s)\n",
+           sizes[s], rounds, ms, ms > 0 ? TOTAL_BYTES / 1000 / ms : 0);
+    PROCESS_PAUSE();
+  }
+
+  printf("checksum benchmark done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Benchmark of file lookups and space reservations in Coffee.
+ *         Build once as is and once with COFFEE_INDEX=1, and compare
+ *         the number of storage reads. Build with COFFEE_GC_INCREMENTAL=1
+ *         to compare the garbage collection pauses in the write path,
+ *         and with COFFEE_CACHE=1 to compare the storage accesses made
+ *         by small sequential reads and writes.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+
+#ifndef COFFEE_INDEX
+#define COFFEE_INDEX 0
+#endif
+#ifndef COFFEE_GC_INCREMENTAL
+#define COFFEE_GC_INCREMENTAL 0
+#endif
+#ifndef COFFEE_CACHE
+#define COFFEE_CACHE 0
+#endif
+
+#define FILES     400
+#define LOOKUPS   2000
+/* Two pages per file, so that the rounds together need more space
+   than there is and the garbage collector has to run. */
+#define FILE_SIZE 300
+#define ROUNDS    6
+/* Coffee finds the end of a file from the last non-zero byte, so the
+   stored values end with one. */
+#define VALUE(i)  (0x55000000UL | (uint32_t)(i))
+/* Stream a file of STREAM_SIZE bytes in STREAM_CHUNK byte pieces. */
+#define STREAM_SIZE  8192
+#define STREAM_CHUNK 16
+
+static int errors;
+static unsigned long elapsed;
+static struct cfs_coffee_stats gc_stats;
+/*---------------------------------------------------------------------------*/
+PROCESS(coffee_benchmark_process, "Coffee benchmark");
+AUTOSTART_PROCESSES(&coffee_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static void
+file_name(char *name, unsigned round, unsigned i)
+{
+  sprintf(name, "r%uf%u", round % 100, i % 1000);
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_files(int round)
+{
+  char name[16];
+  uint32_t value;
+  int i, fd;
+
+  for(i = 0; i < FILES; i++) {
+    file_name(name, round, i);
+    if(cfs_coffee_reserve(name, FILE_SIZE) < 0) {
+      errors++;
+      continue;
+    }
+    value = VALUE(i);
+    fd = cfs_open(name, CFS_WRITE);
+    if(fd < 0 || cfs_write(fd, &value, sizeof(value)) != sizeof(value)) {
+      errors++;
+    }
+    cfs_close(fd);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+lookup_files(int round)
+{
+  char name[16];
+  uint32_t value;
+  int i, n, fd;
+
+  for(n = 0; n < LOOKUPS; n++) {
+    i = random_rand() % FILES;
+    file_name(name, round, i);
+    fd = cfs_open(name, CFS_READ);
+    if(fd < 0 || cfs_read(fd, &value, sizeof(value)) != sizeof(value) ||
+       value != VALUE(i)) {
+      errors++;
+    }
+    cfs_close(fd);
+
+    /* A file that does not exist. */
+    file_name(name, round + ROUNDS, i);
+    fd = cfs_open(name, CFS_READ);
+    if(fd >= 0) {
+      errors++;
+      cfs_close(fd);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_files(int round)
+{
+  char name[16];
+  int i;
+
+  for(i = 0; i < FILES; i++) {
+    file_name(name, round, i);
+    if(cfs_remove(name) < 0) {
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long operations)
+{
+  struct cfs_coffee_stats stats;
+
+  cfs_coffee_get_stats(&stats);
+  printf("%s: %lu reads, %lu per operation, %lu writes, %lu erases",
+         what, stats.reads, stats.reads / operations, stats.writes,
+         stats.erases);
+  if(COFFEE_CACHE) {
+    printf(", %lu cache hits, %lu misses", stats.cache_hits,
+           stats.cache_misses);
+  }
+  printf("\n");
+  cfs_coffee_reset_stats();
+
+  gc_stats.gc_runs += stats.gc_runs;
+  gc_stats.gc_steps += stats.gc_steps;
+  if(stats.gc_pause_max > gc_stats.gc_pause_max) {
+    gc_stats.gc_pause_max = stats.gc_pause_max;
+  }
+  if(stats.gc_step_max > gc_stats.gc_step_max) {
+    gc_stats.gc_step_max = stats.gc_step_max;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+stream_file(void)
+{
+  uint32_t chunk[STREAM_CHUNK / sizeof(uint32_t)];
+  uint32_t i, j;
+  int fd;
+
+  if(cfs_coffee_reserve("stream", STREAM_SIZE) < 0) {
+    errors++;
+    return;
+  }
+
+  fd = cfs_open("stream", CFS_WRITE);
+  for(i = 0; i < STREAM_SIZE / STREAM_CHUNK; i++) {
+    for(j = 0; j < STREAM_CHUNK / sizeof(uint32_t); j++) {
+      chunk[j] = VALUE(i);
+    }
+    if(cfs_write(fd, chunk, sizeof(chunk)) != sizeof(chunk)) {
+      errors++;
+    }
+  }
+  cfs_close(fd);
+  report("stream write", STREAM_SIZE / STREAM_CHUNK);
+
+  fd = cfs_open("stream", CFS_READ);
+  for(i = 0; i < STREAM_SIZE / STREAM_CHUNK; i++) {
+    if(cfs_read(fd, chunk, sizeof(chunk)) != sizeof(chunk) ||
+       chunk[0] != VALUE(i)) {
+      errors++;
+    }
+  }
+  cfs_close(fd);
+  report("stream read", STREAM_SIZE / STREAM_CHUNK);
+
+  cfs_remove("stream");
+  cfs_coffee_reset_stats();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_benchmark_process, ev, data)
+{
+  static int round;
+  static struct etimer idle;
+  clock_time_t start;
+
+  PROCESS_BEGIN();
+
+  printf("Coffee benchmark, %s, %s garbage collection, %s\n",
+         COFFEE_INDEX ? "with index" : "without index",
+         COFFEE_GC_INCREMENTAL ? "incremental" : "synchronous",
+         COFFEE_CACHE ? "with cache" : "without cache");
+
+  cfs_coffee_format();
+  cfs_coffee_reset_stats();
+
+  start = clock_time();
+  stream_file();
+  elapsed += clock_time() - start;
+
+  for(round = 0; round < ROUNDS; round++) {
+    start = clock_time();
+    create_files(round);
+    report("create", FILES);
+    lookup_files(round);
+    report("lookup", 2 * LOOKUPS);
+    remove_files(round);
+    report("remove", FILES);
+    elapsed += clock_time() - start;
+
+    /* Leave the system idle for a while, so that a background
+       collector gets to run. */
+    etimer_set(&idle, CLOCK_SECOND / 10);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&idle));
+    report("idle", 1);
+  }
+
+  printf("GC in the write path: %lu runs, longest %lu ticks\n",
+         gc_stats.gc_runs, gc_stats.gc_pause_max);
+  printf("GC in the background: %lu sectors, longest %lu ticks\n",
+         gc_stats.gc_steps, gc_stats.gc_step_max);
+  printf("Coffee benchmark done in %lu ms, %d errors\n",
+         elapsed * 1000 / CLOCK_SECOND, errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Differential test of Coffee. Random file creations, appends,
+ *         writes at random offsets and removals are applied both to
+ *         Coffee and to a model of the files in RAM, and the contents
+ *         of the files are compared with the model. The operations
+ *         fill the file system many times over, so that the garbage
+ *         collector runs between them. Build with COFFEE_INDEX=1 to
+ *         test the in-RAM index and free page bitmap, and with
+ *         COFFEE_GC_INCREMENTAL=1 to check that the files survive the
+ *         background garbage collector, which runs whenever the test
+ *         waits.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SEEDS       5
+#define ITERATIONS  20000
+#define CHECK_EVERY 250
+/* Let the background garbage collector (COFFEE_GC_INCREMENTAL) run. */
+#define IDLE_EVERY  100
+#define FILES       8
+#define MAX_SIZE    3000
+#define MAX_WRITE   200
+/* Reservations of up to almost a sector make the extents of the files
+   cross sector boundaries. */
+#define MAX_RESERVE 60000U
+
+struct model_file {
+  uint8_t exists;
+  uint16_t size;
+  unsigned char data[MAX_SIZE];
+};
+
+static struct model_file model[FILES];
+static unsigned char buf[MAX_SIZE + 1];
+static unsigned long iteration;
+static int seed_errors;
+static int errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(coffee_fuzz_process, "Coffee fuzz");
+AUTOSTART_PROCESSES(&coffee_fuzz_process);
+/*---------------------------------------------------------------------------*/
+static const char *
+file_name(int f)
+{
+  static char name[4];
+
+  snprintf(name, sizeof(name), "f%d", f);
+  return name;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fail(int f, const char *what)
+{
+  if(seed_errors++ == 0) {
+    printf("%s of %s failed at iteration %lu\n", what, file_name(f), iteration);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Coffee finds the end of a file from its last non-zero byte, so the
+   written bytes are never zero. */
+static void
+fill(unsigned char *data, unsigned length)
+{
+  unsigned i;
+
+  for(i = 0; i < length; i++) {
+    data[i] = 1 + random_rand() % 255;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_file(int f, int append)
+{
+  struct model_file *m;
+  unsigned offset, length;
+  int fd, r;
+
+  m = &model[f];
+  offset = append || m->size == 0 ? m->size : random_rand() % m->size;
+  if(offset >= MAX_SIZE) {
+    return;
+  }
+  length = 1 + random_rand() % MAX_WRITE;
+  if(length > MAX_SIZE - offset) {
+    length = MAX_SIZE - offset;
+  }
+  fill(buf, length);
+
+  fd = cfs_open(file_name(f), append ? CFS_WRITE | CFS_APPEND :
+                CFS_READ | CFS_WRITE);
+  if(fd < 0) {
+    fail(f, "open");
+    return;
+  }
+  if(!append && cfs_seek(fd, offset, CFS_SEEK_SET) != offset) {
+    fail(f, "seek");
+  } else {
+    r = cfs_write(fd, buf, length);
+    if(r != length) {
+      fail(f, "write");
+    }
+  }
+  cfs_close(fd);
+
+  memcpy(&m->data[offset], buf, length);
+  if(offset + length > m->size) {
+    m->size = offset + length;
+  }
+  m->exists = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_file(int f)
+{
+  struct model_file *m;
+  int fd, r;
+
+  m = &model[f];
+  fd = cfs_open(file_name(f), CFS_READ);
+  if(!m->exists) {
+    if(fd >= 0) {
+      cfs_close(fd);
+      fail(f, "removal");
+    }
+    return;
+  }
+  if(fd < 0) {
+    fail(f, "lookup");
+    return;
+  }
+  r = cfs_read(fd, buf, sizeof(buf));
+  cfs_close(fd);
+  if(r != m->size || memcmp(buf, m->data, m->size) != 0) {
+    fail(f, "check");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+step(void)
+{
+  int f;
+
+  f = random_rand() % FILES;
+  switch(random_rand() % 10) {
+  case 0:
+    if(cfs_remove(file_name(f)) < 0 && model[f].exists) {
+      fail(f, "remove");
+    }
+    model[f].exists = 0;
+    model[f].size = 0;
+    break;
+  case 1:
+    if(!model[f].exists) {
+      if(cfs_coffee_reserve(file_name(f),
+                            MAX_SIZE + random_rand() % (MAX_RESERVE - MAX_SIZE)) < 0) {
+        fail(f, "reservation");
+      } else {
+        model[f].exists = 1;
+      }
+    }
+    break;
+  case 2:
+  case 3:
+  case 4:
+  case 5:
+    write_file(f, 1);
+    break;
+  case 6:
+  case 7:
+  case 8:
+    write_file(f, 0);
+    break;
+  default:
+    check_file(f);
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_fuzz_process, ev, data)
+{
+  static unsigned seed;
+  static struct etimer et;
+  struct cfs_coffee_stats stats;
+  int f;
+
+  PROCESS_BEGIN();
+
+  printf("Coffee fuzz, %d seeds of %d operations\n", SEEDS, ITERATIONS);
+
+  for(seed = 1; seed <= SEEDS; seed++) {
+    cfs_coffee_format();
+    memset(model, 0, sizeof(model));
+    random_init(seed);
+    seed_errors = 0;
+
+    for(iteration = 0; iteration < ITERATIONS && seed_errors == 0;
+        iteration++) {
+      step();
+      if(iteration % CHECK_EVERY == 0) {
+        for(f = 0; f < FILES; f++) {
+          check_file(f);
+        }
+      }
+      if(iteration % IDLE_EVERY == 0) {
+        etimer_set(&et, 1);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+      }
+    }
+
+    printf("seed %u: %s\n", seed, seed_errors ? "FAILED" : "ok");
+    errors += seed_errors > 0;
+    PROCESS_PAUSE();
+  }
+
+  cfs_coffee_get_stats(&stats);
+  printf("%lu sectors erased, %lu in the background\n",
+         stats.erases, stats.gc_steps);
+  printf("Coffee fuzz done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Check that CSMA with fair queueing sends a UDP datagram that
+ *         takes four or more 6LoWPAN fragments, and that it queues
+ *         either all the fragments of a datagram or none of them.
+ *         The frames go to an RDC driver that only records them.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/mac/mac.h"
+#include "net/mac/rdc.h"
+#include "apps/benchmark/benchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Statistics used by the IPv6 stack, see apps/benchmark */
+struct netstat_t UNET_NodeStat;
+char NodeStat_Ctrl = 0;
+
+#define LARGE_LEN 400
+#define SMALL_LEN 60
+
+/* Queue buffers CSMA keeps for control frames, see the Makefile */
+#define CONTROL_RESERVE 2
+
+#define DISPATCH_FRAG1 0xc0
+#define DISPATCH_FRAGN 0xe0
+
+#define IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UDP_BUF ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+/* What the RDC driver saw since reset_frames() */
+static int unfragmented, fragments, frag1s;
+static int next_offset, last_size;
+static int errors;
+
+/* The list CSMA handed over while holding */
+static uint8_t holding;
+static mac_callback_t held_sent;
+static void *held_ptr;
+static struct rdc_buf_list *held_list;
+
+static uip_lladdr_t node_a, node_b;
+static struct etimer et;
+/*---------------------------------------------------------------------------*/
+static void
+reset_frames(void)
+{
+  unfragmented = fragments = frag1s = 0;
+  next_offset = last_size = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Check that the fragments follow each other without gaps */
+static void
+record_frame(void)
+{
+  uint8_t *p = packetbuf_dataptr();
+  int size = ((p[0] & 0x07) << 8) | p[1];
+
+  switch(p[0] & 0xf8) {
+  case DISPATCH_FRAG1:
+    frag1s++;
+    fragments++;
+    last_size = size;
+    next_offset = -1;
+    break;
+  case DISPATCH_FRAGN:
+    fragments++;
+    if(size != last_size) {
+      printf("csma-fq: FRAGN of a %d byte datagram after a %d byte FRAG1\n",
+             size, last_size);
+      errors++;
+    }
+    if(next_offset >= 0 && p[4] * 8 != next_offset) {
+      printf("csma-fq: fragment at %d, expected %d\n", p[4] * 8, next_offset);
+      errors++;
+    }
+    next_offset = p[4] * 8 + packetbuf_datalen() - 5;
+    break;
+  default:
+    unfragmented++;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+transmit(mac_callback_t sent, void *ptr, struct rdc_buf_list *list)
+{
+  struct rdc_buf_list *next;
+
+  while(list != NULL) {
+    /* The callback frees the buffer */
+    next = list->next;
+    queuebuf_to_packetbuf(list->buf);
+    record_frame();
+    mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+    list = next;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  record_frame();
+  mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *list)
+{
+  if(holding) {
+    /* The channel is busy until release() */
+    held_sent = sent;
+    held_ptr = ptr;
+    held_list = list;
+    return;
+  }
+  transmit(sent, ptr, list);
+}
+/*---------------------------------------------------------------------------*/
+static void
+release(void)
+{
+  holding = 0;
+  if(held_list != NULL) {
+    transmit(held_sent, held_ptr, held_list);
+    held_list = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver csma_fq_test_rdc = {
+  "csma-fq-test",
+  init,
+  send_packet,
+  send_list,
+  input,
+  on,
+  off,
+  channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+/* Send a UDP datagram of len bytes, IP header included, to a link-local
+   address derived from lladdr */
+static void
+send_datagram(uip_lladdr_t *lladdr, int len)
+{
+  memset(uip_buf, 0, UIP_LLH_LEN + len);
+  IP_BUF->vtc = 0x60;
+  IP_BUF->len[0] = (len - UIP_IPH_LEN) >> 8;
+  IP_BUF->len[1] = (len - UIP_IPH_LEN) & 0xff;
+  IP_BUF->proto = UIP_PROTO_UDP;
+  IP_BUF->ttl = 64;
+  uip_ip6addr(&IP_BUF->srcipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 1);
+  uip_ip6addr(&IP_BUF->destipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&IP_BUF->destipaddr, lladdr);
+  UDP_BUF->srcport = UIP_HTONS(5678);
+  UDP_BUF->destport = UIP_HTONS(8765);
+  UDP_BUF->udplen = UIP_HTONS(len - UIP_IPH_LEN);
+  uip_len = len;
+  tcpip_output(lladdr);
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_datagram(const char *what)
+{
+  if(frag1s != 1 || fragments < 4 || next_offset != LARGE_LEN ||
+     last_size != LARGE_LEN) {
+    printf("csma-fq: %s: %d fragments, %d bytes of %d\n",
+           what, fragments, next_offset, last_size);
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(csma_fq_test_process, "CSMA fair queueing test");
+AUTOSTART_PROCESSES(&csma_fq_test_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(csma_fq_test_process, ev, data)
+{
+  static int numfree, frames, i;
+
+  PROCESS_BEGIN();
+
+  printf("CSMA fair queueing test\n");
+
+  node_a.addr[0] = node_b.addr[0] = 0x02;
+  node_a.addr[7] = 0x0a;
+  node_b.addr[7] = 0x0b;
+
+  /* An idle channel: every fragment goes out */
+  reset_frames();
+  send_datagram(&node_a, LARGE_LEN);
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  check_datagram("idle channel");
+  printf("%d byte datagram sent in %d fragments\n", LARGE_LEN, fragments);
+  frames = fragments;
+
+  /* A busy channel: a frame to B is in flight and more wait behind
+     it, so that the queue has room for all but one of the fragments
+     to A, which is still enough for the estimate of 6LoWPAN */
+  reset_frames();
+  holding = 1;
+  send_datagram(&node_b, SMALL_LEN);
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  if(held_list == NULL) {
+    printf("csma-fq: no frame in flight\n");
+    errors++;
+  }
+  for(i = 0; i < QUEUEBUF_NUM &&
+        queuebuf_numfree() > CONTROL_RESERVE + frames - 1; i++) {
+    send_datagram(&node_b, SMALL_LEN);
+  }
+  numfree = queuebuf_numfree();
+  send_datagram(&node_a, LARGE_LEN);
+  if(queuebuf_numfree() != numfree) {
+    printf("csma-fq: %d fragments of a refused datagram queued\n",
+           numfree - queuebuf_numfree());
+    errors++;
+  }
+  release();
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  if(unfragmented != QUEUEBUF_NUM - numfree || fragments != 0) {
+    printf("csma-fq: busy channel: %d frames, %d fragments sent\n",
+           unfragmented, fragments);
+    errors++;
+  }
+
+  /* Once the channel is free again the datagram gets through */
+  reset_frames();
+  send_datagram(&node_a, LARGE_LEN);
+  etimer_set(&et, CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  check_datagram("after a refusal");
+
+  printf("CSMA fair queueing test done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
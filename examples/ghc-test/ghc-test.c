@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Round-trip test of the 6LoWPAN-GHC (RFC 7400) codec on
+ *         random, zero-filled, periodic and ND/RPL-like payloads, and
+ *         check that our NS messages announce GHC in a 6LoWPAN
+ *         Capability Indication Option.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "net/ipv6/uip-nd6.h"
+#include "net/ipv6/sicslowpan-ghc.h"
+#include "lib/random.h"
+#include "apps/benchmark/benchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Statistics used by the IPv6 stack, see apps/benchmark */
+struct netstat_t UNET_NodeStat;
+char NodeStat_Ctrl = 0;
+
+#define MAX_LEN 400
+#define CHECKS  5000
+
+static uip_ipaddr_t src, dest;
+static uint8_t payload[MAX_LEN];
+static uint8_t comp[MAX_LEN];
+static uint8_t uncomp[MAX_LEN];
+static unsigned long total_in, total_out;
+static int errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(ghc_test_process, "GHC test");
+AUTOSTART_PROCESSES(&ghc_test_process);
+/*---------------------------------------------------------------------------*/
+/*
+ * Compress payload[0..len) and, if it got shorter, check that it
+ * uncompresses to the same bytes, that a smaller output buffer is
+ * refused on both sides, and return the compressed length.
+ */
+static int
+round_trip(uint8_t proto, int len)
+{
+  int n, m;
+
+  n = sicslowpan_ghc_compress(&src, &dest, proto, payload, len, comp, sizeof(comp));
+  if(n == 0) {
+    return 0;
+  }
+  if(n >= len) {
+    printf("ghc: %d bytes compressed to %d\n", len, n);
+    errors++;
+    return n;
+  }
+  total_in += len;
+  total_out += n;
+
+  memset(uncomp, 0x55, sizeof(uncomp));
+  m = sicslowpan_ghc_uncompress(&src, &dest, proto, comp, n, uncomp, sizeof(uncomp));
+  if(m != len || memcmp(payload, uncomp, len) != 0) {
+    printf("ghc: %d bytes round trip to %d bytes, proto %u\n", len, m, proto);
+    errors++;
+  }
+  if(sicslowpan_ghc_compress(&src, &dest, proto, payload, len, comp, n - 1) != 0) {
+    printf("ghc: %d bytes compressed into %d bytes\n", len, n - 1);
+    errors++;
+  }
+  if(len > 1 &&
+     sicslowpan_ghc_uncompress(&src, &dest, proto, comp, n, uncomp, len - 1) >= 0) {
+    printf("ghc: %d bytes uncompressed into %d bytes\n", len, len - 1);
+    errors++;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_addresses(void)
+{
+  int i;
+
+  uip_ip6addr(&src, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  uip_ip6addr(&dest, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  for(i = 8; i < 16; i++) {
+    src.u8[i] = random_rand();
+    dest.u8[i] = random_rand();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Random bytes, runs of zeroes and repeats of earlier data */
+static void
+check_random(void)
+{
+  int i, j, c, k, len, from;
+
+  for(i = 0; i < CHECKS; i++) {
+    random_addresses();
+    len = 1 + random_rand() % MAX_LEN;
+    for(j = 0; j < len; j += k) {
+      k = 1 + random_rand() % 40;
+      if(k > len - j) {
+        k = len - j;
+      }
+      switch(random_rand() % 4) {
+      case 0:
+        memset(&payload[j], 0, k);
+        break;
+      case 1:
+        if(j > 0) {
+          /* Overlapping copies make periodic data */
+          from = random_rand() % j;
+          for(c = 0; c < k; c++) {
+            payload[j + c] = payload[from + c];
+          }
+          break;
+        }
+        /* Fall through */
+      default:
+        for(c = 0; c < k; c++) {
+          payload[j + c] = random_rand();
+        }
+        break;
+      }
+    }
+    round_trip(random_rand() & 1 ? UIP_PROTO_UDP : UIP_PROTO_ICMP6, len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Zero-filled payloads of every length */
+static void
+check_zeroes(void)
+{
+  int len;
+
+  memset(payload, 0, sizeof(payload));
+  for(len = 1; len <= MAX_LEN; len++) {
+    if(len > 2 && round_trip(UIP_PROTO_ICMP6, len) == 0) {
+      printf("ghc: %d zero bytes not compressed\n", len);
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * An NS for the destination with an SLLAO and a 6CIO, and a DIO
+ * whose DODAG ID is the source, as the stack sends them.
+ */
+static void
+check_messages(void)
+{
+  int i, n;
+
+  for(i = 0; i < CHECKS / 10; i++) {
+    random_addresses();
+
+    memset(payload, 0, 4 + UIP_ND6_NS_LEN + 16 + 8);
+    payload[0] = ICMP6_NS;
+    payload[2] = random_rand();
+    payload[3] = random_rand();
+    memcpy(&payload[8], &dest, sizeof(dest));
+    payload[24] = UIP_ND6_OPT_SLLAO;
+    payload[25] = 2;
+    memcpy(&payload[26], &src.u8[8], 8);
+    payload[26] ^= 0x02;
+    payload[40] = UIP_ND6_OPT_6CIO;
+    payload[41] = 1;
+    payload[43] = UIP_ND6_6CIO_FLAG_G;
+    n = round_trip(UIP_PROTO_ICMP6, 48);
+    if(n == 0 || n > 32) {
+      printf("ghc: NS compressed to %d bytes\n", n);
+      errors++;
+    }
+
+    memset(payload, 0, 4 + 24);
+    payload[0] = ICMP6_RPL;
+    payload[1] = 0x01;
+    payload[4] = 1;
+    payload[5] = 240;
+    payload[6] = 1;
+    payload[8] = 0x88;
+    payload[9] = 0x10;
+    memcpy(&payload[12], &src, sizeof(src));
+    n = round_trip(UIP_PROTO_ICMP6, 28);
+    if(n == 0 || n > 20) {
+      printf("ghc: DIO compressed to %d bytes\n", n);
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Our NS carries a 6CIO with the G flag, within the IP length */
+static void
+check_6cio(void)
+{
+  uip_ipaddr_t tgt;
+  int offset, found;
+  uint8_t *opt;
+
+  uip_ip6addr(&tgt, 0xfe80, 0, 0, 0, 0x0212, 0x7401, 0x0001, 0x0101);
+  uip_nd6_ns_output(NULL, NULL, &tgt);
+  if(uip_len == 0) {
+    printf("ghc: no NS sent\n");
+    errors++;
+    return;
+  }
+  if(uip_len != UIP_IPH_LEN + ((uip_buf[UIP_LLH_LEN + 4] << 8) |
+                               uip_buf[UIP_LLH_LEN + 5])) {
+    printf("ghc: NS length %u does not match its IP header\n", uip_len);
+    errors++;
+  }
+
+  found = 0;
+  for(offset = UIP_IPH_LEN + 4 + UIP_ND6_NS_LEN; offset < uip_len;
+      offset += opt[1] << 3) {
+    opt = &uip_buf[UIP_LLH_LEN + offset];
+    if(opt[1] == 0) {
+      break;
+    }
+    if(opt[0] == UIP_ND6_OPT_6CIO && opt[1] == 1 &&
+       (opt[3] & UIP_ND6_6CIO_FLAG_G)) {
+      found = 1;
+    }
+  }
+  if(!found) {
+    printf("ghc: NS without a 6CIO\n");
+    errors++;
+  }
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ghc_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("GHC test\n");
+
+  check_zeroes();
+  check_messages();
+  check_random();
+  check_6cio();
+
+  printf("%lu bytes compressed to %lu\n", total_in, total_out);
+  printf("GHC test done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
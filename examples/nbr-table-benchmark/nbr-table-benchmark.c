@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Benchmark of neighbor table lookups versus the number of
+ *         neighbors. Build once as is for the list lookup and once
+ *         with NBR_HASH=1 for the hashed lookup.
+ */
+
+#include "contiki.h"
+#include "net/nbr-table.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOOKUPS 200000UL
+
+struct nbr {
+  uint16_t value;
+};
+
+NBR_TABLE(struct nbr, nbrs);
+
+static const int sizes[] = { 4, 8, 16, 32, NBR_TABLE_MAX_NEIGHBORS };
+static int errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(nbr_table_benchmark_process, "Neighbor table benchmark");
+AUTOSTART_PROCESSES(&nbr_table_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static void
+make_addr(linkaddr_t *addr, uint16_t id)
+{
+  memset(addr, 0, sizeof(linkaddr_t));
+  /* Spread the ids over the address like real EUI-64s do */
+  addr->u8[LINKADDR_SIZE - 1] = id & 0xff;
+  addr->u8[0] = (id >> 8) + 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Fill the table with n neighbors, then look up random ones. Half of
+ * the lookups are for neighbors that are not in the table. Returns
+ * the elapsed time in milliseconds.
+ */
+static unsigned long
+run(int n, uint16_t base)
+{
+  clock_time_t start;
+  linkaddr_t addr;
+  struct nbr *item;
+  unsigned long i;
+  uint16_t id;
+
+  for(id = 0; id < n; id++) {
+    make_addr(&addr, base + id);
+    item = nbr_table_add_lladdr(nbrs, &addr);
+    if(item == NULL) {
+      errors++;
+      continue;
+    }
+    item->value = base + id;
+  }
+
+  start = clock_time();
+  for(i = 0; i < LOOKUPS; i++) {
+    id = random_rand() % (2 * n);
+    make_addr(&addr, base + id);
+    item = nbr_table_get_from_lladdr(nbrs, &addr);
+    if((id < n) != (item != NULL) || (item != NULL && item->value != base + id)) {
+      errors++;
+    }
+  }
+  return (unsigned long)(clock_time() - start) * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(nbr_table_benchmark_process, ev, data)
+{
+  static int s;
+  static uint16_t base;
+  struct nbr *item;
+
+  PROCESS_BEGIN();
+
+  nbr_table_register(nbrs, NULL);
+
+  printf("nbr-table benchmark, %s lookup\n", NBR_TABLE_HASH ? "hashed" : "list");
+
+  for(s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    /* Empty the table, leaving the old keys to be evicted by the new
+       ones so that replacement is exercised as well */
+    for(item = nbr_table_head(nbrs); item != NULL; item = nbr_table_head(nbrs)) {
+      nbr_table_remove(nbrs, item);
+    }
+    base += 1000;
+    printf("%d neighbors: %lu lookups in %lu ms\n",
+           sizes[s], LOOKUPS, run(sizes[s], base));
+    PROCESS_PAUSE();
+  }
+
+  printf("nbr-table benchmark done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
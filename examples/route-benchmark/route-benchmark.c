@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Benchmark of routing table lookups, as done for every
+ *         forwarded packet, with 50, 200 and 1000 routes. Build once
+ *         as is for the linear lookup and once with ROUTE_HASH=1 for
+ *         the hashed lookup. The downward next hop resolution of
+ *         tcpip_ipv6_output() is timed against the neighbor cache
+ *         search it replaced.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "lib/random.h"
+#include "apps/benchmark/benchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Statistics used by the IPv6 stack, see apps/benchmark */
+struct netstat_t UNET_NodeStat;
+char NodeStat_Ctrl = 0;
+
+#define LOOKUPS   1000000UL
+#define NEXTHOPS  16
+
+static const int sizes[] = { 50, 200, UIP_DS6_ROUTE_NB };
+static uip_ipaddr_t nexthops[NEXTHOPS];
+static uip_ipaddr_t dests[UIP_DS6_ROUTE_NB];
+static int errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(route_benchmark_process, "Route benchmark");
+AUTOSTART_PROCESSES(&route_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static void
+make_addr(uip_ipaddr_t *addr, uint16_t id)
+{
+  uip_ip6addr(addr, 0xaaaa, 0, 0, 0, 0x0212, 0x7400, id >> 8, id & 0xff);
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_nexthops(void)
+{
+  uip_lladdr_t lladdr;
+  int i;
+
+  for(i = 0; i < NEXTHOPS; i++) {
+    memset(&lladdr, 0, sizeof(lladdr));
+    lladdr.addr[sizeof(lladdr.addr) - 1] = i + 1;
+    uip_ip6addr(&nexthops[i], 0xfe80, 0, 0, 0, 0, 0, 0, i + 1);
+    uip_ds6_nbr_add(&nexthops[i], &lladdr, 1, NBR_REACHABLE);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Fill the routing table with n host routes and a /64 prefix route,
+ * then look up random destinations. One in eight lookups is for a
+ * destination that only matches the prefix route. Returns the
+ * elapsed time in milliseconds.
+ */
+static unsigned long
+run(int n)
+{
+  clock_time_t start;
+  uip_ipaddr_t addr;
+  uip_ds6_route_t *r;
+  unsigned long i;
+  uint16_t id;
+
+  while(uip_ds6_route_head() != NULL) {
+    uip_ds6_route_rm(uip_ds6_route_head());
+  }
+
+  uip_ip6addr(&addr, 0xbbbb, 0, 0, 0, 0, 0, 0, 0);
+  if(uip_ds6_route_add(&addr, 64, &nexthops[0]) == NULL) {
+    errors++;
+  }
+  for(id = 1; id < n; id++) {
+    make_addr(&dests[id], id);
+    if(uip_ds6_route_add(&dests[id], 128, &nexthops[id % NEXTHOPS]) == NULL) {
+      errors++;
+    }
+  }
+
+  start = clock_time();
+  for(i = 0; i < LOOKUPS; i++) {
+    id = 1 + random_rand() % (n - 1);
+    if((i & 7) == 0) {
+      uip_ip6addr(&addr, 0xbbbb, 0, 0, 0, 0, 0, 0, id);
+      r = uip_ds6_route_lookup(&addr);
+      if(r == NULL || r->length != 64) {
+        errors++;
+      }
+    } else {
+      make_addr(&addr, id);
+      r = uip_ds6_route_lookup(&addr);
+      if(r == NULL || !uip_ipaddr_cmp(&r->ipaddr, &addr)) {
+        errors++;
+      }
+    }
+  }
+  return (unsigned long)(clock_time() - start) * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Resolve the next hop neighbor of random host routes, as done for
+ * every downward packet, either through the route's neighbor index or
+ * by searching the neighbor cache for the next hop address. Uses the
+ * routes set up by the last run(). Returns the elapsed time in
+ * milliseconds.
+ */
+static unsigned long
+forward(int n, int search)
+{
+  clock_time_t start;
+  uip_ds6_route_t *r;
+  uip_ds6_nbr_t *nbr;
+  unsigned long i;
+  uint16_t id;
+
+  start = clock_time();
+  for(i = 0; i < LOOKUPS; i++) {
+    id = 1 + random_rand() % (n - 1);
+    r = uip_ds6_route_lookup(&dests[id]);
+    if(search) {
+      nbr = uip_ds6_nbr_lookup(uip_ds6_route_nexthop(r));
+    } else {
+      nbr = uip_ds6_route_nexthop_nbr(r);
+    }
+    if(nbr == NULL || !uip_ipaddr_cmp(&nbr->ipaddr, &nexthops[id % NEXTHOPS])) {
+      errors++;
+    }
+  }
+  return (unsigned long)(clock_time() - start) * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(route_benchmark_process, ev, data)
+{
+  static int s;
+  unsigned long ms;
+
+  PROCESS_BEGIN();
+
+  printf("route benchmark, %s lookup\n", UIP_DS6_ROUTE_HASH ? "hashed" : "linear");
+
+  add_nexthops();
+
+  for(s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    ms = run(sizes[s]);
+    printf("%d routes: %lu lookups in %lu ms (%lu lookups/s)\n",
+           sizes[s], LOOKUPS, ms, ms > 0 ? LOOKUPS * 1000 / ms : 0);
+    ms = forward(sizes[s], 1);
+    printf("%d routes: %lu packets/s downward, neighbor search\n",
+           sizes[s], ms > 0 ? LOOKUPS * 1000 / ms : 0);
+    ms = forward(sizes[s], 0);
+    printf("%d routes: %lu packets/s downward, neighbor index\n",
+           sizes[s], ms > 0 ? LOOKUPS * 1000 / ms : 0);
+    PROCESS_PAUSE();
+  }
+
+  printf("route benchmark done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Benchmark of the event timer backends. Build once as is for
+ *         the list backend and once with ETIMER_HEAP=1 for the heap
+ *         backend, and compare the printed results.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+
+#define MAX_TIMERS 1000
+#define ROUNDS     200
+
+static struct etimer timers[MAX_TIMERS];
+static const int sizes[] = { 10, 100, 500, MAX_TIMERS };
+
+static struct etimer order_timers[3];
+static clock_time_t last_fired;
+static int errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(timer_benchmark_process, "Timer benchmark");
+AUTOSTART_PROCESSES(&timer_benchmark_process);
+/*---------------------------------------------------------------------------*/
+/*
+ * Set n timers with random intervals, query the next expiration time
+ * after each insertion and stop them again in a different order.
+ * Returns the elapsed time in milliseconds.
+ */
+static unsigned long
+run(int n)
+{
+  clock_time_t start, next;
+  int r, i;
+
+  start = clock_time();
+  for(r = 0; r < ROUNDS; r++) {
+    for(i = 0; i < n; i++) {
+      /* Intervals are long enough that no timer expires during the run. */
+      etimer_set(&timers[i], 60 * CLOCK_SECOND + random_rand() % 1000);
+      next = etimer_next_expiration_time();
+      if(next == 0) {
+        errors++;
+      }
+    }
+    for(i = 0; i < n; i++) {
+      etimer_stop(&timers[(i * 7919UL) % n]);
+    }
+  }
+  return (unsigned long)(clock_time() - start) * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(timer_benchmark_process, ev, data)
+{
+  static int s;
+  unsigned long ms;
+
+  PROCESS_BEGIN();
+
+  printf("etimer benchmark, %s backend\n", ETIMER_CONF_HEAP ? "heap" : "list");
+
+  for(s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    ms = run(sizes[s]);
+    printf("%d timers: %lu set+stop pairs in %lu ms\n",
+           sizes[s], (unsigned long)sizes[s] * ROUNDS, ms);
+    PROCESS_PAUSE();
+  }
+
+  /* Check that timers still expire in order. */
+  etimer_set(&order_timers[0], CLOCK_SECOND / 4);
+  etimer_set(&order_timers[1], CLOCK_SECOND / 8);
+  etimer_set(&order_timers[2], CLOCK_SECOND / 2);
+  for(s = 0; s < 3; s++) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    if(etimer_expiration_time(data) < last_fired) {
+      errors++;
+    }
+    last_fired = etimer_expiration_time(data);
+  }
+
+  printf("etimer benchmark done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
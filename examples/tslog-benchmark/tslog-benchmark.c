@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Benchmark of the time-series log against plain CFS appends,
+ *         on Coffee. Prints the storage accesses needed to log the
+ *         samples and to query a short time range.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "tslog.h"
+
+#include <stdio.h>
+
+#define SAMPLES   4000
+#define INTERVAL  10
+#define FROM      (sample_time(SAMPLES / 2))
+#define TO        (sample_time(SAMPLES / 2 + 100) - 1)
+
+static struct tslog log;
+static struct tslog_cursor cursor;
+static int errors;
+/*---------------------------------------------------------------------------*/
+PROCESS(tslog_benchmark_process, "tslog benchmark");
+AUTOSTART_PROCESSES(&tslog_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static uint32_t
+sample_time(uint32_t i)
+{
+  return 1000 + i * INTERVAL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sample(uint32_t i, struct tslog_record *record)
+{
+  record->time = sample_time(i);
+  record->values[0] = 2000 + (int32_t)((i * 7) % 50) - 25;
+  record->values[1] = -(int32_t)i;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check(const struct tslog_record *record)
+{
+  struct tslog_record expected;
+
+  sample((record->time - sample_time(0)) / INTERVAL, &expected);
+  if(record->time != expected.time ||
+     record->values[0] != expected.values[0] ||
+     record->values[1] != expected.values[1]) {
+    errors++;
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long operations)
+{
+  struct cfs_coffee_stats stats;
+
+  cfs_coffee_get_stats(&stats);
+  printf("%s: %lu reads, %lu writes of %lu bytes, %lu erases, %lu records\n",
+         what, stats.reads, stats.writes, stats.write_bytes, stats.erases,
+         operations);
+  cfs_coffee_reset_stats();
+}
+/*---------------------------------------------------------------------------*/
+static void
+cfs_log(void)
+{
+  struct tslog_record record;
+  uint32_t i;
+  int fd;
+
+  fd = cfs_open("plain", CFS_WRITE | CFS_APPEND);
+  for(i = 0; i < SAMPLES; i++) {
+    sample(i, &record);
+    if(cfs_write(fd, &record, sizeof(record)) != sizeof(record)) {
+      errors++;
+    }
+  }
+  cfs_close(fd);
+  report("cfs append", SAMPLES);
+}
+/*---------------------------------------------------------------------------*/
+static void
+cfs_query(void)
+{
+  struct tslog_record record;
+  unsigned long found;
+  int fd;
+
+  found = 0;
+  fd = cfs_open("plain", CFS_READ);
+  while(cfs_read(fd, &record, sizeof(record)) == sizeof(record) &&
+        record.time <= TO) {
+    if(record.time >= FROM && check(&record)) {
+      found++;
+    }
+  }
+  cfs_close(fd);
+  report("cfs query", found);
+}
+/*---------------------------------------------------------------------------*/
+static void
+tslog_log(uint32_t first, uint32_t count)
+{
+  struct tslog_record record;
+  uint32_t i;
+
+  for(i = first; i < first + count; i++) {
+    sample(i, &record);
+    if(tslog_append(&log, &record) < 0) {
+      errors++;
+    }
+  }
+  if(tslog_flush(&log) < 0) {
+    errors++;
+  }
+  report("tslog append", count);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+tslog_count(uint32_t from, uint32_t to, uint32_t *first)
+{
+  struct tslog_record record;
+  unsigned long found;
+  uint32_t last;
+
+  found = 0;
+  last = 0;
+  tslog_query(&log, &cursor, from, to);
+  while(tslog_next(&cursor, &record) > 0) {
+    if(record.time < from || record.time > to || record.time < last) {
+      errors++;
+    }
+    if(found == 0 && first != NULL) {
+      *first = record.time;
+    }
+    last = record.time;
+    if(check(&record)) {
+      found++;
+    }
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tslog_benchmark_process, ev, data)
+{
+  unsigned long found, total;
+  uint32_t first;
+
+  PROCESS_BEGIN();
+
+  printf("tslog benchmark, %d byte blocks, %d blocks per segment\n",
+         TSLOG_BLOCK_SIZE, TSLOG_SEGMENT_BLOCKS);
+
+  cfs_coffee_format();
+  cfs_coffee_reset_stats();
+
+  cfs_log();
+  cfs_query();
+
+  if(tslog_open(&log, "ts") < 0) {
+    errors++;
+  }
+  tslog_log(0, SAMPLES);
+  found = tslog_count(FROM, TO, NULL);
+  report("tslog query", found);
+  if(found != 100) {
+    errors++;
+  }
+
+  /* Wrap around the segments, and check that the newest records are
+     kept without gaps. */
+  tslog_log(SAMPLES, 4 * SAMPLES);
+  total = tslog_count(0, sample_time(5 * SAMPLES), &first);
+  if(total == 0 || first != sample_time(5 * SAMPLES - total)) {
+    errors++;
+  }
+  printf("retention: %lu records kept, oldest from %lu\n",
+         total, (unsigned long)first);
+
+  /* Reopen the log, as after a reboot. */
+  if(tslog_open(&log, "ts") < 0 ||
+     tslog_count(0, sample_time(5 * SAMPLES), NULL) != total) {
+    errors++;
+  }
+  cfs_coffee_reset_stats();
+  found = tslog_count(sample_time(5 * SAMPLES - 1000),
+                      sample_time(5 * SAMPLES - 900) - 1, NULL);
+  report("tslog query after reopen", found);
+  if(found != 100) {
+    errors++;
+  }
+
+  printf("tslog benchmark done, %d errors\n", errors);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
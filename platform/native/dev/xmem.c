@@ -34,6 +34,7 @@
 
 #include "contiki-conf.h"
 #include "dev/xmem.h"
+#include "sys/cc.h"
 
 #include <stdio.h>
 #include <fcntl.h>
@@ -43,6 +44,61 @@
 
 #define XMEM_SIZE 1024 * 1024
 
+/*
+ * Define XMEM_CONF_FILE as a file name to keep the external memory in
+ * a file instead of in RAM, so that every access costs a system call
+ * like the accesses to a real flash chip cost bus transfers.
+ */
+#ifdef XMEM_CONF_FILE
+static int xmem_fd = -1;
+/*---------------------------------------------------------------------------*/
+static int
+xmem_file(void)
+{
+  if(xmem_fd < 0) {
+    xmem_fd = open(XMEM_CONF_FILE, O_RDWR | O_CREAT, 0644);
+    if(xmem_fd < 0) {
+      perror(XMEM_CONF_FILE);
+    }
+  }
+  return xmem_fd;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_pwrite(const void *buf, int size, unsigned long offset)
+{
+  return pwrite(xmem_file(), buf, size, offset);
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_pread(void *buf, int size, unsigned long offset)
+{
+  int r;
+
+  r = pread(xmem_file(), buf, size, offset);
+  if(r >= 0 && r < size) {
+    /* Never written bytes are erased. */
+    memset((char *)buf + r, 0, size - r);
+    r = size;
+  }
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_erase(long nbytes, unsigned long offset)
+{
+  static const unsigned char erased[4096];
+  long n;
+
+  for(n = 0; n < nbytes; n += sizeof(erased)) {
+    if(pwrite(xmem_file(), erased, MIN(nbytes - n, (long)sizeof(erased)),
+              offset + n) < 0) {
+      return -1;
+    }
+  }
+  return nbytes;
+}
+#else /* XMEM_CONF_FILE */
 static unsigned char xmem[XMEM_SIZE];
 /*---------------------------------------------------------------------------*/
 int
@@ -78,6 +134,7 @@ xmem_erase(long nbytes, unsigned long offset)
   memset(&xmem[offset], 0, nbytes);
   return nbytes;
 }
+#endif /* XMEM_CONF_FILE */
 /*---------------------------------------------------------------------------*/
 void
 xmem_init(void)
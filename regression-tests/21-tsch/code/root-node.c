@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Collection root for the TSCH-MAC tests. Starts the RPL DAG
+ *         and, with TSCH-MAC, the TSCH network, and prints each
+ *         message it receives as "recv <node> <seq>".
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/rpl/rpl.h"
+#include "simple-udp.h"
+#include "apps/benchmark/benchmark.h"
+#if WITH_TSCH
+#include "net/mac/tschmac/tschmac.h"
+#endif /* WITH_TSCH */
+
+#include <stdio.h>
+#include <string.h>
+
+/* Statistics used by the IPv6 stack, see apps/benchmark */
+struct netstat_t UNET_NodeStat;
+char NodeStat_Ctrl = 0;
+
+#define UDP_PORT 1234
+
+struct message {
+  uint16_t node;
+  uint16_t seq;
+};
+
+static struct simple_udp_connection connection;
+/*---------------------------------------------------------------------------*/
+PROCESS(root_node_process, "Collection root");
+AUTOSTART_PROCESSES(&root_node_process);
+/*---------------------------------------------------------------------------*/
+static void
+receiver(struct simple_udp_connection *c,
+         const uip_ipaddr_t *sender_addr,
+         uint16_t sender_port,
+         const uip_ipaddr_t *receiver_addr,
+         uint16_t receiver_port,
+         const uint8_t *data,
+         uint16_t datalen)
+{
+  struct message msg;
+
+  if(datalen == sizeof(msg)) {
+    memcpy(&msg, data, sizeof(msg));
+    printf("recv %u %u\n", msg.node, msg.seq);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(root_node_process, ev, data)
+{
+  static uip_ipaddr_t ipaddr;
+  uip_ipaddr_t prefix;
+  rpl_dag_t *dag;
+
+  PROCESS_BEGIN();
+
+  uip_ip6addr(&ipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+
+  rpl_set_root(RPL_DEFAULT_INSTANCE, &ipaddr);
+  dag = rpl_get_any_dag();
+  uip_ip6addr(&prefix, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  rpl_set_prefix(dag, &prefix, 64);
+
+#if WITH_TSCH
+  tschmac_set_coordinator(1);
+#endif /* WITH_TSCH */
+
+  simple_udp_register(&connection, UDP_PORT, NULL, UDP_PORT, receiver);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
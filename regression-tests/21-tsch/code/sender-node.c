@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Collection sender for the TSCH-MAC tests. Sends a sequence
+ *         numbered message to the root every SEND_INTERVAL and prints
+ *         "send <node> <seq>".
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "simple-udp.h"
+#include "sys/node-id.h"
+#include "apps/benchmark/benchmark.h"
+
+#include <stdio.h>
+
+/* Statistics used by the IPv6 stack, see apps/benchmark */
+struct netstat_t UNET_NodeStat;
+char NodeStat_Ctrl = 0;
+
+#define UDP_PORT 1234
+
+#define SEND_INTERVAL (5 * CLOCK_SECOND)
+/* Give RPL and TSCH-MAC time to form the network */
+#define START_DELAY   (60 * CLOCK_SECOND)
+
+struct message {
+  uint16_t node;
+  uint16_t seq;
+};
+
+static struct simple_udp_connection connection;
+/*---------------------------------------------------------------------------*/
+PROCESS(sender_node_process, "Collection sender");
+AUTOSTART_PROCESSES(&sender_node_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sender_node_process, ev, data)
+{
+  static struct etimer periodic_timer;
+  static struct etimer send_timer;
+  static struct message msg;
+  uip_ipaddr_t addr;
+
+  PROCESS_BEGIN();
+
+  uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&addr, &uip_lladdr);
+  uip_ds6_addr_add(&addr, 0, ADDR_AUTOCONF);
+
+  simple_udp_register(&connection, UDP_PORT, NULL, UDP_PORT, NULL);
+
+  etimer_set(&periodic_timer, START_DELAY);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+
+  etimer_set(&periodic_timer, SEND_INTERVAL);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+    etimer_reset(&periodic_timer);
+    etimer_set(&send_timer, random_rand() % SEND_INTERVAL);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&send_timer));
+
+    /* The root is node 1 */
+    uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0x0201, 0x001, 0x001, 0x001);
+    msg.node = node_id;
+    printf("send %u %u\n", msg.node, msg.seq);
+    simple_udp_sendto(&connection, &msg, sizeof(msg), &addr);
+    msg.seq++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/